@@ -0,0 +1,79 @@
+#include "bloom_filter.h"
+#include <cmath>
+#include <cstdint>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Odd multipliers, one per word; each turns the low half of the hash into a bit index.
+alignas(64) constexpr std::uint32_t kSalt[16] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du, 0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+    0x9e3779b1u, 0x85ebca77u, 0xc2b2ae3du, 0x27d4eb2fu, 0x165667b1u, 0xd3a2646bu, 0xfd7046c5u, 0xb55a4f09u
+};
+
+} // namespace
+
+/**
+ * @brief Construct a filter sized for the expected number of keys.
+ *
+ * @param expectedKeys The number of keys that will be inserted.
+ * @param bitsPerKey The number of filter bits per key.
+ */
+BloomFilter::BloomFilter(std::size_t expectedKeys, double bitsPerKey) {
+    auto bits = static_cast<double>(expectedKeys) * bitsPerKey;
+    auto count = static_cast<std::size_t>(std::ceil(bits / (sizeof(Block) * 8)));
+    blocks.assign(count == 0 ? 1 : count, Block{});
+}
+
+/**
+ * @brief Hash a key with 64-bit FNV-1a and a murmur finalizer.
+ */
+std::uint64_t BloomFilter::hash(std::string_view key) {
+    std::uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+void BloomFilter::insertHash(std::uint64_t h) {
+    if (blocks.empty()) return;
+    Block& block = blocks[blockIndex(h)];
+    auto low = static_cast<std::uint32_t>(h);
+    for (int i = 0; i < 16; i++) {
+        block.words[i] |= 1u << ((low * kSalt[i]) >> 27);
+    }
+}
+
+bool BloomFilter::mayContainHash(std::uint64_t h) const {
+    if (blocks.empty()) return false;
+    const Block& block = blocks[blockIndex(h)];
+    auto low = static_cast<std::uint32_t>(h);
+#ifdef __AVX2__
+    const __m256i key = _mm256_set1_epi32(static_cast<int>(low));
+    const __m256i one = _mm256_set1_epi32(1);
+    for (int half = 0; half < 2; half++) {
+        __m256i salt = _mm256_load_si256(reinterpret_cast<const __m256i*>(kSalt + half * 8));
+        __m256i shift = _mm256_srli_epi32(_mm256_mullo_epi32(key, salt), 27);
+        __m256i mask = _mm256_sllv_epi32(one, shift);
+        __m256i words = _mm256_load_si256(reinterpret_cast<const __m256i*>(block.words + half * 8));
+        // testc is 1 iff every bit of mask is set in words
+        if (!_mm256_testc_si256(words, mask)) return false;
+    }
+    return true;
+#else
+    for (int i = 0; i < 16; i++) {
+        if (!(block.words[i] & (1u << ((low * kSalt[i]) >> 27)))) return false;
+    }
+    return true;
+#endif
+}
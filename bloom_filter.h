@@ -0,0 +1,93 @@
+#pragma once
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief A blocked Bloom filter for fast rejection of absent keys.
+ *
+ * Each key maps to a single 64-byte block (one cache line) made of sixteen
+ * 32-bit words, and sets exactly one bit in each word. A lookup therefore
+ * touches one cache line, and with AVX2 the sixteen bit tests are done with
+ * two vector compares. At the default 16 bits per key the false positive
+ * rate is about 0.2% (about 1.3% at 12 bits); there are no false negatives.
+ *
+ * Its hash() is also the 64-bit key hash of the stored tables and indexes.
+ */
+class BloomFilter {
+public:
+    /**
+     * @brief Construct an empty filter that rejects every key.
+     */
+    BloomFilter() = default;
+
+    /**
+     * @brief Construct a filter sized for the expected number of keys.
+     *
+     * @param expectedKeys The number of keys that will be inserted.
+     * @param bitsPerKey The number of filter bits per key; more bits lower the false positive rate.
+     */
+    explicit BloomFilter(std::size_t expectedKeys, double bitsPerKey = 16.0);
+
+    /**
+     * @brief Insert a key into the filter.
+     *
+     * @param key The key to insert.
+     */
+    void insert(std::string_view key) {
+        insertHash(hash(key));
+    }
+
+    /**
+     * @brief Check whether a key may have been inserted.
+     *
+     * @param key The key to test.
+     * @return false if the key was definitely not inserted, true if it probably was.
+     */
+    bool mayContain(std::string_view key) const {
+        return mayContainHash(hash(key));
+    }
+
+    /**
+     * @brief Insert a key given its hash(), e.g. when the hash is already known.
+     */
+    void insertHash(std::uint64_t h);
+
+    /**
+     * @brief Test a key given its hash().
+     */
+    bool mayContainHash(std::uint64_t h) const;
+
+    /**
+     * @brief Hash a key the way the filter does.
+     *
+     * @param key The key to hash.
+     * @return A 64-bit hash of the key.
+     */
+    static std::uint64_t hash(std::string_view key);
+
+    /**
+     * @brief Get the size of the filter in bytes.
+     */
+    std::size_t bytes() const {
+        return blocks.size() * sizeof(Block);
+    }
+
+private:
+    struct alignas(64) Block {
+        std::uint32_t words[16];
+    };
+
+    std::vector<Block> blocks;
+
+    std::size_t blockIndex(std::uint64_t h) const {
+        // Map the high half of the hash onto [0, blocks) without a division
+        return static_cast<std::size_t>(((h >> 32) * blocks.size()) >> 32);
+    }
+};
+
+#endif
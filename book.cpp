@@ -1,11 +1,10 @@
 #include "book.h"
 #include <typeinfo>
 #include <stdexcept>
-#include "third_parties/cpp-httplib/httplib.h"
 #include "third_parties/nlohmann/json.hpp"
 #include "utils.hpp"
-
-extern httplib::Client client;
+#include "isbn.h"
+#include "metadata.h"
 
 /**
  * @brief Construct a new Book object.
@@ -28,27 +27,35 @@ Book::Book(const std::string& id, const std::string& author, const std::string&
  * This constructor initializes a new Book object with the given attributes.
  * It retrieves additional information about the book from an external API using the ISBN.
  * 
+ * The ISBN is canonicalized to its 13 digit form before the request, so that
+ * different spellings of the same book share one request and cache key.
+ * 
  * @param id The unique identifier for the book citation.
  * @param isbn The International Standard Book Number (ISBN) of the book.
+ * 
+ * @throws std::invalid_argument If the ISBN is malformed or its checksum is invalid.
+ * @throws std::runtime_error If the book information cannot be retrieved.
  */
 Book::Book(const std::string& id, const std::string& isbn) : Citation{id} {
-    // Make a GET request to retrieve book information using the ISBN
-    auto result = client.Get("/isbn/" + encodeUriComponent(isbn));
-
-    // Check if the request was successful (HTTP status code 200)
-    if(result && result->status == httplib::OK_200) {
-        // Parse the response body as JSON
-        auto jsonObj = nlohmann::json::parse(result->body);
+    // Reject malformed ISBNs locally instead of paying for a network round trip
+    std::string canonical;
+    if(!normalizeIsbn(isbn, canonical)) {
+        throw std::invalid_argument("Invalid ISBN: " + isbn);
+    }
 
+    // Retrieve book information using the canonical ISBN
+    nlohmann::json jsonObj;
+    if(fetchMetadata(MetadataKind::Isbn, canonical, jsonObj)) {
         // Extract book information from the JSON object
-        if(!check_string(jsonObj, "author") || !check_string(jsonObj, "title") || !check_string(jsonObj, "publisher") || !check_string(jsonObj, "year")) exit(1);
+        if(!check_string(jsonObj, "author") || !check_string(jsonObj, "title") || !check_string(jsonObj, "publisher") || !check_string(jsonObj, "year"))
+            throw std::runtime_error("Incomplete book information for ISBN: " + isbn);
         author = jsonObj["author"].get<std::string>();
         title = jsonObj["title"].get<std::string>();
         publisher = jsonObj["publisher"].get<std::string>();
         year = jsonObj["year"].get<std::string>();
     } else {
         // Handle HTTP errors
-        std::exit(1);
+        throw std::runtime_error("Cannot retrieve book information for ISBN: " + isbn);
     }
 }
 
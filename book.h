@@ -47,9 +47,13 @@ public:
      * 
      * This constructor intializes a new Book object with the given attributes.
      * It takes a unique identifier and an ISBN number to fetch book information from an external API.
+     * The ISBN is validated and canonicalized to ISBN-13 before the request is made.
      * 
      * @param id The unique identifier for the book citation.
      * @param isbn The ISBN number of the book.
+     * 
+     * @throws std::invalid_argument If the ISBN is malformed or its checksum is invalid.
+     * @throws std::runtime_error If the book information cannot be retrieved.
     */
     Book(const std::string& id, const std::string& isbn);
 
@@ -0,0 +1,426 @@
+#include "checker.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+
+#include "bloom_filter.h"
+#include "isbn.h"
+#include "json_lines.h"
+#include "library.h"
+#include "thread_pool.h"
+#include "url.h"
+#include "third_parties/nlohmann/json.hpp"
+
+namespace {
+
+enum Field { Type, Id, Isbn, Url, Title, Author, Journal, Year, Volume, Issue, kFieldCount };
+constexpr std::string_view kFieldNames[kFieldCount] = {"type", "id", "isbn", "url", "title",
+                                                      "author", "journal", "year", "volume", "issue"};
+constexpr int kStoredFields = Url + 1;  // The fields whose string values are kept
+
+enum class Kind : unsigned char { Absent, String, Number, Other };
+
+constexpr std::size_t kNoToken = static_cast<std::size_t>(-1);
+
+// The loader's limit on the nesting it searches
+const std::size_t kMaxDepth = CitationWalkOptions{}.maxDepth;
+
+/**
+ * @brief The entries and problems found in one JSON document or in one chunk of a JSON Lines file.
+ */
+struct Unit {
+    /**
+     * @brief A citation entry: its ID and where it is.
+     */
+    struct Entry {
+        std::size_t idOffset;   //!< The offset of the ID in ids.
+        std::size_t idLength;
+        std::size_t container;  //!< The pointer of its container in containers.
+        std::size_t token;      //!< Its index in the container, or kNoToken if the container is the entry itself.
+        std::size_t line;
+    };
+
+    std::size_t file = 0;
+    std::size_t lines = 0;                 //!< The number of lines of a chunk.
+    std::vector<LibraryProblem> problems;
+    std::vector<Entry> entries;
+    std::string ids;                       //!< The IDs of the entries, one after the other.
+    std::vector<std::string> containers;
+
+    std::string_view idOf(const Entry& entry) const {
+        return std::string_view{ids}.substr(entry.idOffset, entry.idLength);
+    }
+
+    std::string pointerOf(const Entry& entry) const {
+        return containers[entry.container] + (entry.token == kNoToken ? "" : "/" + std::to_string(entry.token));
+    }
+};
+
+/**
+ * @brief SAX handler that checks the objects of a JSON document as they end.
+ *
+ * Each open object keeps the kind of its known fields and the strings of
+ * "type", "id", "isbn" and "url". The problems and entries found inside an
+ * object are recorded at once; when the object turns out to be a citation
+ * entry, or an array sits directly in an array, they are dropped again, since
+ * the loader does not look inside either. For the same reason only the
+ * containers the loader searches count towards its depth limit, which is
+ * checked when the document ends.
+ */
+class CheckingSax {
+public:
+    explicit CheckingSax(Unit& unit) : unit{unit} {}
+
+    /**
+     * @brief Start a new document on a line, 0 for a JSON document.
+     */
+    void startLine(std::size_t line) {
+        this->line = line;
+        depth = 0;
+    }
+
+    bool null() { value(Kind::Other); return true; }
+    bool boolean(bool) { value(Kind::Other); return true; }
+    bool number_integer(nlohmann::json::number_integer_t) { value(Kind::Number); return true; }
+    bool number_unsigned(nlohmann::json::number_unsigned_t) { value(Kind::Number); return true; }
+    bool number_float(nlohmann::json::number_float_t, const std::string&) { value(Kind::Number); return true; }
+    bool binary(nlohmann::json::binary_t&) { value(Kind::Other); return true; }
+
+    bool string(std::string& val) {
+        auto field = value(Kind::String);
+        if(field >= 0 && field < kStoredFields) top().values[field] = val;
+        return true;
+    }
+
+    bool key(std::string& val) {
+        auto& frame = top();
+        frame.key = val;
+        frame.field = -1;
+        for(int f = 0; f < kFieldCount; f++) {
+            // Comparing string_views checks the lengths first
+            if(std::string_view{val} == kFieldNames[f]) frame.field = f;
+        }
+        return true;
+    }
+
+    bool start_object(std::size_t) {
+        value(Kind::Other);
+        push(true);
+        return true;
+    }
+
+    bool end_object() {
+        // A citation entry is not searched, so nothing inside it counts towards the depth
+        end(!checkObject());
+        return true;
+    }
+
+    bool start_array(std::size_t) {
+        value(Kind::Other);
+        push(false);
+        return true;
+    }
+
+    bool end_array() {
+        // The loader searches an array member of an object, the root, and the arrays in a root array
+        end(depth == 1 || frames[depth - 2].object || (depth == 2 && !frames[0].object));
+        // The loader does not look into arrays inside arrays
+        if(depth > 0 && !top().object) drop(frames[depth]);
+        return true;
+    }
+
+    template<class Exception>
+    bool parse_error(std::size_t, const std::string&, const Exception& ex) {
+        unit.problems.push_back({unit.file, line, "", std::string{"invalid JSON: "} + ex.what()});
+        return false;
+    }
+
+private:
+    struct Frame {
+        bool object = false;
+        int field = -1;                     // The field the current key names, or -1
+        std::size_t index = 0;              // The number of elements of an array begun
+        std::size_t container = kNoToken;   // The pointer of the frame in the unit's containers, once needed
+        std::string key;                    // The current key of an object
+        Kind kinds[kFieldCount] = {};
+        std::string values[kStoredFields];
+        std::size_t problems = 0;           // The sizes of the unit's vectors when the frame began
+        std::size_t entries = 0;
+        std::size_t below = 0;              // The deepest nesting of searched containers inside the frame
+    };
+
+    Unit& unit;
+    std::size_t line = 0;
+    std::vector<Frame> frames;              // Reused from one object to the next
+    std::size_t depth = 0;
+
+    Frame& top() {
+        return frames[depth - 1];
+    }
+
+    // Record the kind of a value under a known key, and count the elements of arrays
+    int value(Kind kind) {
+        if(depth == 0) return -1;
+        auto& frame = top();
+        if(!frame.object) {
+            frame.index++;
+            return -1;
+        }
+        if(frame.field >= 0) frame.kinds[frame.field] = kind;
+        return frame.field;
+    }
+
+    void push(bool object) {
+        if(depth == frames.size()) frames.emplace_back();
+        auto& frame = frames[depth++];
+        frame.object = object;
+        frame.field = -1;
+        frame.index = 0;
+        frame.container = kNoToken;
+        frame.below = 0;
+        std::fill(std::begin(frame.kinds), std::end(frame.kinds), Kind::Absent);
+        frame.problems = unit.problems.size();
+        frame.entries = unit.entries.size();
+    }
+
+    // Close the innermost container, adding it to the nesting of its parent if the loader searches it
+    void end(bool searched) {
+        auto nesting = searched ? top().below + 1 : 0;
+        depth--;
+        if(depth > 0) frames[depth - 1].below = std::max(frames[depth - 1].below, nesting);
+        else if(nesting > kMaxDepth)
+            report("", "citation data nested deeper than " + std::to_string(kMaxDepth) + " levels");
+    }
+
+    void drop(const Frame& frame) {
+        unit.problems.resize(frame.problems);
+        if(unit.entries.size() > frame.entries) unit.ids.resize(unit.entries[frame.entries].idOffset);
+        unit.entries.resize(frame.entries);
+    }
+
+    // The JSON pointer of the value open at a depth
+    std::string pointerAt(std::size_t at) const {
+        std::string pointer;
+        for(std::size_t k = 1; k < at; k++) {
+            const auto& parent = frames[k - 1];
+            pointer += '/';
+            if(!parent.object) {
+                pointer += std::to_string(parent.index - 1);
+                continue;
+            }
+            for(char c : parent.key) {
+                if(c == '~') pointer += "~0";
+                else if(c == '/') pointer += "~1";
+                else pointer += c;
+            }
+        }
+        return pointer;
+    }
+
+    std::size_t intern(std::string pointer) {
+        unit.containers.push_back(std::move(pointer));
+        return unit.containers.size() - 1;
+    }
+
+    void report(const std::string& pointer, std::string message) {
+        unit.problems.push_back({unit.file, line, pointer, std::move(message)});
+    }
+
+    // Report the missing or mistyped required fields of an object; true if there are none
+    bool checkFields(const Frame& frame, std::initializer_list<Field> fields, Kind kind) {
+        bool valid = true;
+        for(auto field : fields) {
+            if(frame.kinds[field] == kind) continue;
+            valid = false;
+            if(frame.kinds[field] == Kind::Absent)
+                report(pointerAt(depth), "\"" + std::string{kFieldNames[field]} + "\" is missing");
+            else
+                report(pointerAt(depth) + "/" + std::string{kFieldNames[field]}, "\"" + std::string{kFieldNames[field]} +
+                       (kind == Kind::String ? "\" must be a string" : "\" must be a number"));
+        }
+        return valid;
+    }
+
+    // Check an object that is ending, as isCitationEntry() and createCitation() would see it; true if it is an entry
+    bool checkObject() {
+        auto& frame = top();
+        if(frame.kinds[Type] == Kind::Absent && frame.kinds[Id] == Kind::Absent) return false;
+
+        bool valid = checkFields(frame, {Type, Id}, Kind::String);
+        if(frame.kinds[Type] == Kind::String) {
+            const auto& type = frame.values[Type];
+            if(type == "book") valid = checkFields(frame, {Isbn}, Kind::String) && valid;
+            else if(type == "webpage") valid = checkFields(frame, {Url}, Kind::String) && valid;
+            else if(type == "article") {
+                valid = checkFields(frame, {Title, Author, Journal}, Kind::String) && valid;
+                valid = checkFields(frame, {Year, Volume, Issue}, Kind::Number) && valid;
+            }
+            else {
+                report(pointerAt(depth) + "/type", "unknown type " + nlohmann::json(type).dump());
+                valid = false;
+            }
+        }
+        if(!valid) return false;
+
+        // A citation entry: what is inside is never looked at
+        drop(frame);
+        std::size_t container, token;
+        if(depth > 1 && !frames[depth - 2].object) {
+            auto& parent = frames[depth - 2];
+            if(parent.container == kNoToken) parent.container = intern(pointerAt(depth - 1));
+            container = parent.container;
+            token = parent.index - 1;
+        }
+        else {
+            container = intern(pointerAt(depth));
+            token = kNoToken;
+        }
+        const auto& id = frame.values[Id];
+        unit.entries.push_back({unit.ids.size(), id.size(), container, token, line});
+        unit.ids += id;
+
+        if(id.empty()) report(pointerAt(depth) + "/id", "the ID is empty");
+        std::string canonical;
+        if(frame.values[Type] == "book" && !normalizeIsbn(frame.values[Isbn], canonical))
+            report(pointerAt(depth) + "/isbn", "invalid ISBN " + nlohmann::json(frame.values[Isbn]).dump());
+        if(frame.values[Type] == "webpage" && !normalizeUrl(frame.values[Url], canonical))
+            report(pointerAt(depth) + "/url", "invalid URL " + nlohmann::json(frame.values[Url]).dump());
+        return true;
+    }
+};
+
+/**
+ * @brief Check one file into units: one for a JSON document, one per chunk for JSON Lines.
+ */
+void checkFile(const std::string& filename, std::size_t file, std::vector<Unit>& units) {
+    std::ifstream input{filename, std::ios::binary};
+    if(!input) {
+        units.emplace_back().file = file;
+        units[0].problems.push_back({file, 0, "", "cannot open the file"});
+        return;
+    }
+    std::string text{std::istreambuf_iterator<char>{input}, std::istreambuf_iterator<char>{}};
+
+    if(!isJsonLinesFile(filename)) {
+        units.emplace_back().file = file;
+        CheckingSax handler{units[0]};
+        handler.startLine(0);
+        nlohmann::json::sax_parse(text.begin(), text.end(), &handler);
+        return;
+    }
+
+    units.resize(lineChunkCount(text.size()));
+    std::vector<CheckingSax> handlers;
+    handlers.reserve(units.size());
+    for(auto& unit : units) {
+        unit.file = file;
+        handlers.emplace_back(unit);
+    }
+    forEachLine(text, units.size(), [&](std::size_t chunk, std::string_view line, std::uint64_t) {
+        // The lines are numbered within the chunk for now
+        auto number = ++units[chunk].lines;
+        if(line.find_first_not_of(" \t\r") == std::string_view::npos) return;
+        handlers[chunk].startLine(number);
+        nlohmann::json::sax_parse(line.begin(), line.end(), &handlers[chunk]);
+    });
+
+    std::size_t before = 0;
+    for(auto& unit : units) {
+        for(auto& problem : unit.problems) problem.line += before;
+        for(auto& entry : unit.entries) entry.line += before;
+        before += unit.lines;
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Check citation libraries without loading them or requesting any metadata.
+ *
+ * Every file is checked by its own task. The IDs of all the entries are then
+ * hashed and sorted by hash, so the IDs defined more than once end up next to
+ * each other and only those are compared.
+ *
+ * @param filenames The paths to the JSON or JSON Lines files.
+ * @param problems A vector to append the problems to, by file; the duplicate IDs come last.
+ * @return The number of citation entries checked.
+ */
+std::size_t checkLibraries(const std::vector<std::string>& filenames, std::vector<LibraryProblem>& problems) {
+    std::vector<std::vector<Unit>> files(filenames.size());
+    if(filenames.size() == 1) {
+        checkFile(filenames[0], 0, files[0]);
+    }
+    else {
+        TaskGroup group{ThreadPool::instance()};
+        for(std::size_t i = 0; i < filenames.size(); i++)
+            group.run([&filenames, &files, i] { checkFile(filenames[i], i, files[i]); });
+        group.wait();
+    }
+
+    std::vector<const Unit*> units;
+    for(const auto& file : files) {
+        for(const auto& unit : file) {
+            units.push_back(&unit);
+            problems.insert(problems.end(), unit.problems.begin(), unit.problems.end());
+        }
+    }
+
+    struct Ref {
+        std::uint64_t hash;
+        std::uint32_t unit;
+        std::uint32_t entry;
+    };
+    std::vector<Ref> refs;
+    for(std::size_t u = 0; u < units.size(); u++) {
+        for(std::size_t e = 0; e < units[u]->entries.size(); e++)
+            refs.push_back({BloomFilter::hash(units[u]->idOf(units[u]->entries[e])),
+                            static_cast<std::uint32_t>(u), static_cast<std::uint32_t>(e)});
+    }
+    std::sort(refs.begin(), refs.end(), [](const Ref& a, const Ref& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.unit != b.unit ? a.unit < b.unit : a.entry < b.entry;
+    });
+
+    // Each later definition of an ID, with the first one
+    std::vector<std::pair<Ref, Ref>> duplicates;
+    auto idOf = [&](const Ref& ref) { return units[ref.unit]->idOf(units[ref.unit]->entries[ref.entry]); };
+    for(std::size_t begin = 0, end = 0; begin < refs.size(); begin = end) {
+        while(end < refs.size() && refs[end].hash == refs[begin].hash) end++;
+        for(auto i = begin + 1; i < end; i++) {
+            for(auto j = begin; j < i; j++) {
+                if(idOf(refs[j]) != idOf(refs[i])) continue;
+                duplicates.emplace_back(refs[i], refs[j]);
+                break;
+            }
+        }
+    }
+    std::sort(duplicates.begin(), duplicates.end(), [](const auto& a, const auto& b) {
+        return a.first.unit != b.first.unit ? a.first.unit < b.first.unit : a.first.entry < b.first.entry;
+    });
+    for(const auto& [duplicate, first] : duplicates) {
+        const auto& unit = *units[duplicate.unit];
+        const auto& entry = unit.entries[duplicate.entry];
+        const auto& firstUnit = *units[first.unit];
+        const auto& firstEntry = firstUnit.entries[first.entry];
+        LibraryProblem original{firstUnit.file, firstEntry.line, firstUnit.pointerOf(firstEntry), ""};
+        problems.push_back({unit.file, entry.line, unit.pointerOf(entry) + "/id",
+                            "duplicate ID " + nlohmann::json(std::string{unit.idOf(entry)}).dump() +
+                            ", first defined at " + formatLocation(filenames, original)});
+    }
+    return refs.size();
+}
+
+/**
+ * @brief Format the location of a problem, e.g. "lib.json:/citations/3/isbn" or "lib.jsonl:12:/isbn".
+ *
+ * @param filenames The paths to the files checked.
+ * @param problem The problem.
+ * @return The file, the line in a JSON Lines file, and the JSON pointer unless it is the whole document.
+ */
+std::string formatLocation(const std::vector<std::string>& filenames, const LibraryProblem& problem) {
+    auto location = filenames[problem.file];
+    if(problem.line > 0) location += ":" + std::to_string(problem.line);
+    if(!problem.pointer.empty()) location += ":" + problem.pointer;
+    return location;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef CHECKER_H
+#define CHECKER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A problem found in a citation library, located by a JSON pointer.
+ */
+struct LibraryProblem {
+    std::size_t file = 0;  //!< The index of the file among those checked.
+    std::size_t line = 0;  //!< The line of a JSON Lines file, from 1; 0 in a JSON document.
+    std::string pointer;   //!< The JSON pointer of the value, within its line in a JSON Lines file.
+    std::string message;   //!< What is wrong.
+};
+
+/**
+ * @brief Check citation libraries without loading them or requesting any metadata.
+ *
+ * The entries are found the way loadLibraries() finds them. An object with a
+ * "type" or "id" field that is not a citation entry, and would therefore be
+ * skipped, is reported with each field it lacks or has of the wrong type. The
+ * citation entries are checked for empty IDs, ISBN checksums and URL syntax,
+ * and every ID defined more than once in all the files is reported with its
+ * first definition. Invalid JSON is reported too, and so is data nested deeper
+ * than the loader searches (CitationWalkOptions::maxDepth).
+ *
+ * The files are checked in parallel, as are the chunks of a JSON Lines file.
+ * The files are streamed through a SAX handler, so no JSON document is built.
+ *
+ * @param filenames The paths to the JSON or JSON Lines files.
+ * @param problems A vector to append the problems to, by file; the duplicate IDs come last.
+ * @return The number of citation entries checked.
+ */
+std::size_t checkLibraries(const std::vector<std::string>& filenames, std::vector<LibraryProblem>& problems);
+
+/**
+ * @brief Format the location of a problem, e.g. "lib.json:/citations/3/isbn" or "lib.jsonl:12:/isbn".
+ *
+ * @param filenames The paths to the files checked.
+ * @param problem The problem.
+ * @return The file, the line in a JSON Lines file, and the JSON pointer unless it is the whole document.
+ */
+std::string formatLocation(const std::vector<std::string>& filenames, const LibraryProblem& problem);
+
+#endif
@@ -0,0 +1,342 @@
+#include "document.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+
+namespace {
+
+// Preferred size of a block; blocks end at the first newline after this many bytes.
+constexpr std::size_t kBlockBytes = 4096;
+
+// The next block version, shared by all documents so that a version is never reused
+std::atomic<std::uint64_t> nextVersion{1};
+
+// Number of UTF-16 code units of a UTF-8 lead byte; continuation bytes count 0
+std::size_t utf16Units(unsigned char c) {
+    if ((c & 0xC0) == 0x80) return 0;
+    return c >= 0xF0 ? 2 : 1;
+}
+
+// The end of the first line that ends at or after from + size bytes, or text.size().
+std::size_t lineEndAfter(std::string_view text, std::size_t from, std::size_t size) {
+    if (from + size >= text.size()) return text.size();
+    auto newline = text.find('\n', from + size - 1);
+    return newline == std::string_view::npos ? text.size() : newline + 1;
+}
+
+} // namespace
+
+/**
+ * @brief Construct a new Document object and scan it.
+ *
+ * @param text The initial text.
+ * @param options The options of the scanner.
+ */
+Document::Document(std::string_view text, ScannerOptions options) : scanner{options}, length{text.size()} {
+    blocks = cut(text);
+    for (auto& block : blocks) remember(block);
+    reindex(0);
+}
+
+/**
+ * @brief Scan a block and store its references.
+ *
+ * @return true if the block can end where it does, false if the end of its text
+ *         cut off a construct or a line, so it has to be merged with the next block.
+ */
+bool Document::scanBlock(Block& block) const {
+    std::vector<CitationOccurrence> found;
+    ScanStatus status;
+    block.wellFormed = scanner.scan(block.text, found, status);
+    block.errorAt = status.errorAt;
+    block.lines = static_cast<std::size_t>(std::count(block.text.begin(), block.text.end(), '\n'));
+    block.references.clear();
+    block.references.reserve(found.size());
+    for (const auto& occurrence : found) {
+        block.references.push_back(Reference{occurrence.begin, occurrence.end,
+                                             occurrence.keyOffset, occurrence.key.size(), occurrence.syntax});
+    }
+    return status.complete && (block.text.empty() || block.text.back() == '\n');
+}
+
+/**
+ * @brief Cut a text into blocks of whole lines that can be scanned independently.
+ *
+ * A block that cannot end where it would is extended by its own size again, so
+ * a long code block is scanned a logarithmic number of times, not once per line.
+ */
+std::vector<Document::Block> Document::cut(std::string_view text) const {
+    std::vector<Block> result;
+    std::size_t start = 0;
+    while (start < text.size()) {
+        std::size_t end = lineEndAfter(text, start, kBlockBytes);
+        Block block;
+        block.text.assign(text.substr(start, end - start));
+        while (!scanBlock(block) && end < text.size()) {
+            end = lineEndAfter(text, start, 2 * (end - start));
+            block.text.assign(text.substr(start, end - start));
+        }
+        block.chunkedSize = block.text.size();
+        result.push_back(std::move(block));
+        start = end;
+    }
+    if (result.empty()) result.emplace_back();
+    return result;
+}
+
+void Document::forget(const Block& block) {
+    if (!block.wellFormed) malformedBlocks--;
+    for (const auto& reference : block.references) {
+        auto found = references.find(block.text.substr(reference.keyBegin, reference.keyLength));
+        if (found != references.end() && --found->second == 0) references.erase(found);
+    }
+}
+
+void Document::remember(Block& block) {
+    block.version = nextVersion++;
+    if (!block.wellFormed) malformedBlocks++;
+    for (const auto& reference : block.references) {
+        references[block.text.substr(reference.keyBegin, reference.keyLength)]++;
+    }
+}
+
+/**
+ * @brief Set the offset and first line of the blocks from a block to the end.
+ *
+ * @param from The index of the first block whose offset may be out of date.
+ */
+void Document::reindex(std::size_t from) {
+    std::size_t start = 0, line = 0;
+    if (from > 0) {
+        const auto& previous = blocks[from - 1];
+        start = previous.start + previous.text.size();
+        line = previous.firstLine + previous.lines;
+    }
+    for (std::size_t index = from; index < blocks.size(); index++) {
+        blocks[index].start = start;
+        blocks[index].firstLine = line;
+        start += blocks[index].text.size();
+        line += blocks[index].lines;
+    }
+}
+
+/**
+ * @brief Rescan a changed block, whose references are already forgotten.
+ *
+ * The block absorbs the blocks after it while it cannot end where it does,
+ * at least doubling each time. A block that has grown much larger than when
+ * it was cut is cut again, so blocks stay small after a code block is closed.
+ */
+void Document::rescan(std::size_t index) {
+    Block& block = blocks[index];
+    while (!scanBlock(block) && index + 1 < blocks.size()) {
+        std::size_t target = block.text.size();
+        std::size_t absorbed = 0, last = index + 1;
+        while (last < blocks.size() && absorbed < target) {
+            forget(blocks[last]);
+            block.text += blocks[last].text;
+            absorbed += blocks[last].text.size();
+            last++;
+        }
+        blocks.erase(blocks.begin() + static_cast<std::ptrdiff_t>(index + 1),
+                     blocks.begin() + static_cast<std::ptrdiff_t>(last));
+    }
+
+    if (block.text.size() > 2 * std::max(block.chunkedSize, kBlockBytes)) {
+        auto pieces = cut(block.text);
+        blocks.erase(blocks.begin() + static_cast<std::ptrdiff_t>(index));
+        for (auto& piece : pieces) remember(piece);
+        blocks.insert(blocks.begin() + static_cast<std::ptrdiff_t>(index),
+                      std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+        return;
+    }
+    remember(block);
+}
+
+/**
+ * @brief Replace a range of the text.
+ *
+ * The blocks overlapping the range are joined, edited and rescanned; the other
+ * blocks, and their references, are not touched.
+ *
+ * @param offset The byte offset of the range; clamped to the size of the text.
+ * @param removed The number of bytes to remove; clamped to the end of the text.
+ * @param inserted The text to insert at offset.
+ */
+void Document::edit(std::size_t offset, std::size_t removed, std::string_view inserted) {
+    offset = std::min(offset, length);
+    removed = std::min(removed, length - offset);
+
+    std::size_t first = findBlock(offset);
+    std::size_t start = blocks[first].start;
+    // Join the blocks up to the one holding the end of the removed range
+    std::size_t last = first + 1, end = start + blocks[first].text.size();
+    while (last < blocks.size() && end < offset + removed) {
+        end += blocks[last].text.size();
+        last++;
+    }
+
+    Block& block = blocks[first];
+    forget(block);
+    for (std::size_t i = first + 1; i < last; i++) {
+        forget(blocks[i]);
+        block.text += blocks[i].text;
+    }
+    blocks.erase(blocks.begin() + static_cast<std::ptrdiff_t>(first + 1),
+                 blocks.begin() + static_cast<std::ptrdiff_t>(last));
+    block.text.replace(offset - start, removed, inserted);
+    length = length - removed + inserted.size();
+
+    rescan(first);
+    if (blocks[first].text.empty() && blocks.size() > 1) {
+        blocks.erase(blocks.begin() + static_cast<std::ptrdiff_t>(first));
+    }
+    reindex(first);
+}
+
+std::string Document::getText() const {
+    std::string text;
+    text.reserve(length);
+    for (const auto& block : blocks) text += block.text;
+    return text;
+}
+
+/**
+ * @brief Get the occurrences in a block with their offsets in the whole text.
+ *
+ * @param block The index of the block.
+ * @param occurrences A vector to append the occurrences to, in text order.
+ */
+void Document::getOccurrences(std::size_t block, std::vector<CitationOccurrence>& occurrences) const {
+    const auto& found = blocks[block];
+    std::size_t start = found.start;
+    for (const auto& reference : found.references) {
+        occurrences.push_back(CitationOccurrence{start + reference.begin, start + reference.end,
+                                                 start + reference.keyBegin,
+                                                 std::string_view{found.text}.substr(reference.keyBegin, reference.keyLength),
+                                                 reference.syntax});
+    }
+}
+
+/**
+ * @brief Find the block containing a byte offset.
+ *
+ * Only the first block can be empty, so the offsets of the blocks are strictly ascending.
+ *
+ * @param offset The offset; the end of the text belongs to the last block.
+ * @return The index of the block.
+ */
+std::size_t Document::findBlock(std::size_t offset) const {
+    auto after = std::upper_bound(blocks.begin() + 1, blocks.end(), offset,
+                                  [](std::size_t offset, const Block& block) { return offset < block.start; });
+    return static_cast<std::size_t>(after - blocks.begin()) - 1;
+}
+
+/**
+ * @brief Convert a line and a UTF-16 column, as used by editors, to a byte offset.
+ *
+ * @param line The 0-based line.
+ * @param character The 0-based column in UTF-16 code units; clamped to the end of the line.
+ * @return The byte offset, clamped to the size of the text.
+ */
+std::size_t Document::offsetAt(std::size_t line, std::size_t character) const {
+    // The last block starting on or before the line; every block but the last holds a newline
+    auto after = std::upper_bound(blocks.begin() + 1, blocks.end(), line,
+                                  [](std::size_t line, const Block& block) { return line < block.firstLine; });
+    const auto& block = *(after - 1);
+    const auto& text = block.text;
+    std::size_t i = 0;
+    for (line -= block.firstLine; line > 0; line--) {
+        auto newline = text.find('\n', i);
+        if (newline == std::string::npos) return block.start + text.size();
+        i = newline + 1;
+    }
+    while (i < text.size() && text[i] != '\n') {
+        auto units = utf16Units(static_cast<unsigned char>(text[i]));
+        if (units > character) break;
+        character -= units;
+        i++;
+    }
+    // Do not stop inside a multi-byte character
+    while (i < text.size() && utf16Units(static_cast<unsigned char>(text[i])) == 0) i++;
+    return block.start + i;
+}
+
+/**
+ * @brief Convert a byte offset to a line and a UTF-16 column.
+ *
+ * @param offset The byte offset; clamped to the size of the text.
+ * @param line Set to the 0-based line.
+ * @param character Set to the 0-based column in UTF-16 code units.
+ */
+void Document::positionAt(std::size_t offset, std::size_t& line, std::size_t& character) const {
+    offset = std::min(offset, length);
+    const auto& block = blocks[findBlock(offset)];
+    const auto& text = block.text;
+    line = block.firstLine;
+    std::size_t relative = offset - block.start, lineStart = 0;
+    for (std::size_t i = 0; i < relative; i++) {
+        if (text[i] == '\n') {
+            line++;
+            lineStart = i + 1;
+        }
+    }
+    character = 0;
+    for (std::size_t i = lineStart; i < relative; i++) character += utf16Units(static_cast<unsigned char>(text[i]));
+}
+
+/**
+ * @brief Get the text from the start of the line holding a byte offset up to the offset.
+ *
+ * @param offset The byte offset.
+ * @return The text before the offset on its line, viewing the document until the next edit.
+ */
+std::string_view Document::lineBefore(std::size_t offset) const {
+    offset = std::min(offset, length);
+    const auto& block = blocks[findBlock(offset)];
+    std::string_view text = block.text;
+    std::size_t relative = offset - block.start;
+    auto newline = relative == 0 ? std::string_view::npos : text.rfind('\n', relative - 1);
+    std::size_t lineStart = newline == std::string_view::npos ? 0 : newline + 1;
+    return text.substr(lineStart, relative - lineStart);
+}
+
+/**
+ * @brief Find the reference key at a byte offset.
+ *
+ * @param offset The byte offset, inside the reference or right after it.
+ * @param occurrence Set to the occurrence whose key contains the offset; for a reference
+ *                   with several keys, the key under the offset or else the first one.
+ * @return true if the offset is in a reference, false otherwise.
+ */
+bool Document::referenceAt(std::size_t offset, CitationOccurrence& occurrence) const {
+    const auto& block = blocks[findBlock(offset)];
+    std::size_t start = block.start;
+    std::size_t relative = offset - start;
+    bool found = false;
+    for (const auto& reference : block.references) {
+        if (relative < reference.begin || relative > reference.end) continue;
+        bool onKey = relative >= reference.keyBegin && relative <= reference.keyBegin + reference.keyLength;
+        if (found && !onKey) continue;
+        occurrence = CitationOccurrence{start + reference.begin, start + reference.end, start + reference.keyBegin,
+                                        std::string_view{block.text}.substr(reference.keyBegin, reference.keyLength),
+                                        reference.syntax};
+        found = true;
+        if (onKey) break;
+    }
+    return found;
+}
+
+/**
+ * @brief Get the offset where a block stops being well formed.
+ *
+ * @param block The index of the block.
+ * @param offset Set to the offset in the whole text if the block is malformed.
+ * @return true if the block is malformed, false otherwise.
+ */
+bool Document::getError(std::size_t block, std::size_t& offset) const {
+    const auto& found = blocks[block];
+    if (found.wellFormed) return false;
+    offset = found.start + std::min(found.errorAt, found.text.size());
+    return true;
+}
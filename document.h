@@ -0,0 +1,200 @@
+#pragma once
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "scanner.h"
+
+/**
+ * @brief Document is an editable text that keeps its citation references up to date incrementally.
+ *
+ * The text is stored as a sequence of blocks of whole lines, a few kilobytes
+ * each. Every block ends where the scanner is in its initial state, so each
+ * block is scanned on its own and its references are kept with it, relative to
+ * the block. An edit only changes and rescans the blocks it touches, and the
+ * reference counts are updated by the difference, so the cost of an edit
+ * depends on the size of the edit and of a block, not on the document.
+ *
+ * Each block knows its offset and first line in the whole text, so a position
+ * is found by a binary search over the blocks and a walk of one block. A block
+ * gets a new version whenever it is rescanned, and a version is never reused,
+ * so a caller can keep results per block and redo only the blocks that changed.
+ *
+ * A block that a code block, comment or citation command would run past is
+ * merged with the blocks after it until the construct ends, so the references
+ * are the same as those of a scan of the whole text. The one exception is a
+ * bracket or brace left open at the end of a line that starts a new block: it
+ * is reported as malformed rather than continued in the next block, so typing
+ * an opening bracket does not rescan the rest of the document.
+ */
+class Document {
+public:
+    /**
+     * @brief Construct a new Document object and scan it.
+     *
+     * @param text The initial text.
+     * @param options The options of the scanner.
+     */
+    explicit Document(std::string_view text = {}, ScannerOptions options = {});
+
+    /**
+     * @brief Replace a range of the text.
+     *
+     * @param offset The byte offset of the range; clamped to the size of the text.
+     * @param removed The number of bytes to remove; clamped to the end of the text.
+     * @param inserted The text to insert at offset.
+     */
+    void edit(std::size_t offset, std::size_t removed, std::string_view inserted);
+
+    /**
+     * @brief Get the whole text.
+     */
+    std::string getText() const;
+
+    /**
+     * @brief Get the size of the text in bytes.
+     */
+    std::size_t size() const {
+        return length;
+    }
+
+    /**
+     * @brief Check whether every reference of the text is well formed.
+     */
+    bool isWellFormed() const {
+        return malformedBlocks == 0;
+    }
+
+    /**
+     * @brief Get the cited keys, each with the number of times it is cited.
+     */
+    const std::unordered_map<std::string, std::size_t>& getReferences() const {
+        return references;
+    }
+
+    /**
+     * @brief Get the number of blocks the text is stored in.
+     */
+    std::size_t blockCount() const {
+        return blocks.size();
+    }
+
+    /**
+     * @brief Get the version of a block, which changes whenever the block is rescanned.
+     *
+     * @param block The index of the block.
+     * @return A number that no other block of any document has had or will have.
+     */
+    std::uint64_t blockVersion(std::size_t block) const {
+        return blocks[block].version;
+    }
+
+    /**
+     * @brief Get the line a block starts on; every block starts at the start of a line.
+     *
+     * @param block The index of the block.
+     * @return The 0-based line.
+     */
+    std::size_t blockLine(std::size_t block) const {
+        return blocks[block].firstLine;
+    }
+
+    /**
+     * @brief Get the occurrences in a block with their offsets in the whole text.
+     *
+     * @param block The index of the block.
+     * @param occurrences A vector to append the occurrences to, in text order.
+     *                    The keys view the document and are valid until the next edit.
+     */
+    void getOccurrences(std::size_t block, std::vector<CitationOccurrence>& occurrences) const;
+
+    /**
+     * @brief Get the offset where a block stops being well formed.
+     *
+     * @param block The index of the block.
+     * @param offset Set to the offset in the whole text if the block is malformed.
+     * @return true if the block is malformed, false otherwise.
+     */
+    bool getError(std::size_t block, std::size_t& offset) const;
+
+    /**
+     * @brief Find the reference key at a byte offset.
+     *
+     * @param offset The byte offset, inside the reference or right after it.
+     * @param occurrence Set to the occurrence; its key views the document until the next edit.
+     * @return true if the offset is in a reference, false otherwise.
+     */
+    bool referenceAt(std::size_t offset, CitationOccurrence& occurrence) const;
+
+    /**
+     * @brief Get the text from the start of the line holding a byte offset up to the offset.
+     *
+     * @param offset The byte offset.
+     * @return The text before the offset on its line, viewing the document until the next edit.
+     */
+    std::string_view lineBefore(std::size_t offset) const;
+
+    /**
+     * @brief Convert a line and a UTF-16 column, as used by editors, to a byte offset.
+     *
+     * @param line The 0-based line.
+     * @param character The 0-based column in UTF-16 code units; clamped to the end of the line.
+     * @return The byte offset, clamped to the size of the text.
+     */
+    std::size_t offsetAt(std::size_t line, std::size_t character) const;
+
+    /**
+     * @brief Convert a byte offset to a line and a UTF-16 column.
+     *
+     * @param offset The byte offset; clamped to the size of the text.
+     * @param line Set to the 0-based line.
+     * @param character Set to the 0-based column in UTF-16 code units.
+     */
+    void positionAt(std::size_t offset, std::size_t& line, std::size_t& character) const;
+
+private:
+    /**
+     * @brief A reference in a block, with offsets relative to the start of the block.
+     */
+    struct Reference {
+        std::size_t begin;
+        std::size_t end;
+        std::size_t keyBegin;
+        std::size_t keyLength;
+        CitationSyntax syntax;
+    };
+
+    struct Block {
+        std::string text;
+        std::vector<Reference> references;
+        bool wellFormed = true;
+        std::size_t errorAt = 0;      //!< Where the block stops being well formed, if it does.
+        std::size_t lines = 0;        //!< The number of newlines in the block.
+        std::size_t chunkedSize = 0;  //!< The size of the block when it was last cut, to detect growth.
+        std::size_t start = 0;        //!< The offset of the block in the whole text.
+        std::size_t firstLine = 0;    //!< The line the block starts on.
+        std::uint64_t version = 0;    //!< Set anew whenever the references of the block are remembered.
+    };
+
+    CitationScanner scanner;
+    std::vector<Block> blocks;
+    std::size_t length = 0;
+    std::size_t malformedBlocks = 0;
+    std::unordered_map<std::string, std::size_t> references;
+
+    std::size_t findBlock(std::size_t offset) const;
+    void reindex(std::size_t from);
+    bool scanBlock(Block& block) const;
+    void forget(const Block& block);
+    void remember(Block& block);
+    void rescan(std::size_t index);
+    std::vector<Block> cut(std::string_view text) const;
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include "html_title.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+/**
+ * @brief The named character references, sorted by name for a binary search.
+ */
+constexpr std::pair<std::string_view, std::uint32_t> kEntities[] = {
+    {"AElig", 0xC6}, {"Aacute", 0xC1}, {"Agrave", 0xC0}, {"Auml", 0xC4}, {"Ccedil", 0xC7},
+    {"Eacute", 0xC9}, {"Egrave", 0xC8}, {"Ntilde", 0xD1}, {"Oacute", 0xD3}, {"Ouml", 0xD6},
+    {"Uuml", 0xDC}, {"aacute", 0xE1}, {"agrave", 0xE0}, {"amp", 0x26}, {"apos", 0x27},
+    {"auml", 0xE4}, {"bull", 0x2022}, {"ccedil", 0xE7}, {"copy", 0xA9}, {"deg", 0xB0},
+    {"eacute", 0xE9}, {"egrave", 0xE8}, {"euro", 0x20AC}, {"gt", 0x3E}, {"hellip", 0x2026},
+    {"iacute", 0xED}, {"laquo", 0xAB}, {"ldquo", 0x201C}, {"lsquo", 0x2018}, {"lt", 0x3C},
+    {"mdash", 0x2014}, {"middot", 0xB7}, {"nbsp", 0xA0}, {"ndash", 0x2013}, {"ntilde", 0xF1},
+    {"oacute", 0xF3}, {"ouml", 0xF6}, {"pound", 0xA3}, {"quot", 0x22}, {"raquo", 0xBB},
+    {"rdquo", 0x201D}, {"reg", 0xAE}, {"rsquo", 0x2019}, {"sect", 0xA7}, {"szlig", 0xDF},
+    {"times", 0xD7}, {"trade", 0x2122}, {"uacute", 0xFA}, {"uuml", 0xFC}, {"yen", 0xA5},
+};
+
+void appendUtf8(std::string& out, std::uint32_t c) {
+    if (c < 0x80) {
+        out += static_cast<char>(c);
+    }
+    else if (c < 0x800) {
+        out += static_cast<char>(0xC0 | (c >> 6));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000) {
+        out += static_cast<char>(0xE0 | (c >> 12));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+    else {
+        out += static_cast<char>(0xF0 | (c >> 18));
+        out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+}
+
+/**
+ * @brief Decode the reference at the start of a text, which starts after the '&'.
+ *
+ * @return The length of the reference up to and including the ';', or 0 if it is not one.
+ */
+std::size_t decodeReference(std::string_view text, std::uint32_t& c) {
+    auto semicolon = text.substr(0, 32).find(';');
+    if (semicolon == std::string_view::npos || semicolon == 0) return 0;
+    auto name = text.substr(0, semicolon);
+    if (name[0] == '#') {
+        bool hex = name.size() > 1 && (name[1] == 'x' || name[1] == 'X');
+        auto digits = name.substr(hex ? 2 : 1);
+        if (digits.empty()) return 0;
+        c = 0;
+        for (char d : digits) {
+            std::uint32_t value;
+            if (d >= '0' && d <= '9') value = static_cast<std::uint32_t>(d - '0');
+            else if (hex && d >= 'a' && d <= 'f') value = static_cast<std::uint32_t>(d - 'a' + 10);
+            else if (hex && d >= 'A' && d <= 'F') value = static_cast<std::uint32_t>(d - 'A' + 10);
+            else return 0;
+            c = c * (hex ? 16 : 10) + value;
+            if (c > 0x10FFFF) return 0;
+        }
+        // Surrogates and NUL are not characters; browsers show the replacement character
+        if (c == 0 || (c >= 0xD800 && c <= 0xDFFF)) c = 0xFFFD;
+        return semicolon + 1;
+    }
+    auto found = std::lower_bound(std::begin(kEntities), std::end(kEntities), name,
+                                  [](const auto& entity, std::string_view key) { return entity.first < key; });
+    if (found == std::end(kEntities) || found->first != name) return 0;
+    c = found->second;
+    return semicolon + 1;
+}
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+/**
+ * @brief Test whether a text starts with a lowercase tag name, in any case, ending the name there.
+ */
+bool startsWithTag(std::string_view text, std::string_view name) {
+    if (text.size() <= name.size()) return false;
+    for (std::size_t i = 0; i < name.size(); i++) {
+        if ((text[i] | 0x20) != name[i]) return false;
+    }
+    auto next = text[name.size()];
+    return isSpace(next) || next == '>' || next == '/';
+}
+
+/**
+ * @brief Find the end tag of an element whose text is not markup, such as a title or a script.
+ *
+ * @return The position of the '<' of the end tag, or npos.
+ */
+std::size_t findEndTag(std::string_view html, std::size_t from, std::string_view name) {
+    while (true) {
+        auto p = static_cast<const char*>(std::memchr(html.data() + from, '<', html.size() - from));
+        if (p == nullptr) return std::string_view::npos;
+        auto at = static_cast<std::size_t>(p - html.data());
+        if (at + 1 < html.size() && html[at + 1] == '/' && startsWithTag(html.substr(at + 2), name)) return at;
+        from = at + 1;
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Decode the character references of HTML text.
+ *
+ * @param text The text.
+ * @param decoded A string to append the decoded text to.
+ */
+void decodeHtmlEntities(std::string_view text, std::string& decoded) {
+    std::size_t from = 0;
+    for (auto at = text.find('&'); at != std::string_view::npos; at = text.find('&', from)) {
+        decoded.append(text.substr(from, at - from));
+        std::uint32_t c = 0;
+        auto length = decodeReference(text.substr(at + 1), c);
+        if (length == 0) {
+            decoded += '&';
+            from = at + 1;
+            continue;
+        }
+        appendUtf8(decoded, c);
+        from = at + 1 + length;
+    }
+    decoded.append(text.substr(from));
+}
+
+/**
+ * @brief Extract the title of an HTML document.
+ *
+ * @param html The document.
+ * @param title Receives the title.
+ * @return true if the document has a non-empty title, false otherwise.
+ */
+bool extractHtmlTitle(std::string_view html, std::string& title) {
+    std::size_t from = 0;
+    while (from < html.size()) {
+        auto p = static_cast<const char*>(std::memchr(html.data() + from, '<', html.size() - from));
+        if (p == nullptr) return false;
+        auto at = static_cast<std::size_t>(p - html.data());
+        auto rest = html.substr(at + 1);
+        if (rest.substr(0, 3) == "!--") {
+            auto end = html.find("-->", at + 4);
+            if (end == std::string_view::npos) return false;
+            from = end + 3;
+            continue;
+        }
+        if (startsWithTag(rest, "script") || startsWithTag(rest, "style")) {
+            auto end = findEndTag(html, at + 1, startsWithTag(rest, "script") ? "script" : "style");
+            if (end == std::string_view::npos) return false;
+            from = end + 2;
+            continue;
+        }
+        if (startsWithTag(rest, "body") || (rest.size() > 1 && rest[0] == '/' && startsWithTag(rest.substr(1), "head")))
+            return false;
+        if (!startsWithTag(rest, "title")) {
+            from = at + 1;
+            continue;
+        }
+
+        auto open = html.find('>', at);
+        if (open == std::string_view::npos) return false;
+        auto close = findEndTag(html, open + 1, "title");
+        if (close == std::string_view::npos) return false;
+
+        std::string decoded;
+        decodeHtmlEntities(html.substr(open + 1, close - open - 1), decoded);
+        // Collapse whitespace like a browser does in the tab of the page
+        title.clear();
+        for (char c : decoded) {
+            if (!isSpace(c)) title += c;
+            else if (!title.empty() && title.back() != ' ') title += ' ';
+        }
+        if (!title.empty() && title.back() == ' ') title.pop_back();
+        return !title.empty();
+    }
+    return false;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#ifndef HTML_TITLE_H
+#define HTML_TITLE_H
+
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Extract the title of an HTML document.
+ *
+ * The document is scanned from the start for the <title> element, jumping
+ * from one '<' to the next with memchr(), which compares many bytes at a time.
+ * Comments, scripts and styles are skipped, and the scan stops at </head> or
+ * <body>, so the rest of a page is never read. The text of the title has its
+ * character references decoded and its runs of whitespace collapsed.
+ *
+ * @param html The document, assumed to be UTF-8.
+ * @param title Receives the title.
+ * @return true if the document has a non-empty title, false otherwise.
+ */
+bool extractHtmlTitle(std::string_view html, std::string& title);
+
+/**
+ * @brief Decode the character references of HTML text, e.g. "&amp;", "&#233;" and "&#x2014;".
+ *
+ * The common named references are known; an unknown or malformed reference
+ * is kept as it is, like browsers do.
+ *
+ * @param text The text.
+ * @param decoded A string to append the decoded UTF-8 text to.
+ */
+void decodeHtmlEntities(std::string_view text, std::string& decoded);
+
+#endif
@@ -0,0 +1,87 @@
+#include "isbn.h"
+
+namespace {
+
+// Return true if c separates ISBN groups and should be ignored.
+bool isSeparator(char c) {
+    return c == '-' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Skip a leading "ISBN", "ISBN-10", "ISBN-13" or "ISBN13" label with an optional colon.
+std::string::size_type skipPrefix(const std::string& s) {
+    std::string::size_type i = 0;
+    while (i < s.size() && isSeparator(s[i])) i++;
+    if (s.size() - i < 4) return i;
+    for (std::string::size_type k = 0; k < 4; k++) {
+        if ((s[i + k] | 0x20) != "isbn"[k]) return i;
+    }
+    i += 4;
+    if (i < s.size() && s[i] == '-') i++;
+    // Only treat "10"/"13" as part of the label when a colon or separator follows it
+    if (i + 2 < s.size() && s[i] == '1' && (s[i + 1] == '0' || s[i + 1] == '3') &&
+        (s[i + 2] == ':' || isSeparator(s[i + 2]))) i += 2;
+    if (i < s.size() && s[i] == ':') i++;
+    return i;
+}
+
+} // namespace
+
+/**
+ * @brief Canonicalize an ISBN to its 13-digit form.
+ *
+ * The digits are collected into a fixed buffer in a single pass, so no
+ * allocation happens until the canonical string is written.
+ *
+ * @param isbn The ISBN as written in the library.
+ * @param canonical Receives the 13 digit canonical form if the ISBN is valid.
+ * @return true if the ISBN is valid, false otherwise.
+ */
+bool normalizeIsbn(const std::string& isbn, std::string& canonical) {
+    char digits[13];
+    int count = 0;
+
+    for (auto i = skipPrefix(isbn); i < isbn.size(); i++) {
+        char c = isbn[i];
+        if (isSeparator(c)) continue;
+        if (count == 13) return false;
+        if (c >= '0' && c <= '9') {
+            digits[count++] = c;
+        } else if ((c == 'X' || c == 'x') && count == 9) {
+            // 'X' stands for 10 and is only allowed as an ISBN-10 check digit
+            digits[count++] = 'X';
+        } else {
+            return false;
+        }
+    }
+
+    if (count == 10) {
+        // ISBN-10: sum of digit * (10 - position) must be divisible by 11
+        int sum = 0;
+        for (int k = 0; k < 10; k++) {
+            int value = digits[k] == 'X' ? 10 : digits[k] - '0';
+            sum += value * (10 - k);
+        }
+        if (sum % 11 != 0) return false;
+
+        // Convert to ISBN-13 by prefixing 978 and recomputing the check digit
+        char result[13] = {'9', '7', '8'};
+        for (int k = 0; k < 9; k++) result[k + 3] = digits[k];
+        int weighted = 0;
+        for (int k = 0; k < 12; k++) weighted += (result[k] - '0') * (k % 2 == 0 ? 1 : 3);
+        result[12] = static_cast<char>('0' + (10 - weighted % 10) % 10);
+        canonical.assign(result, 13);
+        return true;
+    }
+
+    if (count == 13) {
+        if (digits[9] == 'X') return false;
+        // ISBN-13: alternating weights 1 and 3, total must be divisible by 10
+        int weighted = 0;
+        for (int k = 0; k < 13; k++) weighted += (digits[k] - '0') * (k % 2 == 0 ? 1 : 3);
+        if (weighted % 10 != 0) return false;
+        canonical.assign(digits, 13);
+        return true;
+    }
+
+    return false;
+}
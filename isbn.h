@@ -0,0 +1,23 @@
+#pragma once
+#ifndef ISBN_H
+#define ISBN_H
+
+#include <string>
+
+/**
+ * @brief Canonicalize an ISBN to its 13-digit form.
+ *
+ * This function strips an optional "ISBN" / "ISBN-10:" / "ISBN-13:" prefix and
+ * all hyphen and whitespace separators, validates the checksum of the remaining
+ * ISBN-10 or ISBN-13, and converts ISBN-10 to ISBN-13 (978 prefix). Different
+ * spellings of the same book therefore map to the same canonical string, which
+ * is used both for the metadata request and as its cache key.
+ *
+ * @param isbn The ISBN as written in the library, e.g. "0-201-89683-4".
+ * @param canonical Receives the 13 digit canonical form, e.g. "9780201896831".
+ *                  It is left unchanged if the ISBN is invalid.
+ * @return true if the ISBN is well-formed and its checksum is valid, false otherwise.
+ */
+bool normalizeIsbn(const std::string& isbn, std::string& canonical);
+
+#endif
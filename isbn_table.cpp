@@ -0,0 +1,243 @@
+#include "isbn_table.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include "isbn.h"
+#include "json_lines.h"
+#include "metadata.h"
+#include "thread_pool.h"
+#include "utils.hpp"
+
+namespace {
+
+using Row = RecordTable::Row;
+
+std::uint64_t keyOf(const std::string& canonical) {
+    std::uint64_t key = 0;
+    for (char c : canonical) key = key * 10 + static_cast<std::uint64_t>(c - '0');
+    return key;
+}
+
+std::string_view trim(std::string_view text) {
+    auto begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) return {};
+    return text.substr(begin, text.find_last_not_of(" \t\r") - begin + 1);
+}
+
+// The fields of a record, all strings, that a Book is built from
+const char* const kBookFields[] = {"author", "title", "publisher", "year"};
+
+/**
+ * @brief Split a CSV row into its fields, undoing the quoting of RFC 4180.
+ */
+void splitCsv(std::string_view line, std::vector<std::string>& fields) {
+    fields.clear();
+    fields.emplace_back();
+    bool quoted = false;
+    for (std::size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (quoted) {
+            if (c != '"') fields.back() += c;
+            else if (i + 1 < line.size() && line[i + 1] == '"') fields.back() += line[++i];
+            else quoted = false;
+        }
+        else if (c == '"') quoted = true;
+        else if (c == ',') fields.emplace_back();
+        else fields.back() += c;
+    }
+}
+
+void appendJsonString(std::string& out, std::string_view text) {
+    out += '"';
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        }
+        else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else {
+            out += static_cast<char>(c);
+        }
+    }
+    out += '"';
+}
+
+/**
+ * @brief The rows read from one chunk of a dump.
+ */
+struct Chunk {
+    std::vector<Row> rows;
+    std::vector<std::pair<std::size_t, std::size_t>> built;  // The records of CSV rows in arena
+    std::string arena;
+    std::size_t lines = 0;
+    std::size_t rejected = 0;
+};
+
+} // namespace
+
+/**
+ * @brief Get the path of the table in the metadata store directory.
+ */
+std::string IsbnTable::defaultPath() {
+    return metadataStoreDirectory() + "/isbn.table";
+}
+
+/**
+ * @brief Open a table file.
+ *
+ * @param path The path to the table.
+ * @return true if the table was opened, false otherwise.
+ */
+bool IsbnTable::open(const std::string& path) {
+    return table.open(path);
+}
+
+/**
+ * @brief Check that a record has the string fields a Book is built from.
+ *
+ * @param record The parsed record.
+ * @return true if the record is a JSON object with a string "author", "title",
+ *         "publisher" and "year", false otherwise.
+ */
+bool IsbnTable::isComplete(const nlohmann::json& record) {
+    return record.is_object() && std::all_of(std::begin(kBookFields), std::end(kBookFields),
+                                             [&](const char* field) { return check_string(record, field); });
+}
+
+/**
+ * @brief Find the record of an ISBN.
+ *
+ * @param canonical The ISBN in the canonical 13-digit form of normalizeIsbn().
+ * @param record Receives the JSON record of the book.
+ * @return true if the ISBN is in the table, false otherwise.
+ */
+bool IsbnTable::find(const std::string& canonical, std::string& record) const {
+    std::string_view found;
+    if (canonical.size() != 13 || !table.find(keyOf(canonical), found)) return false;
+    record.assign(found);
+    return true;
+}
+
+/**
+ * @brief Merge metadata dumps into a table file.
+ *
+ * The dumps are mapped, and each is cut into chunks of lines that are read
+ * in parallel. The records of JSON lines are parsed to check them and then
+ * used in place; those of CSV rows are built in the arena of their chunk. The rows of the old table come first,
+ * then each chunk is a run of RecordTable::write(), so the last row of an ISBN
+ * wins.
+ *
+ * @param dumps The paths to the dumps.
+ * @param path The path to the table; it is created or replaced.
+ * @return The counters of the import.
+ */
+IsbnTable::ImportStats IsbnTable::import(const std::vector<std::string>& dumps, const std::string& path) {
+    ImportStats stats;
+    std::vector<std::vector<Row>> runs;
+
+    // The old table comes first so that the dumps replace its records
+    RecordTable old;
+    if (old.open(path)) runs.push_back(old.rows());
+
+    std::vector<MappedFile> mapped(dumps.size());
+    std::list<std::string> arenas;
+    for (std::size_t d = 0; d < dumps.size(); d++) {
+        if (!mapped[d].open(dumps[d])) throw std::runtime_error("cannot open " + dumps[d]);
+        auto text = mapped[d].view();
+        bool csv = dumps[d].size() >= 4 && dumps[d].compare(dumps[d].size() - 4, 4, ".csv") == 0;
+
+        std::vector<std::string> columns;
+        std::size_t isbnColumn = 0, lastColumn = 0;
+        if (csv) {
+            auto newline = text.find('\n');
+            splitCsv(trim(text.substr(0, newline)), columns);
+            for (auto& column : columns) {
+                for (auto& c : column) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            isbnColumn = static_cast<std::size_t>(std::find(columns.begin(), columns.end(), "isbn") - columns.begin());
+            if (isbnColumn == columns.size()) throw std::runtime_error("no isbn column in " + dumps[d]);
+            // A row must reach every column that a Book needs
+            lastColumn = isbnColumn;
+            for (const char* field : kBookFields) {
+                auto column = static_cast<std::size_t>(std::find(columns.begin(), columns.end(), field) - columns.begin());
+                if (column == columns.size()) throw std::runtime_error(std::string{"no "} + field + " column in " + dumps[d]);
+                lastColumn = std::max(lastColumn, column);
+            }
+            text = newline == std::string_view::npos ? std::string_view{} : text.substr(newline + 1);
+        }
+
+        std::vector<Chunk> chunks(lineChunkCount(text.size()));
+        forEachLine(text, chunks.size(), [&](std::size_t c, std::string_view line, std::uint64_t) {
+            thread_local std::vector<std::string> fields;
+            thread_local std::string canonical;
+            auto& chunk = chunks[c];
+            line = trim(line);
+            if (line.empty()) return;
+            chunk.lines++;
+
+            if (csv) {
+                splitCsv(line, fields);
+                if (fields.size() <= lastColumn || !normalizeIsbn(fields[isbnColumn], canonical)) {
+                    chunk.rejected++;
+                    return;
+                }
+                auto begin = chunk.arena.size();
+                chunk.arena += '{';
+                for (std::size_t i = 0; i < fields.size() && i < columns.size(); i++) {
+                    if (columns[i].empty()) continue;
+                    if (chunk.arena.size() > begin + 1) chunk.arena += ',';
+                    appendJsonString(chunk.arena, columns[i]);
+                    chunk.arena += ':';
+                    appendJsonString(chunk.arena, fields[i]);
+                }
+                chunk.arena += '}';
+                chunk.built.emplace_back(begin, chunk.arena.size() - begin);
+                chunk.rows.push_back({keyOf(canonical), {}});
+                return;
+            }
+            auto record = nlohmann::json::parse(line, nullptr, false);
+            if (!isComplete(record) || !check_string(record, "isbn") ||
+                !normalizeIsbn(record["isbn"].get_ref<const std::string&>(), canonical)) {
+                chunk.rejected++;
+                return;
+            }
+            chunk.rows.push_back({keyOf(canonical), line});
+        });
+
+        for (auto& chunk : chunks) {
+            if (csv) {
+                // The views into the arena are taken once it has stopped growing and moving
+                const auto& arena = arenas.emplace_back(std::move(chunk.arena));
+                for (std::size_t i = 0; i < chunk.rows.size(); i++) {
+                    chunk.rows[i].record = std::string_view{arena}.substr(chunk.built[i].first, chunk.built[i].second);
+                }
+            }
+            stats.rows += chunk.lines;
+            stats.rejected += chunk.rejected;
+            runs.push_back(std::move(chunk.rows));
+        }
+    }
+    stats.records = RecordTable::write(std::move(runs), path);
+    return stats;
+}
+
+/**
+ * @brief Get the table imported into the metadata store, opened on first use.
+ *
+ * @return The table; it is empty if nothing has been imported.
+ */
+const IsbnTable& isbnTable() {
+    static IsbnTable table;
+    static std::once_flag opened;
+    std::call_once(opened, [] { table.open(IsbnTable::defaultPath()); });
+    return table;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#ifndef ISBN_TABLE_H
+#define ISBN_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "record_table.h"
+#include "third_parties/nlohmann/json.hpp"
+
+/**
+ * @brief IsbnTable is a sorted table of book metadata by ISBN, read in place from a mapped file.
+ *
+ * The table is built from metadata dumps by import(). It is a RecordTable
+ * keyed by the 13-digit ISBNs as 64-bit integers, whose records are JSON
+ * objects like the responses of "/isbn/". A lookup is a binary search over the
+ * mapped ISBNs, so opening the table reads nothing and a lookup touches a few
+ * pages.
+ */
+class IsbnTable {
+public:
+    /**
+     * @brief Get the path of the table in the metadata store directory.
+     */
+    static std::string defaultPath();
+
+    /**
+     * @brief Counters of an import.
+     */
+    struct ImportStats {
+        std::size_t rows = 0;      //!< The rows read from the dumps.
+        std::size_t rejected = 0;  //!< The rows without a valid ISBN or the fields of a book.
+        std::size_t records = 0;   //!< The records in the new table, including those kept from the old one.
+    };
+
+    /**
+     * @brief Check that a record has the string fields a Book is built from.
+     *
+     * @param record The parsed record.
+     * @return true if the record is a JSON object with a string "author", "title",
+     *         "publisher" and "year", false otherwise.
+     */
+    static bool isComplete(const nlohmann::json& record);
+
+    /**
+     * @brief Open a table file.
+     *
+     * @param path The path to the table.
+     * @return true if the table was opened, false if it is missing or not a table; the table is then empty.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Find the record of an ISBN.
+     *
+     * @param canonical The ISBN in the canonical 13-digit form of normalizeIsbn().
+     * @param record Receives the JSON record of the book.
+     * @return true if the ISBN is in the table, false otherwise.
+     */
+    bool find(const std::string& canonical, std::string& record) const;
+
+    /**
+     * @brief Get the number of records.
+     */
+    std::size_t size() const {
+        return table.size();
+    }
+
+    /**
+     * @brief Merge metadata dumps into a table file.
+     *
+     * A dump ending in ".csv" has a header row naming its columns, among them
+     * "isbn", "author", "title", "publisher" and "year", and one row per line;
+     * quoted fields may hold commas and doubled quotes but not newlines. Any
+     * other dump has one JSON object per line with these fields as strings. Rows
+     * missing one of them are rejected, since a Book could not be built from them. The ISBNs are canonicalized, and the rows are parsed and
+     * sorted in parallel. A row replaces the record of its ISBN from the old
+     * table and from earlier rows.
+     *
+     * @param dumps The paths to the dumps.
+     * @param path The path to the table; it is created or replaced.
+     * @return The counters of the import.
+     *
+     * @throws std::runtime_error if a dump cannot be read, a CSV dump lacks one of these columns,
+     *         or the table cannot be written.
+     */
+    static ImportStats import(const std::vector<std::string>& dumps, const std::string& path);
+
+private:
+    RecordTable table;
+};
+
+/**
+ * @brief Get the process-wide ISBN table, opened from the metadata store directory on first use.
+ *
+ * @return The table, empty if none was imported.
+ */
+const IsbnTable& isbnTable();
+
+#endif
@@ -0,0 +1,282 @@
+#include "json_lines.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#include "bloom_filter.h"
+#include "library.h"
+#include "thread_pool.h"
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'M', 'L', 'I', 'N', 'E', 'S', '1'};
+
+// The number of bytes before the end of the indexed part whose hash tells an append from a rewrite
+constexpr std::uint64_t kTailLength = 4096;
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ * @brief Parse one line and collect its citation entries; blank lines hold none.
+ */
+void parseLine(std::string_view line, std::uint64_t offset, std::vector<nlohmann::json>& entries) {
+    if (line.find_first_not_of(" \t\r") == std::string_view::npos) return;
+    nlohmann::json value;
+    try {
+        value = nlohmann::json::parse(line.begin(), line.end());
+    } catch (const nlohmann::json::parse_error& e) {
+        throw std::runtime_error("invalid JSON line at offset " + std::to_string(offset) + ": " + e.what());
+    }
+    collectCitationEntries(value, entries);
+}
+
+/**
+ * @brief Read a range of bytes of a file.
+ */
+std::string readRange(std::ifstream& file, std::uint64_t begin, std::uint64_t end) {
+    std::string bytes(static_cast<std::size_t>(end - begin), '\0');
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(begin));
+    if (!bytes.empty() && !file.read(&bytes[0], static_cast<std::streamsize>(bytes.size())))
+        throw std::runtime_error("cannot read the library");
+    return bytes;
+}
+
+} // namespace
+
+/**
+ * @brief Check whether a citation file is in the JSON Lines format, by its extension.
+ *
+ * @param filename The path to the citation file.
+ * @return true if the file ends with ".jsonl" or ".ndjson", false otherwise.
+ */
+bool isJsonLinesFile(const std::string& filename) {
+    return endsWith(filename, ".jsonl") || endsWith(filename, ".ndjson");
+}
+
+/**
+ * @brief Choose the number of chunks forEachLine() cuts a text into.
+ *
+ * @param length The length of the text.
+ * @return A chunk per 64 KiB, at most four per worker, at least one.
+ */
+std::size_t lineChunkCount(std::size_t length) {
+    return std::max<std::size_t>(1, std::min(length / 65536 + 1, ThreadPool::instance().size() * 4));
+}
+
+/**
+ * @brief Visit the lines of a text in parallel chunks cut at newlines.
+ *
+ * Each chunk starts at the first line beginning in its share of the text, so
+ * the chunks split the text at newlines without scanning it first.
+ *
+ * @param text The text.
+ * @param chunkCount The number of chunks, from lineChunkCount().
+ * @param visit Called with the chunk, each line without its newline, and the offset of the line.
+ */
+void forEachLine(std::string_view text, std::size_t chunkCount,
+                 const std::function<void(std::size_t chunk, std::string_view line, std::uint64_t offset)>& visit) {
+    auto n = text.size();
+    auto lineStart = [&](std::size_t chunk) -> std::size_t {
+        if (chunk == 0) return 0;
+        if (chunk == chunkCount) return n;
+        auto newline = text.find('\n', n * chunk / chunkCount - 1);
+        return newline == std::string_view::npos ? n : newline + 1;
+    };
+
+    parallelFor(0, chunkCount, 1, [&](std::size_t begin, std::size_t end) {
+        for (auto c = begin; c < end; c++) {
+            for (auto position = lineStart(c), last = lineStart(c + 1); position < last;) {
+                auto newline = text.find('\n', position);
+                auto stop = newline == std::string_view::npos ? n : newline;
+                visit(c, text.substr(position, stop - position), position);
+                position = stop + 1;
+            }
+        }
+    });
+}
+
+/**
+ * @brief Parse JSON Lines text and collect its citation entries.
+ *
+ * Every chunk of lines collects its entries separately, and the chunks are
+ * concatenated in order.
+ *
+ * @param text The text, made of whole lines.
+ * @param entries A vector to append the citation entries to.
+ * @param offsets If not null, a vector to append the offset of the line of each entry to.
+ * @param base The offset of the text in its file, added to the offsets.
+ */
+void parseJsonLines(std::string_view text, std::vector<nlohmann::json>& entries,
+                    std::vector<std::uint64_t>* offsets, std::uint64_t base) {
+    struct Chunk {
+        std::vector<nlohmann::json> entries;
+        std::vector<std::uint64_t> offsets;
+    };
+    std::vector<Chunk> chunks(lineChunkCount(text.size()));
+
+    forEachLine(text, chunks.size(), [&](std::size_t c, std::string_view line, std::uint64_t offset) {
+        auto& chunk = chunks[c];
+        parseLine(line, base + offset, chunk.entries);
+        chunk.offsets.resize(chunk.entries.size(), base + offset);
+    });
+
+    for (auto& chunk : chunks) {
+        std::move(chunk.entries.begin(), chunk.entries.end(), std::back_inserter(entries));
+        if (offsets) offsets->insert(offsets->end(), chunk.offsets.begin(), chunk.offsets.end());
+    }
+}
+
+/**
+ * @brief Read the lines at given offsets of a JSON Lines file and collect their citation entries.
+ *
+ * @param filename The path to the JSON Lines file.
+ * @param offsets The offsets of the lines to read, in ascending order.
+ * @param entries A vector to append the citation entries to.
+ */
+void readJsonLines(const std::string& filename, const std::vector<std::uint64_t>& offsets,
+                   std::vector<nlohmann::json>& entries) {
+    std::ifstream file{filename, std::ios::binary};
+    if (!file) throw std::runtime_error("cannot open " + filename);
+    std::string line;
+    for (auto offset : offsets) {
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(offset));
+        if (!std::getline(file, line)) throw std::runtime_error("no line at offset " + std::to_string(offset));
+        parseLine(line, offset, entries);
+    }
+}
+
+/**
+ * @brief Get the path of the index file of a library.
+ *
+ * @param library The path to the JSON Lines library.
+ * @return The path of the library followed by ".offsets".
+ */
+std::string JsonLinesIndex::pathFor(const std::string& library) {
+    return library + ".offsets";
+}
+
+/**
+ * @brief Bring the index up to date with a library.
+ *
+ * If the bytes last indexed are unchanged, the library was only appended to,
+ * and only the lines after them are parsed; otherwise every line is. The IDs
+ * already indexed are then merged with the new ones; this sorts the IDs again
+ * but parses no JSON.
+ *
+ * @param library The path to the JSON Lines library.
+ * @return true if the index changed, false if it was already up to date.
+ */
+bool JsonLinesIndex::update(const std::string& library) {
+    std::ifstream file{library, std::ios::binary | std::ios::ate};
+    if (!file) throw std::runtime_error("cannot open " + library);
+    std::uint64_t size = static_cast<std::uint64_t>(file.tellg());
+
+    std::uint64_t start = 0;
+    if (covered > 0 && covered <= size) {
+        auto window = std::min(covered, kTailLength);
+        if (BloomFilter::hash(readRange(file, covered - window, covered)) == tailHash) start = covered;
+    }
+    auto text = readRange(file, start, size);
+    // Only whole lines; the last one may still be being written
+    text.resize(text.rfind('\n') == std::string::npos ? 0 : text.rfind('\n') + 1);
+    if (start == covered && text.empty()) return false;
+
+    std::vector<nlohmann::json> entries;
+    std::vector<std::uint64_t> offsets;
+    parseJsonLines(text, entries, &offsets, start);
+
+    std::vector<std::pair<std::string, std::uint64_t>> records;
+    if (start > 0) {
+        records.reserve(lines.size() + entries.size());
+        ids.forEach(0, ids.size(), [&](std::size_t rank, std::string_view key) {
+            auto last = rank + 1 < ids.size() ? ids.value(rank + 1) : lines.size();
+            for (auto i = ids.value(rank); i < last; i++) records.emplace_back(std::string{key}, lines[i]);
+        });
+    }
+    for (std::size_t i = 0; i < entries.size(); i++)
+        records.emplace_back(entries[i]["id"].get<std::string>(), offsets[i]);
+    std::sort(records.begin(), records.end());
+    // A line defining an ID twice is read once
+    records.erase(std::unique(records.begin(), records.end()), records.end());
+
+    std::vector<std::pair<std::string_view, std::size_t>> keys;
+    lines.clear();
+    lines.reserve(records.size());
+    for (const auto& [id, offset] : records) {
+        if (keys.empty() || keys.back().first != id) keys.emplace_back(id, lines.size());
+        lines.push_back(offset);
+    }
+    ids = PrefixIndex{std::move(keys)};
+
+    covered = start + text.size();
+    auto window = std::min(covered, kTailLength);
+    tailHash = BloomFilter::hash(readRange(file, covered - window, covered));
+    return true;
+}
+
+/**
+ * @brief Find the lines defining an ID.
+ *
+ * @param id The ID to find.
+ * @param offsets A vector to append the offsets of the lines to, in ascending order.
+ * @return true if the ID is defined, false otherwise.
+ */
+bool JsonLinesIndex::find(std::string_view id, std::vector<std::uint64_t>& offsets) const {
+    auto rank = ids.find(id);
+    if (rank == PrefixIndex::npos) return false;
+    auto last = rank + 1 < ids.size() ? ids.value(rank + 1) : lines.size();
+    offsets.insert(offsets.end(), lines.begin() + static_cast<std::ptrdiff_t>(ids.value(rank)),
+                   lines.begin() + static_cast<std::ptrdiff_t>(last));
+    return true;
+}
+
+/**
+ * @brief Write the index to a binary stream.
+ *
+ * @param output The stream to write to.
+ */
+void JsonLinesIndex::serialize(std::ostream& output) const {
+    output.write(kMagic, sizeof(kMagic));
+    output.write(reinterpret_cast<const char*>(&covered), sizeof(covered));
+    output.write(reinterpret_cast<const char*>(&tailHash), sizeof(tailHash));
+    ids.serialize(output);
+    std::uint64_t count = lines.size();
+    output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    output.write(reinterpret_cast<const char*>(lines.data()), static_cast<std::streamsize>(count * sizeof(std::uint64_t)));
+}
+
+/**
+ * @brief Read an index written by serialize().
+ *
+ * @param input The stream to read from.
+ * @return true if an index was read, false otherwise. The index is unchanged on failure.
+ */
+bool JsonLinesIndex::deserialize(std::istream& input) {
+    char magic[sizeof(kMagic)];
+    if (!input.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) return false;
+
+    JsonLinesIndex loaded;
+    std::uint64_t count = 0;
+    if (!input.read(reinterpret_cast<char*>(&loaded.covered), sizeof(loaded.covered))) return false;
+    if (!input.read(reinterpret_cast<char*>(&loaded.tailHash), sizeof(loaded.tailHash))) return false;
+    if (!loaded.ids.deserialize(input)) return false;
+    if (!input.read(reinterpret_cast<char*>(&count), sizeof(count)) || count > SIZE_MAX / sizeof(std::uint64_t)) return false;
+    loaded.lines.resize(static_cast<std::size_t>(count));
+    if (!input.read(reinterpret_cast<char*>(loaded.lines.data()), static_cast<std::streamsize>(count * sizeof(std::uint64_t))))
+        return false;
+
+    // Every ID has at least one line, and the lines of the IDs follow each other
+    for (std::size_t rank = 0; rank < loaded.ids.size(); rank++) {
+        auto last = rank + 1 < loaded.ids.size() ? loaded.ids.value(rank + 1) : loaded.lines.size();
+        if (loaded.ids.value(rank) >= last || last > loaded.lines.size()) return false;
+    }
+    *this = std::move(loaded);
+    return true;
+}
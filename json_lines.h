@@ -0,0 +1,149 @@
+#pragma once
+#ifndef JSON_LINES_H
+#define JSON_LINES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "prefix_index.h"
+#include "third_parties/nlohmann/json.hpp"
+
+/**
+ * @brief Check whether a citation file is in the JSON Lines format, by its ".jsonl" or ".ndjson" extension.
+ *
+ * In a JSON Lines library every line holds one JSON value, usually a single
+ * citation entry, and empty lines are ignored. New entries are appended to the
+ * end of the file without rewriting it.
+ *
+ * @param filename The path to the citation file.
+ * @return true if the file is a JSON Lines library, false if it is a single JSON document.
+ */
+bool isJsonLinesFile(const std::string& filename);
+
+/**
+ * @brief Choose the number of chunks forEachLine() cuts a text into.
+ *
+ * @param length The length of the text.
+ * @return The number of chunks, at least one.
+ */
+std::size_t lineChunkCount(std::size_t length);
+
+/**
+ * @brief Visit the lines of a text in parallel chunks cut at newlines.
+ *
+ * The chunks are contiguous and in text order, and the lines of a chunk are
+ * visited in order by a single thread, so per-chunk results need no locking.
+ *
+ * @param text The text.
+ * @param chunkCount The number of chunks, from lineChunkCount().
+ * @param visit Called with the chunk, each line without its newline, and the offset of the line in the text.
+ *
+ * @throws The first exception thrown by visit.
+ */
+void forEachLine(std::string_view text, std::size_t chunkCount,
+                 const std::function<void(std::size_t chunk, std::string_view line, std::uint64_t offset)>& visit);
+
+/**
+ * @brief Parse JSON Lines text and collect its citation entries.
+ *
+ * The text is cut into one chunk per task at line boundaries, and the chunks
+ * are parsed in parallel. The entries are returned in file order.
+ *
+ * @param text The text, made of whole lines.
+ * @param entries A vector to append the citation entries to.
+ * @param offsets If not null, a vector to append the offset of the line of each entry to.
+ * @param base The offset of the text in its file, added to the offsets.
+ *
+ * @throws std::runtime_error if a line is not valid JSON.
+ */
+void parseJsonLines(std::string_view text, std::vector<nlohmann::json>& entries,
+                    std::vector<std::uint64_t>* offsets = nullptr, std::uint64_t base = 0);
+
+/**
+ * @brief Read the lines at given offsets of a JSON Lines file and collect their citation entries.
+ *
+ * @param filename The path to the JSON Lines file.
+ * @param offsets The offsets of the lines to read, in ascending order.
+ * @param entries A vector to append the citation entries to.
+ *
+ * @throws std::runtime_error if the file cannot be read or a line is not valid JSON.
+ */
+void readJsonLines(const std::string& filename, const std::vector<std::uint64_t>& offsets,
+                   std::vector<nlohmann::json>& entries);
+
+/**
+ * @brief JsonLinesIndex maps the IDs of a JSON Lines library to the offsets of their lines.
+ *
+ * With the index, the entries of a few IDs are read by seeking to their lines
+ * instead of parsing the whole library. The index is kept in a file next to the
+ * library and remembers how much of the library it covers, together with a
+ * hash of the last bytes covered. When the library has only grown, update()
+ * parses just the appended lines; when it was rewritten, the index is rebuilt.
+ */
+class JsonLinesIndex {
+public:
+    /**
+     * @brief Get the path of the index file of a library.
+     *
+     * @param library The path to the JSON Lines library.
+     * @return The path of the library followed by ".offsets".
+     */
+    static std::string pathFor(const std::string& library);
+
+    /**
+     * @brief Bring the index up to date with a library.
+     *
+     * Only whole lines are indexed; a last line without its newline is left
+     * for the next update.
+     *
+     * @param library The path to the JSON Lines library.
+     * @return true if the index changed, false if it was already up to date.
+     *
+     * @throws std::runtime_error if the library cannot be read or a line is not valid JSON.
+     */
+    bool update(const std::string& library);
+
+    /**
+     * @brief Find the lines defining an ID.
+     *
+     * @param id The ID to find.
+     * @param offsets A vector to append the offsets of the lines to, in ascending order.
+     * @return true if the ID is defined, false otherwise.
+     */
+    bool find(std::string_view id, std::vector<std::uint64_t>& offsets) const;
+
+    /**
+     * @brief Get the number of distinct IDs.
+     */
+    std::size_t size() const {
+        return ids.size();
+    }
+
+    /**
+     * @brief Write the index to a binary stream.
+     *
+     * @param output The stream to write to.
+     */
+    void serialize(std::ostream& output) const;
+
+    /**
+     * @brief Read an index written by serialize().
+     *
+     * @param input The stream to read from.
+     * @return true if an index was read, false if the data is truncated or not an index.
+     */
+    bool deserialize(std::istream& input);
+
+private:
+    PrefixIndex ids;                    //!< The IDs; the value of an ID is the index of its first line in lines.
+    std::vector<std::uint64_t> lines;   //!< The offsets of the lines, grouped by ID in sorted order.
+    std::uint64_t covered = 0;          //!< The length of the library indexed.
+    std::uint64_t tailHash = 0;         //!< The hash of the last bytes indexed.
+};
+
+#endif
@@ -0,0 +1,663 @@
+#include "library.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "utils.hpp"
+#include "book.h"
+#include "webpage.h"
+#include "article.h"
+#include "isbn.h"
+#include "url.h"
+#include "metadata.h"
+#include "thread_pool.h"
+#include "suggest.h"
+#include "json_lines.h"
+
+/**
+ * @brief Construct a new Library from citation entries and index them.
+ *
+ * When an ID is defined more than once, the index keeps the first definition
+ * and the positions of all definitions are recorded for count() and definitions().
+ *
+ * @param entries The JSON objects of the citations, each accepted by isCitationEntry().
+ */
+Library::Library(std::vector<nlohmann::json> entries)
+    : entries(std::move(entries)), citations(this->entries.size()) {
+    index.reserve(this->entries.size());
+    for (std::size_t i = 0; i < this->entries.size(); i++) {
+        const auto& id = this->entries[i]["id"].get_ref<const std::string&>();
+        auto [found, inserted] = index.emplace(id, i);
+        if (!inserted) {
+            auto& positions = duplicates[id];
+            if (positions.empty()) positions.push_back(found->second);
+            positions.push_back(i);
+        }
+    }
+}
+
+namespace {
+
+/**
+ * @brief Move the entries of several shards into one vector, in order; the shards keep their sizes.
+ */
+std::vector<nlohmann::json> joinShards(std::vector<std::vector<nlohmann::json>>& shards) {
+    std::size_t total = 0;
+    for (const auto& shard : shards) total += shard.size();
+    std::vector<nlohmann::json> entries;
+    entries.reserve(total);
+    for (auto& shard : shards)
+        entries.insert(entries.end(), std::make_move_iterator(shard.begin()), std::make_move_iterator(shard.end()));
+    return entries;
+}
+
+} // namespace
+
+/**
+ * @brief Construct a new Library from the entries of several files, in order, and index them.
+ *
+ * The shards are joined and indexed together, so an ID defined in several
+ * shards is found in the same single pass as one defined twice in a file.
+ *
+ * @param shards The JSON objects of the citations of each file, each accepted by isCitationEntry().
+ */
+Library::Library(std::vector<std::vector<nlohmann::json>> shards) : Library(joinShards(shards)) {
+    std::size_t end = 0;
+    for (const auto& shard : shards) shardEnds.push_back(end += shard.size());
+}
+
+/**
+ * @brief Find the position of the entry with the given ID.
+ *
+ * @param id The unique identifier of the citation.
+ * @return The position of the first entry with this ID, or npos if there is none.
+ */
+std::size_t Library::indexOf(const std::string& id) const {
+    auto found = index.find(id);
+    return found == index.end() ? npos : found->second;
+}
+
+/**
+ * @brief Count the citations defined with the given ID.
+ *
+ * @param id The unique identifier of the citation.
+ * @return The number of citations with this ID.
+ */
+std::size_t Library::count(const std::string& id) const {
+    if (indexOf(id) == npos) return 0;
+    auto duplicate = duplicates.find(id);
+    return duplicate == duplicates.end() ? 1 : duplicate->second.size();
+}
+
+/**
+ * @brief Find the positions of all the entries with the given ID.
+ *
+ * @param id The unique identifier of the citation.
+ * @return The positions in ascending order; empty if the ID is unknown.
+ */
+std::vector<std::size_t> Library::definitions(const std::string& id) const {
+    auto position = indexOf(id);
+    if (position == npos) return {};
+    auto duplicate = duplicates.find(id);
+    return duplicate == duplicates.end() ? std::vector<std::size_t>{position} : duplicate->second;
+}
+
+/**
+ * @brief Find the file an entry was loaded from.
+ *
+ * @param position The position of the entry.
+ * @return The index of its shard, or 0 if the library was not loaded from several files.
+ */
+std::size_t Library::shardOf(std::size_t position) const {
+    return static_cast<std::size_t>(std::upper_bound(shardEnds.begin(), shardEnds.end(), position) - shardEnds.begin());
+}
+
+/**
+ * @brief Get the dictionary of the IDs, building it on first use.
+ *
+ * The dictionary views the keys of the index while it is built, and copies
+ * them front-coded, so it does not depend on the index afterwards.
+ */
+const PrefixIndex& Library::getIds() const {
+    std::call_once(idsOnce, [this] {
+        std::vector<std::pair<std::string_view, std::size_t>> keys;
+        keys.reserve(index.size());
+        for (const auto& [id, position] : index) keys.emplace_back(id, position);
+        ids = PrefixIndex{std::move(keys)};
+    });
+    return ids;
+}
+
+/**
+ * @brief Find the entries whose ID starts with a prefix.
+ *
+ * @param prefix The prefix of the IDs.
+ * @param limit The maximum number of positions to return.
+ * @param positions A vector to store the positions of the best matching entries, best first.
+ * @param weights The weights of the ranks of getIds(), or nullptr for ID order.
+ * @return The total number of matching IDs.
+ */
+std::size_t Library::complete(std::string_view prefix, std::size_t limit, std::vector<std::size_t>& positions,
+                              const CompletionWeights* weights) const {
+    const auto& dictionary = getIds();
+    std::vector<std::size_t> ranks;
+    auto total = dictionary.complete(prefix, limit, ranks, weights);
+    for (auto rank : ranks) positions.push_back(dictionary.value(rank));
+    return total;
+}
+
+/**
+ * @brief Find the entries whose IDs are closest to an unknown ID.
+ *
+ * @param id The unknown ID.
+ * @param limit The maximum number of positions to return.
+ * @param positions A vector to store the positions of the closest entries, closest first.
+ */
+void Library::suggest(std::string_view id, std::size_t limit, std::vector<std::size_t>& positions) const {
+    const auto& dictionary = getIds();
+    std::vector<std::size_t> ranks;
+    suggestKeys(dictionary, id, limit, ranks);
+    for (auto rank : ranks) positions.push_back(dictionary.value(rank));
+}
+
+/**
+ * @brief Get the citation of an entry, creating it on first use.
+ *
+ * The lock is not held while the citation is created, so a slow metadata
+ * request does not block the resolution of other entries.
+ *
+ * @param position The position of the entry.
+ * @return The citation of the entry, valid as long as the library.
+ */
+const Citation& Library::resolve(std::size_t position) const {
+    {
+        std::lock_guard<std::mutex> lock{resolveMutex};
+        if (citations[position]) return *citations[position];
+    }
+    auto created = createCitation(entries[position]);
+    std::lock_guard<std::mutex> lock{resolveMutex};
+    // A resolved citation is never replaced, so the reference stays valid
+    if (!citations[position]) citations[position] = std::move(created);
+    return *citations[position];
+}
+
+/**
+ * @brief Start the metadata request of an entry in the background.
+ *
+ * The key is canonicalized as in the Book and WebPage constructors. A book
+ * with an invalid ISBN fails to resolve without a request.
+ *
+ * @param position The position of the entry.
+ * @return true if resolve() can answer without waiting for a request, false while one is in flight.
+ */
+bool Library::prefetch(std::size_t position) const {
+    {
+        std::lock_guard<std::mutex> lock{resolveMutex};
+        if (citations[position]) return true;
+    }
+    const auto& entry = entries[position];
+    const auto& type = entry["type"].get_ref<const std::string&>();
+    if (type == "book") {
+        std::string isbn;
+        return !normalizeIsbn(entry["isbn"].get_ref<const std::string&>(), isbn) ||
+               prefetchMetadata(MetadataKind::Isbn, isbn);
+    }
+    if (type == "webpage") {
+        const auto& url = entry["url"].get_ref<const std::string&>();
+        std::string canonical;
+        return prefetchMetadata(MetadataKind::Title, normalizeUrl(url, canonical) ? canonical : url);
+    }
+    return true;
+}
+
+/**
+ * @brief Check whether a JSON object describes a citation.
+ *
+ * @param j The JSON value to check.
+ * @return true if the JSON value describes a citation, false otherwise.
+ *
+ * @note For each type of Citation (book, webpage, article), specific fields are expected
+ *       in the JSON data, and their absence or invalidity means it is not a citation.
+ *       An unsupported "type" is not a citation either.
+ */
+bool isCitationEntry(const nlohmann::json& j) {
+    // Containers are told apart by a single failed lookup of "type"
+    if(!j.is_object()) return false;
+    auto type = j.find("type");
+    if(type == j.end() || !type->is_string()) return false;
+    auto id = j.find("id");
+    if(id == j.end() || !id->is_string()) return false;
+
+    auto has = [&j](const char* field, bool (nlohmann::json::*is)() const noexcept) {
+        auto found = j.find(field);
+        return found != j.end() && ((*found).*is)();
+    };
+    const auto& name = type->get_ref<const std::string&>();
+    if(name == "book") {
+        // Check for the required "isbn" field
+        return has("isbn", &nlohmann::json::is_string);
+    }
+    if(name == "webpage") {
+        // Check for the requried "url" field
+        return has("url", &nlohmann::json::is_string);
+    }
+    if(name == "article") {
+        // Check for the required fields for creating a Article object
+        return has("title", &nlohmann::json::is_string) && has("author", &nlohmann::json::is_string) &&
+               has("journal", &nlohmann::json::is_string) && has("year", &nlohmann::json::is_number) &&
+               has("volume", &nlohmann::json::is_number) && has("issue", &nlohmann::json::is_number);
+    }
+    return false;
+}
+
+/**
+ * @brief Create the Citation object described by a citation entry.
+ *
+ * Books and webpages fetch their metadata in their constructors, so this blocks
+ * until the response is available, usually from the metadata cache.
+ *
+ * @param j A JSON object accepted by isCitationEntry().
+ * @return The created citation.
+ */
+std::shared_ptr<Citation> createCitation(const nlohmann::json& j) {
+    if(!isCitationEntry(j)) throw std::invalid_argument("not a citation entry");
+
+    auto type = j["type"].get<std::string>();
+    auto id = j["id"].get<std::string>();
+
+    // Create Citation objects based on the type field
+    if(type == "book") {
+        auto isbn = j["isbn"].get<std::string>();
+        return std::make_shared<Book>(id, isbn);
+    }
+    if(type == "webpage") {
+        auto url = j["url"].get<std::string>();
+        return std::make_shared<WebPage>(id, url);
+    }
+
+    auto title = j["title"].get<std::string>();
+    auto author = j["author"].get<std::string>();
+    auto journal = j["journal"].get<std::string>();
+    int year = j["year"].get<int>();
+    int volume = j["volume"].get<int>();
+    int issue = j["issue"].get<int>();
+    return std::make_shared<Article>(id, title, author, journal, year, volume, issue);
+}
+
+namespace {
+
+/**
+ * @brief Visit the citation entries of JSON data in document order, with an explicit stack.
+ *
+ * A citation entry is visited and not searched further. Any other value is
+ * searched through its members: an object member is handled the same way,
+ * and so are the object elements of an array member. Arrays directly inside
+ * arrays are not searched. The stack holds an iterator pair per open container, so deep data takes heap
+ * memory instead of call stack.
+ *
+ * @param root The JSON data; const or not, as visit expects.
+ * @param options The depth limit.
+ * @param visit Called with each citation entry.
+ *
+ * @throws std::runtime_error if the containers are nested deeper than options.maxDepth.
+ */
+template <typename Json, typename Visit>
+void walkCitationEntries(Json& root, const CitationWalkOptions& options, Visit&& visit) {
+    using Iterator = decltype(root.begin());
+    struct Frame {
+        Iterator next;
+        Iterator end;
+        bool elements;  // An array member, whose object elements are searched
+    };
+    std::vector<Frame> stack;
+
+    auto open = [&](Json& container, bool elements) {
+        if(stack.size() >= options.maxDepth)
+            throw std::runtime_error("citation data nested deeper than " + std::to_string(options.maxDepth) + " levels");
+        stack.push_back({container.begin(), container.end(), elements});
+    };
+    auto search = [&](Json& value) {
+        if(isCitationEntry(value)) visit(value);
+        else if(value.is_structured()) open(value, false);
+    };
+
+    search(root);
+    while(!stack.empty()) {
+        auto& frame = stack.back();
+        if(frame.next == frame.end) {
+            stack.pop_back();
+            continue;
+        }
+        auto member = frame.next++;
+        // The frame is not used below, as opening a container may move it
+        if(frame.elements) {
+            if(member->is_object()) search(*member);
+            continue;
+        }
+        if(member->is_array()) open(*member, true);
+        else if(member->is_object()) search(*member);
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Collect the citation entries of JSON data.
+ *
+ * The entries are found in document order by an iterative walk, which needs
+ * no call stack however deep the data is. They are moved out of the JSON data
+ * instead of being copied.
+ *
+ * @param j The JSON data containing the citations; the collected entries are moved out of it.
+ * @param entries A vector to store the citation entries.
+ * @param options The depth limit of the walk.
+ */
+void collectCitationEntries(nlohmann::json& j, std::vector<nlohmann::json>& entries, const CitationWalkOptions& options) {
+    walkCitationEntries(j, options, [&entries](nlohmann::json& entry) { entries.push_back(std::move(entry)); });
+}
+
+namespace {
+
+/**
+ * @brief Start the metadata request of a cited book or webpage, canonicalized as in the Book and WebPage constructors.
+ *
+ * @param type The type of the entry.
+ * @param id The ID of the entry.
+ * @param key The ISBN of a book or the URL of a webpage.
+ * @param cited The IDs referenced by the input.
+ */
+void prefetchCited(const std::string& type, const std::string& id, const std::string& key, const CitedIds& cited) {
+    if(type == "book") {
+        std::string isbn;
+        if(cited.get().count(id) && normalizeIsbn(key, isbn))
+            prefetchMetadata(MetadataKind::Isbn, isbn);
+    }
+    else if(type == "webpage") {
+        std::string canonical;
+        if(cited.get().count(id))
+            prefetchMetadata(MetadataKind::Title, normalizeUrl(key, canonical) ? canonical : key);
+    }
+}
+
+/**
+ * @brief SAX handler that builds the JSON document and prefetches cited metadata on the way.
+ * 
+ * Every event is forwarded to nlohmann's DOM builder. Alongside, the handler keeps
+ * the "type", "id", "isbn" and "url" strings of each open object, so when an object
+ * ends it can tell whether it is a cited book or webpage and start its request.
+ * This is much cheaper than a parse callback, which copies the parsed values.
+ */
+class PrefetchingSax {
+public:
+    PrefetchingSax(nlohmann::json& result, const CitedIds& cited) : dom{result}, cited{cited} {}
+
+    bool null() { resetField(); return dom.null(); }
+    bool boolean(bool val) { resetField(); return dom.boolean(val); }
+    bool number_integer(nlohmann::json::number_integer_t val) { resetField(); return dom.number_integer(val); }
+    bool number_unsigned(nlohmann::json::number_unsigned_t val) { resetField(); return dom.number_unsigned(val); }
+    bool number_float(nlohmann::json::number_float_t val, const std::string& s) { resetField(); return dom.number_float(val, s); }
+    bool binary(nlohmann::json::binary_t& val) { resetField(); return dom.binary(val); }
+
+    bool string(std::string& val) {
+        if(!frames.empty() && frames.back().object && frames.back().field >= 0) {
+            auto& frame = frames.back();
+            frame.values[frame.field] = val;
+            frame.has[frame.field] = true;
+        }
+        return dom.string(val);
+    }
+
+    bool key(std::string& val) {
+        auto& frame = frames.back();
+        frame.field = -1;
+        for(int f = 0; f < kFieldCount; f++) {
+            if(val == kFieldNames[f]) frame.field = f;
+        }
+        return dom.key(val);
+    }
+
+    bool start_object(std::size_t len) {
+        resetField();
+        frames.emplace_back();
+        frames.back().object = true;
+        return dom.start_object(len);
+    }
+
+    bool end_object() {
+        prefetch(frames.back());
+        frames.pop_back();
+        return dom.end_object();
+    }
+
+    bool start_array(std::size_t len) {
+        resetField();
+        frames.emplace_back();
+        return dom.start_array(len);
+    }
+
+    bool end_array() {
+        frames.pop_back();
+        return dom.end_array();
+    }
+
+    template<class Exception>
+    bool parse_error(std::size_t position, const std::string& last_token, const Exception& ex) {
+        return dom.parse_error(position, last_token, ex);
+    }
+
+private:
+    enum Field { Type, Id, Isbn, Url, kFieldCount };
+    static constexpr const char* kFieldNames[kFieldCount] = {"type", "id", "isbn", "url"};
+
+    struct Frame {
+        bool object = false;
+        int field = -1;                      // The field the current key names, or -1
+        std::string values[kFieldCount];
+        bool has[kFieldCount] = {};
+    };
+
+    nlohmann::detail::json_sax_dom_parser<nlohmann::json> dom;
+    const CitedIds& cited;
+    std::vector<Frame> frames;
+
+    // A non-string value under a tracked key replaces an earlier string value
+    void resetField() {
+        if(!frames.empty() && frames.back().object && frames.back().field >= 0) {
+            frames.back().has[frames.back().field] = false;
+        }
+    }
+
+    // Start the request of a cited book or webpage
+    void prefetch(const Frame& frame) {
+        if(!frame.has[Type] || !frame.has[Id]) return;
+        const auto& type = frame.values[Type];
+        if(type == "book" && frame.has[Isbn]) prefetchCited(type, frame.values[Id], frame.values[Isbn], cited);
+        else if(type == "webpage" && frame.has[Url]) prefetchCited(type, frame.values[Id], frame.values[Url], cited);
+    }
+};
+
+} // namespace
+
+/**
+ * @brief Parse a JSON citation file, starting the metadata requests of cited entries on the way.
+ * 
+ * The file is parsed with a SAX handler that sees every JSON object as soon as it is
+ * complete. For a cited book or webpage, it starts the metadata request in the
+ * background; the Book and WebPage constructors later find the response in the
+ * metadata cache or wait for the request still in flight.
+ * 
+ * @param filename The path to the JSON file containing citation data.
+ * @param cited The IDs referenced by the input.
+ * @return The parsed JSON data.
+ *
+ * @throws std::runtime_error if the file cannot be opened or holds null.
+ * @throws nlohmann::json::parse_error if the file is not JSON.
+ */
+nlohmann::json parseLibrary(const std::string& filename, const CitedIds& cited) {
+    std::ifstream file{ filename };
+
+    if(!file.is_open() || file.fail()) throw std::runtime_error("cannot open " + filename);
+
+    nlohmann::json data;
+    PrefetchingSax handler{data, cited};
+    nlohmann::json::sax_parse(file, &handler);
+
+    if(data.is_null()) throw std::runtime_error("no citation data in " + filename);
+    return data;
+}
+
+namespace {
+
+/**
+ * @brief Get an empty set of cited IDs, for loading a library without requesting any metadata.
+ */
+CitedIds nothingCited() {
+    std::promise<std::unordered_set<std::string>> none;
+    none.set_value({});
+    return none.get_future().share();
+}
+
+/**
+ * @brief Load the citation entries of a JSON Lines file, then start the metadata requests of cited entries.
+ *
+ * When only the cited entries are needed and the file has an offset index,
+ * the index is brought up to date with the lines appended since it was written,
+ * and just the lines of the cited IDs it holds are read. Otherwise the lines
+ * are parsed in parallel.
+ *
+ * @param filename The path to the JSON Lines file.
+ * @param cited The IDs referenced by the input.
+ * @param citedOnly Whether only the entries of the cited IDs are needed.
+ * @param partial Set to whether only the entries of the cited IDs were read.
+ * @return The citation entries, in file order.
+ */
+std::vector<nlohmann::json> loadJsonLinesEntries(const std::string& filename, const CitedIds& cited,
+                                                 bool citedOnly, bool& partial) {
+    std::vector<nlohmann::json> entries;
+    JsonLinesIndex index;
+    std::ifstream stored{JsonLinesIndex::pathFor(filename), std::ios::binary};
+    partial = citedOnly && stored && index.deserialize(stored);
+    if(partial) {
+        stored.close();
+        if(index.update(filename)) {
+            std::ofstream store{JsonLinesIndex::pathFor(filename), std::ios::binary};
+            index.serialize(store);
+        }
+        std::vector<std::uint64_t> offsets;
+        for(const auto& id : cited.get()) index.find(id, offsets);
+        std::sort(offsets.begin(), offsets.end());
+        offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+        readJsonLines(filename, offsets, entries);
+    }
+    else {
+        std::ifstream file{ filename, std::ios::binary };
+        std::string text{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+        parseJsonLines(text, entries);
+    }
+
+    for(const auto& entry : entries) {
+        const auto& type = entry["type"].get_ref<const std::string&>();
+        const auto& id = entry["id"].get_ref<const std::string&>();
+        if(type == "book") prefetchCited(type, id, entry["isbn"].get_ref<const std::string&>(), cited);
+        else if(type == "webpage") prefetchCited(type, id, entry["url"].get_ref<const std::string&>(), cited);
+    }
+    return entries;
+}
+
+/**
+ * @brief Load the citation entries of several files in parallel, one task per file.
+ *
+ * @param filenames The paths to the JSON or JSON Lines files.
+ * @param cited The IDs referenced by the input.
+ * @param citedOnly Whether only the entries of the cited IDs are needed.
+ * @param partial Set to whether only the entries of the cited IDs were read, for each file.
+ * @return The citation entries of each file, in file order.
+ */
+std::vector<std::vector<nlohmann::json>> loadShards(const std::vector<std::string>& filenames, const CitedIds& cited,
+                                                    bool citedOnly, std::vector<char>& partial) {
+    // A JSON Lines file is read without checking, so report a missing file here
+    for(const auto& filename : filenames) {
+        if(!std::ifstream{filename}.is_open()) throw std::runtime_error("cannot open " + filename);
+    }
+
+    std::vector<std::vector<nlohmann::json>> shards(filenames.size());
+    partial.assign(filenames.size(), false);
+    auto load = [&](std::size_t i) {
+        bool indexed = false;
+        if(isJsonLinesFile(filenames[i])) {
+            shards[i] = loadJsonLinesEntries(filenames[i], cited, citedOnly, indexed);
+        }
+        else {
+            nlohmann::json data = parseLibrary(filenames[i], cited);
+            collectCitationEntries(data, shards[i]);
+        }
+        partial[i] = indexed;
+    };
+    if(filenames.size() == 1) {
+        load(0);
+        return shards;
+    }
+    TaskGroup group{ThreadPool::instance()};
+    for(std::size_t i = 0; i < filenames.size(); i++) group.run([&load, i] { load(i); });
+    group.wait();
+    return shards;
+}
+
+} // namespace
+
+/**
+ * @brief Load a Library from several files in parallel, overlapping parsing with the metadata requests of cited entries.
+ *
+ * Every file is loaded by its own task, so the time is that of the largest file
+ * when there are enough workers. The entries are joined in the order of the
+ * files, and the Library indexes all of them at once, which finds the IDs
+ * defined in more than one file in a single pass.
+ *
+ * The JSON Lines files with an offset index only provide the entries of the
+ * cited IDs. If a cited ID is in none of the files, those files are loaded in
+ * full after all, so that close IDs can be suggested.
+ *
+ * @param filenames The paths to the JSON or JSON Lines files containing citation data.
+ * @param cited The IDs referenced by the input.
+ * @return The library of the citation entries, not yet resolved.
+ */
+Library loadLibraries(const std::vector<std::string>& filenames, const CitedIds& cited) {
+    std::vector<char> partial;
+    auto shards = loadShards(filenames, cited, true, partial);
+
+    if(std::find(partial.begin(), partial.end(), true) != partial.end()) {
+        std::unordered_set<std::string_view> loaded;
+        for(const auto& shard : shards) {
+            for(const auto& entry : shard) loaded.insert(entry["id"].get_ref<const std::string&>());
+        }
+        // A line edited in place may also no longer define the ID it was indexed for
+        bool missing = std::any_of(cited.get().begin(), cited.get().end(),
+                                   [&](const std::string& id) { return loaded.count(id) == 0; });
+        if(missing) {
+            std::vector<std::string> reloaded;
+            for(std::size_t i = 0; i < filenames.size(); i++) {
+                if(partial[i]) reloaded.push_back(filenames[i]);
+            }
+            // The cited entries of these files are already being fetched
+            std::vector<char> none;
+            auto full = loadShards(reloaded, nothingCited(), false, none);
+            for(std::size_t i = 0, j = 0; i < filenames.size(); i++) {
+                if(partial[i]) shards[i] = std::move(full[j++]);
+            }
+        }
+    }
+    return Library(std::move(shards));
+}
+
+/**
+ * @brief Load a Library from several files in parallel without requesting any metadata.
+ *
+ * @param filenames The paths to the JSON or JSON Lines files containing citation data.
+ * @return The library of all citation entries in the files, not yet resolved.
+ */
+Library loadLibraries(const std::vector<std::string>& filenames) {
+    // Nothing is cited, so the parsers start no requests, and every entry is needed
+    std::vector<char> partial;
+    return Library(loadShards(filenames, nothingCited(), false, partial));
+}
@@ -0,0 +1,270 @@
+#pragma once
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "citation.h"
+#include "prefix_index.h"
+#include "third_parties/nlohmann/json.hpp"
+
+/**
+ * @brief Library is an indexed collection of citation entries.
+ *
+ * This class owns the JSON entries loaded from a citation file and indexes them
+ * by their unique identifier.
+ *
+ * Entries are turned into Citation objects only when they are resolved, so the
+ * metadata of books and webpages that are never cited is never requested, and
+ * resolving one cited entry does not wait for the others.
+ */
+class Library {
+private:
+    std::vector<nlohmann::json> entries;                      //!< The citation entries, in file order.
+    mutable std::vector<std::shared_ptr<Citation>> citations; //!< The resolved citations, null until resolved.
+    mutable std::mutex resolveMutex;                          //!< Guards citations.
+    std::unordered_map<std::string, std::size_t> index;       //!< Maps an ID to its first entry.
+    std::unordered_map<std::string, std::vector<std::size_t>> duplicates; //!< Maps an ID defined more than once to its positions.
+    std::vector<std::size_t> shardEnds;                       //!< One past the last position of each shard, if any.
+    mutable PrefixIndex ids;                                  //!< The IDs in sorted order, built on first use.
+    mutable std::once_flag idsOnce;
+
+public:
+    /**
+     * @brief The position returned by indexOf() for unknown IDs.
+     */
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    /**
+     * @brief Construct an empty Library.
+     */
+    Library() = default;
+
+    /**
+     * @brief Construct a new Library from citation entries and index them.
+     *
+     * @param entries The JSON objects of the citations, each accepted by isCitationEntry().
+     */
+    explicit Library(std::vector<nlohmann::json> entries);
+
+    /**
+     * @brief Construct a new Library from the entries of several files, in order, and index them.
+     *
+     * @param shards The JSON objects of the citations of each file, each accepted by isCitationEntry().
+     */
+    explicit Library(std::vector<std::vector<nlohmann::json>> shards);
+
+    /**
+     * @brief Find the position of the entry with the given ID.
+     *
+     * @param id The unique identifier of the citation.
+     * @return The position of the first entry with this ID, or npos if there is none.
+     */
+    std::size_t indexOf(const std::string& id) const;
+
+    /**
+     * @brief Count the citations defined with the given ID.
+     *
+     * @param id The unique identifier of the citation.
+     * @return The number of citations with this ID; 0 if it is unknown.
+     */
+    std::size_t count(const std::string& id) const;
+
+    /**
+     * @brief Find the positions of all the entries with the given ID.
+     *
+     * @param id The unique identifier of the citation.
+     * @return The positions in ascending order; empty if the ID is unknown.
+     */
+    std::vector<std::size_t> definitions(const std::string& id) const;
+
+    /**
+     * @brief Find the file an entry was loaded from.
+     *
+     * @param position The position of the entry.
+     * @return The index of its shard, or 0 if the library was not loaded from several files.
+     */
+    std::size_t shardOf(std::size_t position) const;
+
+    /**
+     * @brief Get the JSON object of an entry.
+     *
+     * @param position The position of the entry.
+     */
+    const nlohmann::json& getEntry(std::size_t position) const {
+        return entries[position];
+    }
+
+    /**
+     * @brief Get the ID of an entry.
+     *
+     * @param position The position of the entry.
+     */
+    const std::string& getId(std::size_t position) const {
+        return entries[position]["id"].get_ref<const std::string&>();
+    }
+
+    /**
+     * @brief Get the dictionary of the IDs, building it on first use.
+     *
+     * Each ID appears once, with the position of its first entry as its value.
+     */
+    const PrefixIndex& getIds() const;
+
+    /**
+     * @brief Find the entries whose ID starts with a prefix.
+     *
+     * @param prefix The prefix of the IDs.
+     * @param limit The maximum number of positions to return.
+     * @param positions A vector to store the positions of the best matching entries, best first.
+     * @param weights The weights of the ranks of getIds(), e.g. citation counts, or nullptr for ID order.
+     * @return The total number of matching IDs, which may exceed limit.
+     */
+    std::size_t complete(std::string_view prefix, std::size_t limit, std::vector<std::size_t>& positions,
+                         const CompletionWeights* weights = nullptr) const;
+
+    /**
+     * @brief Find the entries whose IDs are closest to an unknown ID, for "did you mean" hints.
+     *
+     * @param id The unknown ID.
+     * @param limit The maximum number of positions to return.
+     * @param positions A vector to store the positions of the closest entries, closest first.
+     */
+    void suggest(std::string_view id, std::size_t limit, std::vector<std::size_t>& positions) const;
+
+    /**
+     * @brief Get the citation of an entry, creating it on first use.
+     *
+     * Creating a book or webpage requests its metadata, so this may block. It is
+     * safe to call from several threads; concurrent first calls for the same
+     * entry may both create the citation, and one of them is kept.
+     *
+     * @param position The position of the entry.
+     * @return The citation of the entry, valid as long as the library.
+     *
+     * @throws std::invalid_argument if a book has an invalid ISBN.
+     * @throws std::runtime_error if the metadata cannot be fetched.
+     */
+    const Citation& resolve(std::size_t position) const;
+
+    /**
+     * @brief Start the metadata request of an entry in the background, so that resolving it later does not block.
+     *
+     * @param position The position of the entry.
+     * @return true if resolve() can answer without waiting for a request, false while one is in flight.
+     */
+    bool prefetch(std::size_t position) const;
+
+    /**
+     * @brief Get the number of citations in the library.
+     */
+    std::size_t size() const {
+        return entries.size();
+    }
+};
+
+/**
+ * @brief The set of citation IDs referenced by the input, available once the input has been scanned.
+ */
+using CitedIds = std::shared_future<std::unordered_set<std::string>>;
+
+/**
+ * @brief Check whether a JSON object describes a citation.
+ *
+ * The JSON object must have string "type" and "id" fields, plus the fields
+ * required by its type: "isbn" for books, "url" for webpages, and "title",
+ * "author", "journal", "year", "volume" and "issue" for articles.
+ *
+ * @param j The JSON value to check.
+ * @return true if the JSON value describes a citation, false otherwise.
+ */
+bool isCitationEntry(const nlohmann::json& j);
+
+/**
+ * @brief Create the Citation object described by a citation entry.
+ *
+ * @param j A JSON object accepted by isCitationEntry().
+ * @return The created citation.
+ *
+ * @throws std::invalid_argument if j is not a citation entry or a book has an invalid ISBN.
+ * @throws std::runtime_error if the metadata of a book or webpage cannot be fetched.
+ */
+std::shared_ptr<Citation> createCitation(const nlohmann::json& j);
+
+/**
+ * @brief Options of the walk that finds the citation entries in JSON data.
+ */
+struct CitationWalkOptions {
+    std::size_t maxDepth = 256;  //!< The deepest nesting of objects and arrays searched.
+};
+
+/**
+ * @brief Collect the citation entries of JSON data, in document order.
+ *
+ * The citation entries are found without recursion: a citation entry is not
+ * searched further, any other object through its object members and the
+ * object elements of its array members.
+ *
+ * @param j The JSON data containing the citations; the collected entries are moved out of it.
+ * @param entries A vector to store the citation entries.
+ * @param options The depth limit of the walk.
+ *
+ * @throws std::runtime_error if the data is nested deeper than options.maxDepth.
+ */
+void collectCitationEntries(nlohmann::json& j, std::vector<nlohmann::json>& entries,
+                            const CitationWalkOptions& options = CitationWalkOptions{});
+
+/**
+ * @brief Parse a JSON citation file, starting the metadata requests of cited entries on the way.
+ *
+ * While the file is parsed, the metadata request of every cited book or webpage
+ * is started in the background as soon as its JSON object is complete.
+ *
+ * @param filename The path to the JSON file containing citation data.
+ * @param cited The IDs referenced by the input; waited for when the first book or webpage is parsed.
+ * @return The parsed JSON data.
+ *
+ * @throws Any exception stored in cited, e.g. when the input could not be read or scanned.
+ * @throws std::runtime_error if the file cannot be opened or holds null.
+ * @throws nlohmann::json::parse_error if the file is not JSON.
+ */
+nlohmann::json parseLibrary(const std::string& filename, const CitedIds& cited);
+
+/**
+ * @brief Load a Library from several files in parallel, overlapping parsing with the metadata requests of cited entries.
+ *
+ * A JSON Lines file (see isJsonLinesFile()) is parsed in parallel. If it has
+ * an offset index (see JsonLinesIndex), the index is updated and only the
+ * entries of the cited IDs are read, unless one of them is not defined. The
+ * entries keep the order of the files, and shardOf() tells which file an entry
+ * comes from.
+ *
+ * @param filenames The paths to the JSON or JSON Lines files containing citation data.
+ * @param cited The IDs referenced by the input.
+ * @return The library of the citation entries in the files, not yet resolved.
+ *
+ * @throws Any exception stored in cited, e.g. when the input could not be read or scanned.
+ * @throws std::runtime_error if a file cannot be opened or holds null.
+ * @throws nlohmann::json::parse_error if a file is not JSON.
+ */
+Library loadLibraries(const std::vector<std::string>& filenames, const CitedIds& cited);
+
+/**
+ * @brief Load a Library from several files in parallel without requesting any metadata.
+ *
+ * @param filenames The paths to the JSON or JSON Lines files containing citation data.
+ * @return The library of all citation entries in the files, not yet resolved.
+ *
+ * @throws std::runtime_error if a file cannot be opened or holds null.
+ * @throws nlohmann::json::parse_error if a file is not JSON.
+ */
+Library loadLibraries(const std::vector<std::string>& filenames);
+
+#endif
@@ -0,0 +1,122 @@
+#include "library_snapshot.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// The nesting depth of the pins of this thread
+thread_local std::size_t pinDepth = 0;
+
+} // namespace
+
+EpochReclaimer::Guard::Guard(EpochReclaimer& reclaimer) : reclaimer{reclaimer} {
+    auto& slot = reclaimer.slotOfThisThread();
+    // Publishing the epoch before the pointer is loaded makes a writer that swaps the pointer later see the pin
+    if (pinDepth++ == 0) slot.epoch.store(reclaimer.epoch.load());
+}
+
+EpochReclaimer::Guard::~Guard() {
+    if (--pinDepth == 0) reclaimer.slotOfThisThread().epoch.store(0, std::memory_order_release);
+}
+
+EpochReclaimer& EpochReclaimer::instance() {
+    static EpochReclaimer reclaimer;
+    return reclaimer;
+}
+
+/**
+ * @brief Get the slot of the calling thread, taking a free one on the first call.
+ */
+EpochReclaimer::Slot& EpochReclaimer::slotOfThisThread() {
+    // Gives the slot back when the thread exits
+    struct Registration {
+        Slot* slot = nullptr;
+        ~Registration() {
+            if (slot) slot->taken.store(false, std::memory_order_release);
+        }
+    };
+    thread_local Registration registration;
+    if (registration.slot) return *registration.slot;
+    for (auto& slot : slots) {
+        bool expected = false;
+        if (slot.taken.compare_exchange_strong(expected, true)) {
+            registration.slot = &slot;
+            return slot;
+        }
+    }
+    throw std::runtime_error("too many threads reading published objects");
+}
+
+/**
+ * @brief Retire an object that is no longer published, and free what no reader can use any more.
+ *
+ * @param free Frees the object.
+ */
+void EpochReclaimer::retire(std::function<void()> free) {
+    std::lock_guard<std::mutex> lock{retiredMutex};
+    retired.emplace_back(epoch.fetch_add(1), std::move(free));
+    reclaimLocked();
+}
+
+void EpochReclaimer::reclaim() {
+    std::lock_guard<std::mutex> lock{retiredMutex};
+    reclaimLocked();
+}
+
+std::size_t EpochReclaimer::pending() {
+    std::lock_guard<std::mutex> lock{retiredMutex};
+    return retired.size();
+}
+
+/**
+ * @brief Free the objects retired before the oldest pinned epoch.
+ */
+void EpochReclaimer::reclaimLocked() {
+    auto oldest = std::numeric_limits<std::uint64_t>::max();
+    for (const auto& slot : slots) {
+        auto pinned = slot.epoch.load();
+        if (pinned != 0) oldest = std::min(oldest, pinned);
+    }
+    auto freeable = std::stable_partition(retired.begin(), retired.end(),
+                                          [oldest](const auto& object) { return object.first >= oldest; });
+    std::vector<std::pair<std::uint64_t, std::function<void()>>> freed{std::make_move_iterator(freeable),
+                                                                        std::make_move_iterator(retired.end())};
+    retired.erase(freeable, retired.end());
+    for (auto& object : freed) object.second();
+}
+
+LiveLibrary::Reader::Reader(const LiveLibrary& live)
+    : guard{EpochReclaimer::instance().pin()}, snapshot{live.current.load()} {}
+
+/**
+ * @brief Build and publish the first library.
+ *
+ * @param build Loads the library.
+ */
+LiveLibrary::LiveLibrary(const std::function<Library()>& build)
+    : current{new LibrarySnapshot{build(), 1}}, generations{1} {
+    current.load()->library.getIds();
+}
+
+LiveLibrary::~LiveLibrary() {
+    // No reader outlives the server, and the retired snapshots are freed by the reclaimer
+    delete current.load();
+}
+
+/**
+ * @brief Build a new library and make it the current snapshot.
+ *
+ * @param build Loads the new library.
+ * @return The generation of the new snapshot.
+ */
+std::uint64_t LiveLibrary::publish(const std::function<Library()>& build) {
+    auto* snapshot = new LibrarySnapshot{build(), 0};
+    // The ID dictionary is built on first use; build it here, so that no reader has to
+    snapshot->library.getIds();
+    std::lock_guard<std::mutex> lock{publishMutex};
+    snapshot->generation = ++generations;
+    const auto* old = current.exchange(snapshot);
+    EpochReclaimer::instance().retire([old] { delete old; });
+    return snapshot->generation;
+}
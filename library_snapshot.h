@@ -0,0 +1,179 @@
+#pragma once
+#ifndef LIBRARY_SNAPSHOT_H
+#define LIBRARY_SNAPSHOT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "library.h"
+
+/**
+ * @brief EpochReclaimer frees the objects that writers have unpublished once no reader can still use them.
+ *
+ * A reader pins the current epoch while it uses a published object, by
+ * writing the epoch to a slot of its thread: one load and one store, so a
+ * reader never waits. A writer that replaces an object retires the old one at
+ * the current epoch and advances the epoch. A reader that can still see the
+ * old object pinned an epoch no later than that, so the object is freed once
+ * every pinned slot holds a later epoch.
+ *
+ * Each thread takes a slot on its first pin and gives it back when it exits.
+ * Pins nest; only the outermost one counts.
+ */
+class EpochReclaimer {
+public:
+    /**
+     * @brief Keeps the epoch of the calling thread pinned while it lives.
+     */
+    class Guard {
+    public:
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        ~Guard();
+
+    private:
+        friend class EpochReclaimer;
+        explicit Guard(EpochReclaimer& reclaimer);
+        EpochReclaimer& reclaimer;
+    };
+
+    /**
+     * @brief Get the process-wide reclaimer.
+     */
+    static EpochReclaimer& instance();
+
+    /**
+     * @brief Pin the current epoch in the calling thread.
+     *
+     * @return A guard that unpins it when destroyed.
+     * @throws std::runtime_error if more threads than there are slots hold pins.
+     */
+    Guard pin() {
+        return Guard{*this};
+    }
+
+    /**
+     * @brief Retire an object that is no longer published, and free what no reader can use any more.
+     *
+     * @param free Frees the object; it is called by a later retire() or reclaim(), or right away.
+     */
+    void retire(std::function<void()> free);
+
+    /**
+     * @brief Free the retired objects that no reader can use any more.
+     */
+    void reclaim();
+
+    /**
+     * @brief Get the number of retired objects not yet freed.
+     */
+    std::size_t pending();
+
+private:
+    static constexpr std::size_t kSlots = 256;
+
+    /**
+     * @brief The epoch pinned by a thread, 0 when it holds no pin, on a cache line of its own.
+     */
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> epoch{0};
+        std::atomic<bool> taken{false};
+    };
+
+    std::atomic<std::uint64_t> epoch{1};
+    Slot slots[kSlots];
+    std::mutex retiredMutex;
+    std::vector<std::pair<std::uint64_t, std::function<void()>>> retired;  //!< The objects and the epochs they were retired at.
+
+    Slot& slotOfThisThread();
+    void reclaimLocked();
+};
+
+/**
+ * @brief LibrarySnapshot is a loaded library that is never changed once published.
+ */
+struct LibrarySnapshot {
+    Library library;
+    std::uint64_t generation;  //!< 1 for the first library, then one more for each library published.
+};
+
+/**
+ * @brief LiveLibrary publishes the current LibrarySnapshot of a long-running server.
+ *
+ * Readers load the snapshot from an atomic pointer under an EpochReclaimer
+ * pin, so they neither lock nor wait. A reload builds the new library on its
+ * own, off the read path, and publish() swaps it in with a single store; the
+ * old snapshot is freed once the readers that could see it are done.
+ */
+class LiveLibrary {
+public:
+    /**
+     * @brief A pinned snapshot; it stays valid while the reader lives.
+     */
+    class Reader {
+    public:
+        const Library& operator*() const {
+            return snapshot->library;
+        }
+
+        const Library* operator->() const {
+            return &snapshot->library;
+        }
+
+        /**
+         * @brief Get the generation of the snapshot.
+         */
+        std::uint64_t generation() const {
+            return snapshot->generation;
+        }
+
+    private:
+        friend class LiveLibrary;
+        explicit Reader(const LiveLibrary& live);
+        EpochReclaimer::Guard guard;
+        const LibrarySnapshot* snapshot;
+    };
+
+    /**
+     * @brief Build and publish the first library.
+     *
+     * @param build Loads the library, e.g. with loadLibraries().
+     */
+    explicit LiveLibrary(const std::function<Library()>& build);
+
+    ~LiveLibrary();
+
+    LiveLibrary(const LiveLibrary&) = delete;
+    LiveLibrary& operator=(const LiveLibrary&) = delete;
+
+    /**
+     * @brief Get the current snapshot, without locking or waiting.
+     */
+    Reader read() const {
+        return Reader{*this};
+    }
+
+    /**
+     * @brief Build a new library and make it the current snapshot.
+     *
+     * The library, with its ID dictionary, is built before anything is
+     * locked, so readers keep the old snapshot meanwhile and never wait for a
+     * lazy build; if build() throws, the old snapshot stays.
+     *
+     * @param build Loads the new library.
+     * @return The generation of the new snapshot.
+     */
+    std::uint64_t publish(const std::function<Library()>& build);
+
+private:
+    std::atomic<const LibrarySnapshot*> current;
+    std::mutex publishMutex;  //!< Orders the writers; readers never take it.
+    std::uint64_t generations = 0;
+};
+
+#endif
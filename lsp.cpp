@@ -0,0 +1,623 @@
+#include "lsp.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace {
+
+// JSON-RPC and LSP error codes
+constexpr int kParseError = -32700;
+constexpr int kInvalidRequest = -32600;
+constexpr int kMethodNotFound = -32601;
+constexpr int kRequestFailed = -32803;
+
+// LSP enumerations
+constexpr int kSeverityError = 1;
+constexpr int kSeverityWarning = 2;
+constexpr int kSyncIncremental = 2;
+constexpr int kCompletionKindReference = 18;
+
+// Maximum number of completion items per response; the list is marked incomplete beyond it.
+constexpr std::size_t kCompletionLimit = 100;
+// Maximum number of unknown keys whose suggestions are remembered; the memo is emptied beyond it.
+constexpr std::size_t kSuggestionLimit = 4096;
+
+// The pause in the messages after a change before its diagnostics are published,
+// and the longest the diagnostics of a change wait while changes keep coming.
+constexpr std::chrono::milliseconds kDiagnosticsDelay{200};
+constexpr std::chrono::milliseconds kDiagnosticsMaxDelay{1000};
+
+/**
+ * @brief Read one message framed by a Content-Length header.
+ *
+ * @param input The stream to read from.
+ * @param body Set to the body of the message.
+ * @return false at the end of the input or on a malformed header.
+ */
+bool readMessage(std::istream& input, std::string& body) {
+    std::string line;
+    std::size_t length = 0;
+    bool hasLength = false;
+    while (std::getline(input, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) {
+            if (!hasLength) continue;
+            body.resize(length);
+            return static_cast<bool>(input.read(&body[0], static_cast<std::streamsize>(length)));
+        }
+        constexpr const char* kContentLength = "Content-Length:";
+        if (line.compare(0, std::strlen(kContentLength), kContentLength) == 0) {
+            length = std::strtoull(line.c_str() + std::strlen(kContentLength), nullptr, 10);
+            hasLength = true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief The messages read from the client and not handled yet.
+ *
+ * It is shared with the thread reading them, which may outlive the server.
+ */
+struct Inbox {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::string> messages;
+    bool closed = false;  //!< The input has ended; no message follows those queued.
+};
+
+// Bytes that end the key being completed
+bool isKeyDelimiter(char c) {
+    return c == ' ' || c == '\t' || c == '[' || c == ']' || c == '{' || c == '}' || c == ',' || c == ';' || c == '@';
+}
+
+/**
+ * @brief Get the path of a "file:" URI, decoding its percent escapes.
+ *
+ * @return The path, or an empty string for another scheme.
+ */
+std::string pathOfUri(const std::string& uri) {
+    constexpr std::string_view kScheme = "file://";
+    if (uri.compare(0, kScheme.size(), kScheme) != 0) return "";
+    return decodeUriComponent(uri.substr(kScheme.size()), false);
+}
+
+} // namespace
+
+/**
+ * @brief Construct a new LanguageServer object.
+ *
+ * @param library The citation library, which must outlive the server.
+ * @param libraryPaths The files the library is loaded from, to reload it from.
+ * @param options The options of the scanner used for every document.
+ */
+LanguageServer::LanguageServer(LiveLibrary& library, std::vector<std::string> libraryPaths, ScannerOptions options)
+    : live{library}, libraryPaths{std::move(libraryPaths)}, options{options} {
+    auto reader = live.read();
+    generation = reader.generation();
+    weights = CompletionWeights{reader->getIds().size()};
+}
+
+/**
+ * @brief Serve requests until the client sends "exit" or closes the input.
+ *
+ * The messages are read on their own thread, so that the server can tell when
+ * the client pauses and publish the diagnostics of the changes then. If the
+ * client exits without closing the input, the reading thread is left blocked
+ * on it until the process ends.
+ */
+int LanguageServer::run(std::istream& input, std::ostream& output) {
+    this->output = &output;
+    auto inbox = std::make_shared<Inbox>();
+    std::thread reader{[inbox, &input] {
+        std::string body;
+        while (readMessage(input, body)) {
+            std::lock_guard<std::mutex> lock{inbox->mutex};
+            inbox->messages.push_back(std::move(body));
+            inbox->condition.notify_one();
+        }
+        std::lock_guard<std::mutex> lock{inbox->mutex};
+        inbox->closed = true;
+        inbox->condition.notify_one();
+    }};
+
+    for (;;) {
+        if (!pending.empty() && std::chrono::steady_clock::now() >= diagnosticsDue) {
+            publishPending();
+            EpochReclaimer::instance().reclaim();
+        }
+        std::string body;
+        {
+            std::unique_lock<std::mutex> lock{inbox->mutex};
+            auto ready = [&inbox] { return !inbox->messages.empty() || inbox->closed; };
+            if (pending.empty()) inbox->condition.wait(lock, ready);
+            else if (!inbox->condition.wait_until(lock, diagnosticsDue, ready)) continue;
+            if (inbox->messages.empty()) break;
+            body = std::move(inbox->messages.front());
+            inbox->messages.pop_front();
+        }
+
+        auto message = nlohmann::json::parse(body, nullptr, false);
+        if (message.is_discarded() || !message.is_object()) {
+            respondError(nullptr, kParseError, "Parse error");
+            continue;
+        }
+        if (!handle(message)) break;
+        // The message has released its pin, so the snapshots retired meanwhile can go now rather than at the next reload
+        EpochReclaimer::instance().reclaim();
+    }
+
+    bool closed;
+    {
+        std::lock_guard<std::mutex> lock{inbox->mutex};
+        closed = inbox->closed;
+    }
+    if (closed) reader.join();
+    else reader.detach();
+    return shutdownRequested ? 0 : 1;
+}
+
+void LanguageServer::send(const nlohmann::json& message) {
+    auto body = message.dump();
+    *output << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+    output->flush();
+}
+
+void LanguageServer::respond(const nlohmann::json& id, nlohmann::json result) {
+    send({{"jsonrpc", "2.0"}, {"id", id}, {"result", std::move(result)}});
+}
+
+void LanguageServer::respondError(const nlohmann::json& id, int code, const std::string& message) {
+    send({{"jsonrpc", "2.0"}, {"id", id}, {"error", {{"code", code}, {"message", message}}}});
+}
+
+/**
+ * @brief Handle one request or notification.
+ *
+ * @param message The message.
+ * @return false if the server should exit.
+ */
+bool LanguageServer::handle(const nlohmann::json& message) {
+    auto method = message.value("method", std::string{});
+    bool isRequest = message.contains("id");
+    nlohmann::json id = isRequest ? message["id"] : nlohmann::json{};
+    const auto& params = message.contains("params") ? message["params"] : nlohmann::json::object();
+
+    if (method == "exit") return false;
+    if (shutdownRequested) {
+        if (isRequest) respondError(id, kInvalidRequest, "Server is shutting down");
+        return true;
+    }
+
+    // The whole message sees one snapshot, even if a reload publishes the next meanwhile
+    auto reader = live.read();
+    library = &*reader;
+
+    try {
+        if (reader.generation() != generation) {
+            generation = reader.generation();
+            refresh();
+        }
+
+        if (method == "initialize") {
+            respond(id, {
+                {"capabilities", {
+                    {"textDocumentSync", {{"openClose", true}, {"change", kSyncIncremental}}},
+                    {"completionProvider", {{"triggerCharacters", {"[", "@", "{", ","}}}},
+                    {"hoverProvider", true}
+                }},
+                {"serverInfo", {{"name", "docman"}}}
+            });
+        }
+        else if (method == "shutdown") {
+            shutdownRequested = true;
+            respond(id, nullptr);
+        }
+        else if (method == "textDocument/didOpen") {
+            const auto& item = params.at("textDocument");
+            auto uri = item.at("uri").get<std::string>();
+            documents.insert_or_assign(uri, Document{item.at("text").get<std::string>(), options});
+            recount(uri);
+            prefetch(uri);
+            publishDiagnostics(uri);
+        }
+        else if (method == "textDocument/didChange") {
+            didChange(params);
+        }
+        else if (method == "textDocument/didClose") {
+            auto uri = params.at("textDocument").at("uri").get<std::string>();
+            documents.erase(uri);
+            diagnosed.erase(uri);
+            pending.erase(uri);
+            recount(uri);
+            send({{"jsonrpc", "2.0"}, {"method", "textDocument/publishDiagnostics"},
+                  {"params", {{"uri", uri}, {"diagnostics", nlohmann::json::array()}}}});
+        }
+        else if (method == "workspace/didChangeWatchedFiles") {
+            for (const auto& change : params.at("changes")) {
+                if (isLibraryFile(change.at("uri").get<std::string>())) {
+                    requestReload();
+                    break;
+                }
+            }
+        }
+        else if (method == "docman/reloadLibrary") {
+            requestReload();
+        }
+        else if (method == "textDocument/completion") {
+            respond(id, completion(params));
+        }
+        else if (method == "textDocument/hover") {
+            respond(id, hover(params));
+        }
+        else if (isRequest) {
+            respondError(id, kMethodNotFound, "Method not found: " + method);
+        }
+    }
+    catch (const std::exception& e) {
+        // Malformed parameters fail the request, not the server
+        if (isRequest) respondError(id, kRequestFailed, e.what());
+    }
+    return true;
+}
+
+/**
+ * @brief Start a reload in the background, or have the running one load again once it is done.
+ */
+void LanguageServer::requestReload() {
+    std::lock_guard<std::mutex> lock{reloadMutex};
+    reloadPending = true;
+    if (reloadRunning) return;
+    reloadRunning = true;
+    // The last reload has cleared reloadRunning, so waiting for its future does not block
+    reloading = std::async(std::launch::async, [this] { reload(); });
+}
+
+/**
+ * @brief Load and publish the library files until no reload is pending.
+ *
+ * If a file cannot be read or parsed, loading throws and the old snapshot is
+ * kept. Problems are logged to the standard error, as the output is the protocol.
+ */
+void LanguageServer::reload() {
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock{reloadMutex};
+            if (!reloadPending) {
+                reloadRunning = false;
+                return;
+            }
+            reloadPending = false;
+        }
+        try {
+            auto published = live.publish([this] { return loadLibraries(libraryPaths); });
+            std::cerr << "docman: loaded library generation " << published << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "docman: keeping the loaded library: " << e.what() << std::endl;
+        }
+    }
+}
+
+/**
+ * @brief Recount the completion weights and rediagnose every open document for a new snapshot.
+ *
+ * The ranks of the IDs change with the library, so the weights are rebuilt from
+ * scratch. The diagnostics are published as soon as the current message is handled.
+ */
+void LanguageServer::refresh() {
+    weights = CompletionWeights{library->getIds().size()};
+    counted.clear();
+    suggestions.clear();
+    diagnosed.clear();
+    for (const auto& [uri, document] : documents) {
+        recount(uri);
+        pending.insert(uri);
+    }
+    pendingSince = diagnosticsDue = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Tell whether a URI names one of the library files.
+ */
+bool LanguageServer::isLibraryFile(const std::string& uri) const {
+    auto path = pathOfUri(uri);
+    if (path.empty()) return false;
+    std::error_code error;
+    auto changed = std::filesystem::weakly_canonical(path, error);
+    if (error) return false;
+    return std::any_of(libraryPaths.begin(), libraryPaths.end(), [&](const std::string& libraryPath) {
+        std::error_code error;
+        auto canonical = std::filesystem::weakly_canonical(libraryPath, error);
+        return !error && canonical == changed;
+    });
+}
+
+/**
+ * @brief Apply the changes of a didChange notification and schedule the publication of the new diagnostics.
+ *
+ * Ranged changes are applied to the document as edits; a change without a
+ * range replaces the whole text. The diagnostics are published, and the
+ * metadata requests started, once the client pauses.
+ */
+void LanguageServer::didChange(const nlohmann::json& params) {
+    auto uri = params.at("textDocument").at("uri").get<std::string>();
+    auto found = documents.find(uri);
+    if (found == documents.end()) return;
+    auto& document = found->second;
+
+    for (const auto& change : params.at("contentChanges")) {
+        const auto& text = change.at("text").get_ref<const std::string&>();
+        if (!change.contains("range")) {
+            document = Document{text, options};
+            continue;
+        }
+        const auto& start = change["range"].at("start");
+        const auto& end = change["range"].at("end");
+        auto begin = document.offsetAt(start.at("line").get<std::size_t>(), start.at("character").get<std::size_t>());
+        auto finish = document.offsetAt(end.at("line").get<std::size_t>(), end.at("character").get<std::size_t>());
+        document.edit(begin, finish > begin ? finish - begin : 0, text);
+    }
+    recount(uri);
+
+    auto now = std::chrono::steady_clock::now();
+    if (pending.empty()) pendingSince = now;
+    pending.insert(uri);
+    diagnosticsDue = std::min(now + kDiagnosticsDelay, pendingSince + kDiagnosticsMaxDelay);
+}
+
+/**
+ * @brief Publish the diagnostics of the documents changed since they were last published.
+ */
+void LanguageServer::publishPending() {
+    auto reader = live.read();
+    library = &*reader;
+    if (reader.generation() != generation) {
+        generation = reader.generation();
+        refresh();
+    }
+    auto uris = std::move(pending);
+    pending.clear();
+    for (const auto& uri : uris) {
+        prefetch(uri);
+        publishDiagnostics(uri);
+    }
+}
+
+/**
+ * @brief Start the metadata requests of the books and webpages a document cites, so that hover finds them resolved.
+ */
+void LanguageServer::prefetch(const std::string& uri) {
+    for (const auto& [key, n] : documents.at(uri).getReferences()) {
+        auto entry = library->indexOf(key);
+        if (entry != Library::npos) library->prefetch(entry);
+    }
+}
+
+/**
+ * @brief Update the completion weights with the citations of a document, or remove them if it is closed.
+ *
+ * The counts are compared with those of the last time, so only the keys whose
+ * count changed are reweighted.
+ */
+void LanguageServer::recount(const std::string& uri) {
+    static const std::unordered_map<std::string, std::size_t> none;
+    auto open = documents.find(uri);
+    const auto& now = open == documents.end() ? none : open->second.getReferences();
+    auto& before = counted[uri];
+
+    const auto& ids = library->getIds();
+    auto adjust = [&](const std::string& key, std::size_t removed, std::size_t added) {
+        if (removed == added) return;
+        auto rank = ids.find(key);
+        if (rank == PrefixIndex::npos) return;
+        auto weight = static_cast<std::size_t>(weights.get(rank)) + added - removed;
+        weights.set(rank, static_cast<std::uint32_t>(std::min<std::size_t>(weight, UINT32_MAX)));
+    };
+    for (const auto& [key, n] : before) {
+        auto found = now.find(key);
+        adjust(key, n, found == now.end() ? 0 : found->second);
+    }
+    for (const auto& [key, n] : now) {
+        if (before.find(key) == before.end()) adjust(key, 0, n);
+    }
+
+    if (open == documents.end()) counted.erase(uri);
+    else before = now;
+}
+
+nlohmann::json LanguageServer::range(const Document& document, std::size_t begin, std::size_t end) const {
+    std::size_t startLine, startCharacter, endLine, endCharacter;
+    document.positionAt(begin, startLine, startCharacter);
+    document.positionAt(end, endLine, endCharacter);
+    return {{"start", {{"line", startLine}, {"character", startCharacter}}},
+            {"end", {{"line", endLine}, {"character", endCharacter}}}};
+}
+
+/**
+ * @brief Get the "did you mean" part of the diagnostic of an unknown key.
+ *
+ * The text is remembered per key until the library is reloaded, so a key that
+ * stays unknown while the document is edited is looked up in the dictionary once.
+ *
+ * @param key The unknown key.
+ * @return The suggestions, or an empty string if no ID is close to the key.
+ */
+const std::string& LanguageServer::suggest(const std::string& key) {
+    auto found = suggestions.find(key);
+    if (found != suggestions.end()) return found->second;
+    if (suggestions.size() >= kSuggestionLimit) suggestions.clear();
+
+    std::vector<std::size_t> positions;
+    library->suggest(key, 3, positions);
+    std::string text;
+    for (std::size_t i = 0; i < positions.size(); i++) {
+        text += (i == 0 ? "; did you mean '" : i + 1 == positions.size() ? " or '" : ", '");
+        text += library->getId(positions[i]) + "'";
+    }
+    if (!positions.empty()) text += "?";
+    return suggestions.emplace(key, std::move(text)).first->second;
+}
+
+/**
+ * @brief Diagnose the references of one block: unknown, duplicate and malformed references.
+ *
+ * @param document The document.
+ * @param block The index of the block.
+ * @param diagnostics A vector to append the diagnostics to, with lines relative to the block.
+ */
+void LanguageServer::diagnose(const Document& document, std::size_t block, std::vector<Diagnostic>& diagnostics) {
+    auto firstLine = document.blockLine(block);
+    auto add = [&](std::size_t begin, std::size_t end, int severity, std::string message) {
+        Diagnostic diagnostic{0, 0, 0, 0, severity, std::move(message)};
+        document.positionAt(begin, diagnostic.startLine, diagnostic.startCharacter);
+        document.positionAt(end, diagnostic.endLine, diagnostic.endCharacter);
+        diagnostic.startLine -= firstLine;
+        diagnostic.endLine -= firstLine;
+        diagnostics.push_back(std::move(diagnostic));
+    };
+
+    std::vector<CitationOccurrence> occurrences;
+    document.getOccurrences(block, occurrences);
+    for (const auto& occurrence : occurrences) {
+        std::string key{occurrence.key};
+        auto count = library->count(key);
+        if (count == 1) continue;
+        auto message = count == 0 ? "Unknown citation ID '" + key + "'"
+                                  : "Citation ID '" + key + "' is defined " + std::to_string(count) + " times in the library";
+        if (count == 0) message += suggest(key);
+        add(occurrence.keyOffset, occurrence.keyOffset + occurrence.key.size(),
+            count == 0 ? kSeverityError : kSeverityWarning, std::move(message));
+    }
+
+    std::size_t offset;
+    if (document.getError(block, offset)) {
+        add(offset, offset + 1, kSeverityError, "Malformed reference: unbalanced or nested bracket");
+    }
+}
+
+/**
+ * @brief Publish the diagnostics of a document.
+ *
+ * Only the blocks whose version has not been diagnosed for the current
+ * snapshot are diagnosed; the others keep their diagnostics, moved to the
+ * line their block starts on now.
+ */
+void LanguageServer::publishDiagnostics(const std::string& uri) {
+    const auto& document = documents.at(uri);
+    pending.erase(uri);
+    auto& before = diagnosed[uri];
+    std::unordered_map<std::uint64_t, std::vector<Diagnostic>> now;
+    auto diagnostics = nlohmann::json::array();
+
+    for (std::size_t block = 0; block < document.blockCount(); block++) {
+        auto& kept = now[document.blockVersion(block)];
+        auto found = before.find(document.blockVersion(block));
+        if (found != before.end()) kept = std::move(found->second);
+        else diagnose(document, block, kept);
+
+        auto firstLine = document.blockLine(block);
+        for (const auto& diagnostic : kept) {
+            diagnostics.push_back({{"range", {{"start", {{"line", firstLine + diagnostic.startLine},
+                                                         {"character", diagnostic.startCharacter}}},
+                                              {"end", {{"line", firstLine + diagnostic.endLine},
+                                                       {"character", diagnostic.endCharacter}}}}},
+                                   {"severity", diagnostic.severity},
+                                   {"source", "docman"},
+                                   {"message", diagnostic.message}});
+        }
+    }
+    before = std::move(now);
+
+    send({{"jsonrpc", "2.0"}, {"method", "textDocument/publishDiagnostics"},
+          {"params", {{"uri", uri}, {"diagnostics", std::move(diagnostics)}}}});
+}
+
+/**
+ * @brief Complete the citation key before the cursor.
+ *
+ * The key starts after "[" for brackets, after "@" for Pandoc, or after "{" or
+ * "," in a \cite command; elsewhere there is nothing to complete.
+ */
+nlohmann::json LanguageServer::completion(const nlohmann::json& params) const {
+    auto items = nlohmann::json::array();
+    auto found = documents.find(params.at("textDocument").at("uri").get<std::string>());
+    if (found == documents.end()) return {{"isIncomplete", false}, {"items", items}};
+    const auto& document = found->second;
+
+    const auto& position = params.at("position");
+    auto offset = document.offsetAt(position.at("line").get<std::size_t>(), position.at("character").get<std::size_t>());
+    auto line = document.lineBefore(offset);
+    auto start = line.size();
+    while (start > 0 && !isKeyDelimiter(line[start - 1])) start--;
+    char trigger = start > 0 ? line[start - 1] : '\0';
+    bool inKey = (trigger == '[' && (options.syntaxes & Brackets)) || (trigger == '@' && (options.syntaxes & Pandoc)) ||
+                 ((trigger == '{' || trigger == ',') && (options.syntaxes & Latex) &&
+                  line.rfind("cite", start) != std::string_view::npos);
+    if (!inKey) return {{"isIncomplete", false}, {"items", items}};
+
+    std::vector<std::size_t> positions;
+    auto total = library->complete(line.substr(start), kCompletionLimit, positions, &weights);
+    for (auto entry : positions) {
+        const auto& json = library->getEntry(entry);
+        nlohmann::json item = {{"label", library->getId(entry)}, {"kind", kCompletionKindReference}};
+        std::string detail = json["type"].get<std::string>();
+        if (json.contains("title") && json["title"].is_string()) detail += ": " + json["title"].get<std::string>();
+        item["detail"] = detail;
+        // Clients sort by sortText, so keep the order of the ranking
+        item["sortText"] = std::to_string(1000 + items.size());
+        items.push_back(std::move(item));
+    }
+    return {{"isIncomplete", total > positions.size()}, {"items", std::move(items)}};
+}
+
+/**
+ * @brief Show the reference under the cursor as it is printed in the reference list.
+ *
+ * A book or webpage whose metadata is still being requested is only reported
+ * as resolving: its request is started if need be, and a later hover shows it.
+ */
+nlohmann::json LanguageServer::hover(const nlohmann::json& params) const {
+    auto found = documents.find(params.at("textDocument").at("uri").get<std::string>());
+    if (found == documents.end()) return nullptr;
+    const auto& document = found->second;
+
+    const auto& position = params.at("position");
+    auto offset = document.offsetAt(position.at("line").get<std::size_t>(), position.at("character").get<std::size_t>());
+    CitationOccurrence occurrence;
+    if (!document.referenceAt(offset, occurrence)) return nullptr;
+
+    std::string key{occurrence.key};
+    std::string text;
+    auto entry = library->indexOf(key);
+    if (entry == Library::npos) {
+        text = "Unknown citation ID `" + key + "`";
+    }
+    else if (!library->prefetch(entry)) {
+        // The message thread never waits for the network; the client hovers again
+        text = "Resolving `" + key + "`…";
+    }
+    else {
+        try {
+            std::ostringstream printed;
+            library->resolve(entry).print(printed);
+            text = "```\n" + printed.str() + "```";
+        }
+        catch (const std::exception& e) {
+            text = "Cannot resolve `" + key + "`: " + e.what();
+        }
+    }
+    return {{"contents", {{"kind", "markdown"}, {"value", text}}},
+            {"range", range(document, occurrence.keyOffset, occurrence.keyOffset + occurrence.key.size())}};
+}
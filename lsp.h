@@ -0,0 +1,129 @@
+#pragma once
+#ifndef LSP_H
+#define LSP_H
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "document.h"
+#include "library.h"
+#include "library_snapshot.h"
+#include "scanner.h"
+#include "third_parties/nlohmann/json.hpp"
+
+/**
+ * @brief LanguageServer serves citation diagnostics, completion and hover over the Language Server Protocol.
+ *
+ * The server speaks JSON-RPC over a pair of streams, normally standard input
+ * and output, with the Content-Length framing of the protocol. The library
+ * stays resident as a LiveLibrary snapshot; each message is handled against the
+ * snapshot current when it arrives. Each open document is kept as a Document,
+ * which is updated and rescanned incrementally on every change.
+ *
+ * - Diagnostics are published for references to IDs that are not in the
+ *   library or are defined more than once, and for malformed references.
+ *   They are kept per block of the Document, so a change only diagnoses the
+ *   blocks it touched. Messages are read on their own thread, and the
+ *   diagnostics of a change are published once the client pauses, or after
+ *   a second of uninterrupted changes.
+ * - Completion offers the library IDs starting with the key being typed after
+ *   "[", "@" or in a \cite command, from the ID dictionary of the library.
+ *   The IDs cited most often in the open documents come first.
+ * - Hover shows the reference as it is printed in the reference list. The
+ *   metadata of the books and webpages a document cites is requested in the
+ *   background when it is opened or changed; until it arrives, hover says the
+ *   reference is being resolved rather than making the other messages wait.
+ * - The library is reloaded in the background when the client reports that a
+ *   library file changed ("workspace/didChangeWatchedFiles") or sends a
+ *   "docman/reloadLibrary" notification. Files that cannot be read or parsed
+ *   keep the old snapshot. Once the new one is published, the completion
+ *   weights are recounted and the diagnostics of the open documents are
+ *   published again once the next message is handled.
+ */
+class LanguageServer {
+public:
+    /**
+     * @brief Construct a new LanguageServer object.
+     *
+     * @param library The citation library, which must outlive the server.
+     * @param libraryPaths The files the library is loaded from, to reload it from.
+     * @param options The options of the scanner used for every document.
+     */
+    LanguageServer(LiveLibrary& library, std::vector<std::string> libraryPaths, ScannerOptions options);
+
+    /**
+     * @brief Serve requests until the client sends "exit" or closes the input.
+     *
+     * @param input The stream the client writes messages to.
+     * @param output The stream the client reads messages from.
+     * @return The exit status: 0 if the client asked for a shutdown before exiting, 1 otherwise.
+     */
+    int run(std::istream& input, std::ostream& output);
+
+private:
+    LiveLibrary& live;
+    std::vector<std::string> libraryPaths;
+    const Library* library = nullptr;  //!< The snapshot pinned while a message is handled.
+    std::uint64_t generation = 0;      //!< The generation the weights and diagnostics were computed for.
+    ScannerOptions options;
+    std::unordered_map<std::string, Document> documents;  //!< Open documents by URI.
+    // The keys each open document cited when it was last counted, and the total over the documents by ID rank
+    std::unordered_map<std::string, std::unordered_map<std::string, std::size_t>> counted;
+    CompletionWeights weights;
+    // The suggestions for each unknown key cited since the last reload
+    std::unordered_map<std::string, std::string> suggestions;
+
+    /**
+     * @brief A diagnostic, with its lines relative to the first line of its block.
+     */
+    struct Diagnostic {
+        std::size_t startLine;
+        std::size_t startCharacter;
+        std::size_t endLine;
+        std::size_t endCharacter;
+        int severity;
+        std::string message;
+    };
+    // The diagnostics of each open document by block version, for the snapshot of the current generation
+    std::unordered_map<std::string, std::unordered_map<std::uint64_t, std::vector<Diagnostic>>> diagnosed;
+    // The documents changed since their diagnostics were last published, and when those are due
+    std::unordered_set<std::string> pending;
+    std::chrono::steady_clock::time_point pendingSince;
+    std::chrono::steady_clock::time_point diagnosticsDue;
+    std::ostream* output = nullptr;
+    bool shutdownRequested = false;
+
+    std::mutex reloadMutex;
+    bool reloadPending = false;  //!< A reload was asked for and has not started yet.
+    bool reloadRunning = false;
+    std::future<void> reloading;
+
+    void send(const nlohmann::json& message);
+    void respond(const nlohmann::json& id, nlohmann::json result);
+    void respondError(const nlohmann::json& id, int code, const std::string& message);
+    bool handle(const nlohmann::json& message);
+
+    void requestReload();
+    void reload();
+    void refresh();
+    bool isLibraryFile(const std::string& uri) const;
+    void didChange(const nlohmann::json& params);
+    void recount(const std::string& uri);
+    void prefetch(const std::string& uri);
+    const std::string& suggest(const std::string& key);
+    void diagnose(const Document& document, std::size_t block, std::vector<Diagnostic>& diagnostics);
+    void publishDiagnostics(const std::string& uri);
+    void publishPending();
+    nlohmann::json completion(const nlohmann::json& params) const;
+    nlohmann::json hover(const nlohmann::json& params) const;
+    nlohmann::json range(const Document& document, std::size_t begin, std::size_t end) const;
+};
+
+#endif
@@ -3,374 +3,614 @@
 #include <vector>
 #include <algorithm>
 #include <cstring>
+#include <filesystem>
+#include <future>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <unordered_set>
 
 #include "utils.hpp"
 #include "citation.h"
+#include "library.h"
+#include "thread_pool.h"
+#include "renderer.h"
+#include "scanner.h"
+#include "numbering.h"
+#include "lsp.h"
+#include "search_index.h"
+#include "json_lines.h"
+#include "checker.h"
+#include "isbn_table.h"
+#include "metadata_store.h"
+#include "title_table.h"
+#include "metadata.h"
 
-#include "book.h"
-#include "webpage.h"
-#include "article.h"
-
-#include "third_parties/nlohmann/json.hpp"
-#include "third_parties/cpp-httplib/httplib.h"
-
-httplib::Client client{ API_ENDPOINT };
-
-using json = nlohmann::json;
+#ifndef _WIN32
+#include <glob.h>
+#include <unistd.h>
+#endif
 
 /**
- * @brief Create Citation objects from JSON data and store their pointers in a vector.
- * 
- * This function parses the provided JSON data to create different types of Citation objects
- * based on the "type" field. It then stores the pointers to these objects in the citations vector.
- * The memory for each Citation object is managed using std::shared_ptr, ensuring automatic memory
- * deallocation when the objects are no longer needed.
- * 
- * @param citations A vector to store the shared pointers to the created Citation objects.
- * @param j The JSON data containing information about the Citation objects to be created.
- * @return true if all Citation objects were successfully created and stored, false otherwise.
- * 
- * @note This function expects the JSON data to have "type" and "id" fields to identify the
- *       type and unique identifier of each Citation object. For different types of Citations,
- *       additional fields such as "isbn", "url", or specific attributes are required.
- * 
- * @note The function performs input validation by checking the presence of required fields
- *       and their data types. If any required field is missing or has an invalid type, the
- *       function returns false indicating creation failure.
+ * @brief Read text from a file and return it as a string.
  * 
- * @note For each type of Citation (book, webpage, article), specific fields are expected
- *       in the JSON data, and their absence or invalidity results in creation failure.
+ * This function reads the contents of a text file and returns them as a string.
  * 
- * @note If the provided "type" field does not match any supported type (book, webpage, article),
- *       the function returns false indicating creation failure.
+ * @param filename The path to the text file.
+ * @return A string containing the contents of the text file.
  * 
- * @note If an error occurs during the creation of a Citation object, such as a network error
- *       or invalid JSON data, the function returns false indicating creation failure.
+ * @note This function reads the entire contents of the specified file into memory as a string.
  * 
- * @note The memory management of the Citation objects is handled automatically by std::shared_ptr,
- *       ensuring proper deallocation of resources and preventing memory leaks.
+ * @note If the file cannot be opened or read, the function throws std::runtime_error.
+ *       The input may be read on a worker thread, so the function never exits the process itself.
  */
-bool createCitationsPointer(std::vector<std::shared_ptr<Citation>>& citations, const json& j) {
-    // Check for required fields "type" and "id"
-    if(!check_string(j, "type") || !check_string(j, "id"))
-        return false;
-    
-    auto type = j["type"].get<std::string>();
-    auto id = j["id"].get<std::string>();
-
-    // Create Citation objects based on the type field
-    if(type == "book") {
-        // Check for the required "isbn" field
-        if(!check_string(j, "isbn")) {
-            return false;
-        }
+std::string readFromFile(const std::string& filename) {
+    std::ifstream file{ filename };
 
-        auto isbn = j["isbn"].get<std::string>();
-        // Create a Book object and store its pointer in the citations vector
-        citations.push_back(std::shared_ptr<Citation>(dynamic_cast<Citation*>(new Book(id, isbn))));
+    if(!file.is_open()) {
+        std::cout << "输入文件打开失败:" << filename << "\n";
+        throw std::runtime_error("cannot open input file");
     }
-    else if(type == "webpage") {
-        // Check for the requried "url" field
-        if(!check_string(j, "url")) {
-            return false;
-        }
-        
-        auto url = j["url"].get<std::string>();
-        // Create a WebPage object and store its pointer in the citations vector
-        citations.push_back(std::shared_ptr<Citation>(dynamic_cast<Citation*>(new WebPage(id, url))));
-    } 
-    else if(type == "article") {
-        // Check for the required fields for creating a Article object
-        if(!check_string(j, "title") || !check_string(j, "author") || !check_string(j, "journal") || !check_int(j, "year") || !check_int(j, "volume") || !check_int(j, "issue"))
-            return false;
-
-        auto title = j["title"].get<std::string>();
-        auto author = j["author"].get<std::string>();
-        auto journal = j["journal"].get<std::string>();
-        int year = j["year"].get<int>();
-        int volume = j["volume"].get<int>();
-        int issue = j["issue"].get<int>();
-        
-        // Create an Article object and store its pointer in the citations vector
-        citations.push_back(std::shared_ptr<Citation>(dynamic_cast<Citation*>(new Article(id, title, author, journal, year, volume, issue))));
-    } else {
-        return false;
+
+    if(file.fail()) {
+        throw std::runtime_error("cannot read input file");
+    }
+
+    // Read the file contents into a string
+    std::string res = std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if(file.bad()) {
+        throw std::runtime_error("cannot read input file");
     }
-    return true;
+    return res;
 }
 
 /**
- * @brief Recursively create Citation objects from JSON data and store their pointers in a vector.
+ * @brief Extract the citation IDs from the references found in the input text.
  * 
- * This function parses the provided JSON data recursively to create different types of Citation objects
- * and stores their pointers in the citations vector. It handles nested JSON structures and arrays.
- * The memory for each Citation object is managed using std::shared_ptr, ensuring automatic memory
- * deallocation when the objects are no longer needed.
- * 
- * @param citations A vector to store the shared pointers to the created Citation objects.
- * @param j The JSON data containing information about the Citation objects to be created.
- * 
- * @note This function recursively traverses the JSON data to handle nested JSON structures and arrays.
- *       It creates Citation objects based on the JSON data and stores their pointers in the citations vector.
+ * @param occurrences The references found by a CitationScanner.
+ * @param ids A vector to store the extracted IDs, sorted and without duplicates.
+ */
+void extractCitationIds(const std::vector<CitationOccurrence>& occurrences, std::vector<std::string>& ids) {
+    for(const auto& occurrence : occurrences) {
+        ids.emplace_back(occurrence.key);
+    }
+
+    // Remove duplicate IDs and sort them
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+/**
+ * @brief Resolve the cited citations and print the reference section to an output stream.
  * 
- * @note The JSON data is expected to have a specific format, with each item representing a Citation object.
- *       The function recursively processes each item to create the corresponding Citation objects.
+ * This function prints the section header, then resolves and formats the citations
+ * on the shared ThreadPool. The citations are cut into contiguous slices, and each
+ * slice is formatted by one worker into its own buffer. A slice is printed as soon as
+ * it and all slices before it are done, so the output starts while later metadata
+ * requests are still in flight, and consecutive finished slices go out in one write.
  * 
- * @note This function modifies the citations vector to store the shared pointers to the created Citation objects.
- *       It does not create copies of the Citation objects, but rather stores pointers to them.
+ * @param library The library containing the cited citations.
+ * @param positions The positions in the library of the citations to be printed, in output order.
+ * @param output The output stream where the references will be printed.
+ * @param numbered Whether each reference is labelled with its 1-based position instead of its ID.
  * 
- * @note The memory management of the Citation objects is handled automatically by std::shared_ptr,
- *       ensuring proper deallocation of resources and preventing memory leaks.
+ * @throws The first exception thrown while resolving a citation or writing the output.
  */
-void createCitations(std::vector<std::shared_ptr<Citation>>& citations, const json& j) {
-    // Create Citation objects and store their pointers in the citations vector
-    if(createCitationsPointer(citations, j))
-        return;
-    
-    // Traverse each item in the JSON data
-    for(auto& item : j.items()) {
-        // If the item's value is an array, recursively process each element in the array
-        if(item.value().is_array()) {
-            for(auto& element : item.value()) {
-                if(element.is_object()){
-                    createCitations(citations, element);
+void printReferences(const Library& library, const std::vector<std::size_t>& positions, std::ostream& output,
+                     bool numbered) {
+    // Print section header for references; flush it with the input text, which must not wait for the first reference
+    output << "\n\nReferences:\n" << std::flush;
+
+    // Small outputs get one citation per slice so each line is printed as early as possible;
+    // large ones get enough slices to keep every worker busy without a task per citation
+    auto& pool = ThreadPool::instance();
+    std::size_t grain = std::min<std::size_t>(std::max<std::size_t>(positions.size() / (pool.size() * 16), 1), 256);
+    std::size_t slices = (positions.size() + grain - 1) / grain;
+
+    StreamingRenderer renderer{output, slices};
+#ifndef _WIN32
+    if(&output == &std::cout) renderer.setDescriptor(STDOUT_FILENO);
+#endif
+    TaskGroup group{pool};
+    for(std::size_t slice = 0; slice < slices; slice++) {
+        // Wait while too many slices are waiting for an earlier one
+        renderer.acquire(slice);
+        group.run([&library, &positions, &renderer, slice, grain, numbered] {
+            try {
+                std::ostringstream text;
+                auto end = std::min(positions.size(), (slice + 1) * grain);
+                for(auto i = slice * grain; i < end; i++) {
+                    const auto& citation = library.resolve(positions[i]);
+                    if(!numbered) {
+                        citation.print(text); // Print citation
+                        continue;
+                    }
+                    // Every citation prints "[id]" first; replace it with the number
+                    std::ostringstream line;
+                    citation.print(line);
+                    text << '[' << i + 1 << ']' << line.str().substr(citation.getId().size() + 2);
                 }
+                renderer.deliver(slice, text.str());
             }
-        } 
-        // If the item's value is an object, recursively process the object
-        else if(item.value().is_object()) {
-            createCitations(citations, item.value());
+            catch(...) {
+                renderer.cancel();
+                throw;
+            }
+        });
+    }
+    group.wait();
+}
+
+/**
+ * @brief Add the citation libraries named by a "-c" argument, expanding a glob pattern.
+ *
+ * The matching files are added in sorted order, except the offset indexes kept
+ * next to JSON Lines libraries. A pattern matching no file is added as it is,
+ * so that loading it reports the missing file.
+ *
+ * @param pattern The path or glob pattern, e.g. "libraries/\*.json".
+ * @param libraryPaths A vector to append the paths to.
+ */
+void addLibraryPaths(const std::string& pattern, std::vector<std::string>& libraryPaths) {
+#ifndef _WIN32
+    glob_t matches;
+    if(glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+        const std::string suffix = JsonLinesIndex::pathFor("");
+        for(std::size_t i = 0; i < matches.gl_pathc; i++) {
+            std::string path = matches.gl_pathv[i];
+            if(path.size() < suffix.size() || path.compare(path.size() - suffix.size(), suffix.size(), suffix) != 0)
+                libraryPaths.push_back(std::move(path));
         }
+        globfree(&matches);
+        return;
     }
+    globfree(&matches);
+#endif
+    libraryPaths.push_back(pattern);
 }
 
 /**
- * @brief Load citations from a JSON file and create Citation objects.
- * 
- * This function reads citation data from a JSON file, creates Citation objects based on the data,
- * and returns a vector containing pointers to these objects. The memory for each Citation object
- * is managed using std::shared_ptr, ensuring automatic memory deallocation when the objects are
- * no longer needed.
- * 
- * @param filename The path to the JSON file containing citation data.
- * @return A vector containing shared pointers to the created Citation objects.
- * 
- * @note This function reads JSON data from the specified file and uses it to create Citation objects.
- *       The memory management of the Citation objects is handled automatically by std::shared_ptr.
- * 
- * @note If the JSON file cannot be opened or parsed correctly, the function may throw exceptions or
- *       return an empty vector.
+ * @brief Exit if a citation library cannot be opened, reporting the first such file.
+ *
+ * The loaders throw on a missing file; the command line reports it first.
+ *
+ * @param libraryPaths The paths to the libraries.
  */
-std::vector<std::shared_ptr<Citation>> loadCitations(const std::string& filename) {
-    
-    std::ifstream file{ filename };
+void requireLibraryFiles(const std::vector<std::string>& libraryPaths) {
+    for(const auto& path : libraryPaths) {
+        if(!std::ifstream{path}.is_open()) {
+            std::cout << "文献合集打开文件失败:"  <<  path << "\n";
+            std::exit(1);
+        }
+    }
+}
 
-    if(!file.is_open()) {
-        std::cout << "文献合集打开文件失败:"  <<  filename << "\n";
-        std::exit(1);
+/**
+ * @brief Explain on standard error why a cited ID cannot be printed.
+ *
+ * An unknown ID is reported with the closest IDs of the library, if any, as
+ * they are usually what was meant. An ID defined more than once is reported
+ * with the files defining it when the library was loaded from several files.
+ *
+ * @param library The citation library.
+ * @param id The ID that is unknown or defined more than once.
+ * @param libraryPaths The files the library was loaded from, in order.
+ */
+void reportInvalidId(const Library& library, const std::string& id, const std::vector<std::string>& libraryPaths) {
+    auto count = library.count(id);
+    if(count > 1) {
+        std::cerr << "docman: citation ID '" << id << "' is defined " << count << " times";
+        if(libraryPaths.size() > 1) {
+            std::vector<std::size_t> shards;
+            for(auto position : library.definitions(id)) shards.push_back(library.shardOf(position));
+            shards.erase(std::unique(shards.begin(), shards.end()), shards.end());
+            for(std::size_t i = 0; i < shards.size(); i++)
+                std::cerr << (i == 0 ? ", in " : i + 1 == shards.size() ? " and " : ", ") << libraryPaths[shards[i]];
+        }
+        std::cerr << "\n";
+        return;
     }
 
-    if(file.fail()) {
-        std::exit(1);
+    std::cerr << "docman: unknown citation ID '" << id << "'";
+    std::vector<std::size_t> suggestions;
+    library.suggest(id, 3, suggestions);
+    for(std::size_t i = 0; i < suggestions.size(); i++) {
+        std::cerr << (i == 0 ? "; did you mean '" : i + 1 == suggestions.size() ? " or '" : ", '")
+                  << library.getId(suggestions[i]) << "'";
     }
+    std::cerr << (suggestions.empty() ? "\n" : "?\n");
+}
 
-    json data;
-    file >> data;
+/**
+ * @brief Run the "docman lsp" subcommand: serve a language server on standard input and output.
+ *
+ * @param argc The number of arguments, including "docman" and "lsp".
+ * @param argv The arguments: "-c" with the citation library, and optionally "-s" and "-m" as for the main command.
+ * @return The exit status of the server.
+ */
+int runLanguageServer(int argc, char** argv) {
+    // "docman", "lsp", "-c", "citations.json", "-s", "latex,pandoc"
+    std::vector<std::string> libraryPaths;
+    ScannerOptions options;
+    bool syntaxesSet = false;
 
-    if(data.is_null()) exit(1);
+    for(int i = 2; i < argc; i++) {
+        if(std::strcmp(argv[i], "-c") == 0) {
+            if(i == argc - 1) exit(1);
+            addLibraryPaths(argv[i + 1], libraryPaths);
+            i++;
+        }
+        else if(std::strcmp(argv[i], "-s") == 0) {
+            if(i == argc - 1 || syntaxesSet || !parseCitationSyntaxes(argv[i + 1], options.syntaxes)) exit(1);
+            syntaxesSet = true;
+            i++;
+        }
+        else if(std::strcmp(argv[i], "-m") == 0) {
+            options.skipCode = true;
+        }
+        else {
+            exit(1);
+        }
+    }
+    if(libraryPaths.empty()) exit(1);
 
-    std::vector<std::shared_ptr<Citation>>citations{};
-    createCitations(citations, data);
-    return citations;
+    requireLibraryFiles(libraryPaths);
+    try {
+        // The library stays loaded for the whole session, and is swapped when it is reloaded; entries are resolved when first hovered
+        LiveLibrary library{[&] { return loadLibraries(libraryPaths); }};
+        LanguageServer server{library, libraryPaths, options};
+        return server.run(std::cin, std::cout);
+    }
+    catch(...) {
+        std::exit(1);
+    }
 }
 
 /**
- * @brief Read text from a file and return it as a string.
- * 
- * This function reads the contents of a text file and returns them as a string.
- * 
- * @param filename The path to the text file.
- * @return A string containing the contents of the text file.
- * 
- * @note This function reads the entire contents of the specified file into memory as a string.
- * 
- * @note If the file cannot be opened or read, the function may throw exceptions or return an empty string.
+ * @brief Run the "docman search" subcommand: print the entries containing every word of a query.
+ *
+ * Each match is printed as "[id] type: " followed by its indexed fields that the
+ * library file holds, so that no metadata is requested.
+ *
+ * @param argc The number of arguments, including "docman" and "search".
+ * @param argv The arguments: "-c" with the citation library, optionally "-i" with a file to keep
+ *             the index in, and the words of the query.
+ * @return 0 if an entry matches, 1 otherwise.
  */
-std::string readFromFile(const std::string& filename) {
-    std::ifstream file{ filename };
+int runSearch(int argc, char** argv) {
+    // "docman", "search", "-c", "citations.json", "-i", "citations.idx", "knuth", "typesetting"
+    std::vector<std::string> libraryPaths;
+    std::string indexPath = "";
+    std::string query = "";
 
-    if(!file.is_open()) {
-        std::cout << "输入文件打开失败:" << filename << "\n";
-        std::exit(1);
+    for(int i = 2; i < argc; i++) {
+        if(std::strcmp(argv[i], "-c") == 0) {
+            if(i == argc - 1) exit(1);
+            addLibraryPaths(argv[i + 1], libraryPaths);
+            i++;
+        }
+        else if(std::strcmp(argv[i], "-i") == 0) {
+            if(i == argc - 1 || indexPath != "") exit(1);
+            indexPath = argv[i + 1];
+            i++;
+        }
+        else {
+            query += (query.empty() ? "" : " ") + std::string{argv[i]};
+        }
     }
+    if(libraryPaths.empty() || query == "") exit(1);
 
-    if(file.fail()) {
-        std::exit(1);
+    requireLibraryFiles(libraryPaths);
+    const Library library = [&] {
+        try {
+            return loadLibraries(libraryPaths);
+        }
+        catch(...) {
+            std::exit(1);
+        }
+    }();
+    // Reuse the stored index if it was built from this library, otherwise build and store it
+    SearchIndex index;
+    std::ifstream stored{indexPath, std::ios::binary};
+    if(indexPath == "" || !stored || !index.deserialize(stored) ||
+       index.getFingerprint() != SearchIndex::fingerprintOf(library)) {
+        index = SearchIndex{library};
+        if(indexPath != "") {
+            std::ofstream store{indexPath, std::ios::binary};
+            index.serialize(store);
+        }
     }
 
-    try{
-        // Read the file contents into a string
-        std::string res = std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-        return res;
+    std::vector<std::size_t> positions;
+    index.search(query, positions);
+    std::string line;
+    for(auto position : positions) {
+        const auto& entry = library.getEntry(position);
+        line = "[" + library.getId(position) + "] " + entry["type"].get<std::string>() + ":";
+        bool first = true;
+        for(const auto* field : {"author", "title", "journal", "publisher"}) {
+            auto found = entry.find(field);
+            if(found == entry.end() || !found->is_string()) continue;
+            line += (first ? " " : ", ") + found->get<std::string>();
+            first = false;
+        }
+        std::cout << line << '\n';
+    }
+    return positions.empty() ? 1 : 0;
+}
+
+/**
+ * @brief Run the "docman index" subcommand: write the offset index of a JSON Lines library.
+ *
+ * The index is built from scratch, so this also repairs an index after a line
+ * was edited in place. Once the index exists, it is brought up to date with
+ * appended lines whenever the library is loaded for an input, and only the
+ * lines of the cited entries are read.
+ *
+ * @param argc The number of arguments, including "docman" and "index".
+ * @param argv The arguments: "-c" with the JSON Lines library.
+ * @return 0 on success.
+ */
+int runIndex(int argc, char** argv) {
+    // "docman", "index", "-c", "citations.jsonl"
+    if(argc != 4 || std::strcmp(argv[2], "-c") != 0 || !isJsonLinesFile(argv[3])) exit(1);
+    std::string libraryPath = argv[3];
+
+    try {
+        JsonLinesIndex index;
+        index.update(libraryPath);
+        std::ofstream store{JsonLinesIndex::pathFor(libraryPath), std::ios::binary};
+        index.serialize(store);
+        if(!store) exit(1);
     }
     catch(...) {
         std::exit(1);
     }
-    return {};
+    return 0;
 }
 
 /**
- * @brief Print citations and input text to an output stream.
- * 
- * This function prints the input text followed by a list of citations to the specified output stream.
- * The citations are printed using their respective print methods, which are called through shared pointers
- * to Citation objects. The memory management of the Citation objects is handled automatically by
- * std::shared_ptr.
- * 
- * @param printedCitations A vector containing shared pointers to the citations to be printed.
- * @param input The input text to be printed before the citations.
- * @param output The output stream where the text and citations will be printed.
- * 
- * @note This function iterates over the vector of shared pointers to access and print each Citation object.
- *       The memory management of the Citation objects is transparently handled by std::shared_ptr.
+ * @brief Run the "docman check" subcommand: report every problem of the citation libraries.
+ *
+ * Each problem is printed as its location, a file and a JSON pointer, followed
+ * by what is wrong. No metadata is requested, so the check runs offline.
+ *
+ * @param argc The number of arguments, including "docman" and "check".
+ * @param argv The arguments: "-c" with a citation library, repeated or with a glob for several.
+ * @return 0 if no problem was found, 1 otherwise.
  */
-void printCitations(const std::vector<std::shared_ptr<Citation>>& printedCitations, const std::string& input, std::ostream& output) {
-    output << input; // Print input text
+int runCheck(int argc, char** argv) {
+    // "docman", "check", "-c", "citations.json", "-c", "departments/*.jsonl"
+    std::vector<std::string> libraryPaths;
+    for(int i = 2; i < argc; i++) {
+        if(std::strcmp(argv[i], "-c") != 0 || i == argc - 1) exit(1);
+        addLibraryPaths(argv[i + 1], libraryPaths);
+        i++;
+    }
+    if(libraryPaths.empty()) exit(1);
 
-    output << "\n\nReferences:\n"; // Print section header for references
+    std::vector<LibraryProblem> problems;
+    auto entries = checkLibraries(libraryPaths, problems);
+    for(const auto& problem : problems) std::cout << formatLocation(libraryPaths, problem) << ": " << problem.message << '\n';
+    std::cerr << "docman: " << problems.size() << (problems.size() == 1 ? " problem" : " problems")
+              << " in " << entries << (entries == 1 ? " entry\n" : " entries\n");
+    return problems.empty() ? 0 : 1;
+}
 
-    for (auto c : printedCitations) {
-        c->print(output); // Print citation
+/**
+ * @brief Run the "docman cache" subcommand: manage the persistent metadata store.
+ *
+ * "docman cache import" merges metadata dumps into the ISBN table of the store,
+ * and the pages of WARC archives into its title table; both are consulted
+ * before the network. "docman cache gc" compacts the responses stored by
+ * earlier runs with $DOCMAN_STORE_RESPONSES set, and "docman cache verify"
+ * checks them, printing each problem.
+ * The store is in metadataStoreDirectory().
+ *
+ * @param argc The number of arguments, including "docman" and "cache".
+ * @param argv The arguments: "import" and the paths to the dumps, JSON Lines or CSV, and archives, ".warc";
+ *             or "gc"; or "verify".
+ * @return 0 on success, 1 if verify found problems; the process exits with 1 on failure.
+ */
+int runCache(int argc, char** argv) {
+    // "docman", "cache", "import", "books.jsonl", "books.csv", "crawl.warc"
+    // "docman", "cache", "gc"
+    // "docman", "cache", "verify"
+    auto responses = metadataStoreDirectory() + "/responses";
+    if(argc == 3 && std::strcmp(argv[2], "gc") == 0) {
+        try {
+            auto stats = MetadataStore::collect(responses);
+            std::cerr << "docman: kept " << stats.kept << " of " << stats.records << " records, " << stats.negative
+                      << " of them negative, from " << stats.segments << " segments (" << stats.expired << " expired, "
+                      << stats.corrupt << " damaged, " << stats.active << " segments in use), "
+                      << stats.bytesBefore << " -> " << stats.bytesAfter << " bytes\n";
+        }
+        catch(const std::exception& e) {
+            std::cerr << "docman: " << e.what() << '\n';
+            std::exit(1);
+        }
+        return 0;
+    }
+    if(argc == 3 && std::strcmp(argv[2], "verify") == 0) {
+        std::vector<MetadataStore::Problem> problems;
+        auto records = MetadataStore::verify(responses, problems);
+        for(const auto& problem : problems) std::cout << problem.file << ':' << problem.offset << ": " << problem.message << '\n';
+        std::cerr << "docman: " << problems.size() << (problems.size() == 1 ? " problem" : " problems")
+                  << " in " << records << (records == 1 ? " record\n" : " records\n");
+        return problems.empty() ? 0 : 1;
+    }
+    if(argc < 4 || std::strcmp(argv[2], "import") != 0) exit(1);
+    std::vector<std::string> dumps, archives;
+    for(int i = 3; i < argc; i++) (TitleTable::isArchive(argv[i]) ? archives : dumps).push_back(argv[i]);
+    try {
+        std::filesystem::create_directories(metadataStoreDirectory());
+        if(!dumps.empty()) {
+            auto stats = IsbnTable::import(dumps, IsbnTable::defaultPath());
+            std::cerr << "docman: imported " << stats.rows - stats.rejected << " of " << stats.rows << " rows, "
+                      << stats.records << " books in " << IsbnTable::defaultPath() << '\n';
+        }
+        if(!archives.empty()) {
+            auto stats = TitleTable::import(archives, TitleTable::defaultPath());
+            std::cerr << "docman: imported " << stats.pages - stats.untitled << " of " << stats.pages << " pages, "
+                      << stats.records << " titles in " << TitleTable::defaultPath() << '\n';
+        }
     }
+    catch(const std::exception& e) {
+        std::cerr << "docman: " << e.what() << '\n';
+        std::exit(1);
+    }
+    return 0;
 }
 
 int main(int argc, char** argv) {
     // "docman", "-c", "citations.json", "input.txt"
-    // Vector to store pointers to loaded citations and using shared_ptr to ensure automatic memort dealocation when the objects are no longer needed.
-    std::vector<std::shared_ptr<Citation>> citations{};
+    // "docman", "-c", "physics.json", "-c", "libraries/*.jsonl", "input.txt"
+    // "docman", "-c", "citations.json", "-s", "latex,pandoc", "paper.tex"
+    // "docman", "-c", "citations.json", "-m", "README.md"
+    // "docman", "-c", "citations.json", "-n", "input.txt"
+    // "docman", "lsp", "-c", "citations.json"
+    // "docman", "search", "-c", "citations.json", "knuth", "typesetting"
+    // "docman", "index", "-c", "citations.jsonl"
+    // "docman", "check", "-c", "citations.json"
+    // "docman", "cache", "import", "books.jsonl", "crawl.warc"
+    // "docman", "cache", "gc"
+    // "docman", "cache", "verify"
+    if(argc > 1 && std::strcmp(argv[1], "lsp") == 0) {
+        return runLanguageServer(argc, argv);
+    }
+    if(argc > 1 && std::strcmp(argv[1], "search") == 0) {
+        return runSearch(argc, argv);
+    }
+    if(argc > 1 && std::strcmp(argv[1], "index") == 0) {
+        return runIndex(argc, argv);
+    }
+    if(argc > 1 && std::strcmp(argv[1], "check") == 0) {
+        return runCheck(argc, argv);
+    }
+    if(argc > 1 && std::strcmp(argv[1], "cache") == 0) {
+        return runCache(argc, argv);
+    }
+
+    // Paths to the citation libraries, loaded in parallel and merged
+    std::vector<std::string> libraryPaths;
     // Path to the output file for printing references
     std::string outputPath = "";
-    // Input text containing citation IDs
-    std::string input = "";
+    // Path to the input text containing citation IDs, "-" for standard input
+    std::string inputPath = "";
+    // Reference syntaxes to recognise in the input text, "[id]" unless -s is given; -m skips Markdown code
+    ScannerOptions options;
+    bool syntaxesSet = false;
+    // Replace references in the text with numbers, IEEE style, instead of printing the text unchanged
+    bool numbered = false;
 
     // Parse command line arguments to process input and output options
     for(int i = 1; i < argc; i++) {
-        // Check if the current argument specifies loading citations from a JSON file
+        // Check if the current argument specifies loading citations from JSON files; it may be repeated or a glob
         if(std::strcmp(argv[i], "-c") == 0) {
-            // Check if the input valid and not-repeated
-            if(i == argc - 1 || !citations.empty()) exit(1);
-                // Load citations from the JSON file specified in the next argument
-                try{
-                    citations = loadCitations(argv[i + 1]);
-                    i++;
-                }
-                catch(...) {
-                    // Handle exceptions throw during file I/O or citation loading
-                    std::exit(1);
-                }
+            // Check if the input valid
+            if(i == argc - 1) exit(1);
+            addLibraryPaths(argv[i + 1], libraryPaths);
+            i++;
         }
         // Check if the current argument specifies the output file path
         else if(std::strcmp(argv[i], "-o") == 0) {
-            // Set the output file path to the next argument
-            try{
-                if(i == argc - 1 || outputPath != "") exit(1); // Ensure the argument is valid and has not been previously set
-                outputPath = argv[i + 1];
-                i++;
-            }
-            catch(...) {
-                // Handle exceptions thrown during argument processing
-                std::exit(1);
-            }
+            // Ensure the argument is valid and has not been previously set
+            if(i == argc - 1 || outputPath != "") exit(1);
+            outputPath = argv[i + 1];
+            i++;
+        }
+        // Check if the current argument specifies the reference syntaxes, e.g. "brackets,latex,pandoc"
+        else if(std::strcmp(argv[i], "-s") == 0) {
+            if(i == argc - 1 || syntaxesSet || !parseCitationSyntaxes(argv[i + 1], options.syntaxes)) exit(1);
+            syntaxesSet = true;
+            i++;
+        }
+        // Check if the references are to be numbered in order of first appearance
+        else if(std::strcmp(argv[i], "-n") == 0) {
+            numbered = true;
+        }
+        // Check if the input is Markdown, whose code and comments hold no references
+        else if(std::strcmp(argv[i], "-m") == 0) {
+            options.skipCode = true;
         }
         // Check if the current argument specifies the intput file path
         else if(i == argc - 1) {
-            try{
-                // Check if the input path is standard input
-                if(strcmp(argv[argc - 1], "-") == 0) {
-                    std::getline(std::cin, input, '\n');
-                }
-                else {
-                    input = readFromFile(argv[argc - 1]); // Read from the input file
-                }
-            }
-            catch(...) {
-                std::exit(1);
-            }
+            inputPath = argv[i];
         }
         else {
             exit(1);
         }
     }
 
-    // Vector to store pointers to citations to be printed, using the shared_ptr to ensure the automatic memort dealocation when the objects are no longer needed.
-    std::vector<std::shared_ptr<Citation>> printedCitations{};
-    
-    // Find citation IDs in the input text
-    std::vector<std::string::size_type>left, right;
-    auto it = input.find("[");
-    while(it != input.npos) {
-        left.push_back(it);
-        try{
-            it = input.find("[", it + 1);
+    // Stage 1, on a worker thread: read and scan the input while the library is being parsed below.
+    // The text to print is held until every ID is known to be valid. The IDs are stored in output order.
+    std::vector<std::string> ids;
+    std::string text;
+    CitedIds cited = std::async(std::launch::async, [&inputPath, &options, numbered, &ids, &text] {
+        std::string input = "";
+        // Check if the input path is standard input
+        if(inputPath == "-") {
+            std::getline(std::cin, input, '\n');
         }
-        catch(...) {
-            break;
+        else if(inputPath != "") {
+            input = readFromFile(inputPath); // Read from the input file
         }
-    }
-    it = input.find("]");
-    while(it != input.npos) {
-        right.push_back(it);
-        try{
-            it = input.find("]", it + 1);
+
+        std::vector<CitationOccurrence> occurrences;
+        if(!CitationScanner{options}.scan(input, occurrences) || occurrences.empty()) throw std::runtime_error("mismatched brackets in input");
+
+        if(numbered) {
+            // Number the IDs by first appearance and print the text with the numbers
+            CitationNumbering numbering{occurrences};
+            ids.assign(numbering.getKeys().begin(), numbering.getKeys().end());
+            text = numbering.rewrite(input, occurrences);
         }
-        catch(...) {
-            break;
+        else {
+            extractCitationIds(occurrences, ids);
+            text = std::move(input);
         }
-    }
-
-    if(left.size() == 0 || right.size() == 0 || left.size() != right.size()) std::exit(1); // check for mismatched brackets in input text
-    
-    // Extract citation IDs enclosed in brackets from input text
-    std::vector<std::string>ids;
-    for(int i = 0; i < left.size(); i++) {
-        if(i < left.size() - 1 && right[i] > left[i + 1]) exit(1);
-        ids.push_back(input.substr(left[i] + 1, right[i] - left[i] - 1)); // Extract IDs enclosed in brackets from input text
-    }
+        return std::unordered_set<std::string>(ids.begin(), ids.end());
+    }).share();
 
-    // Remove duplicate IDs and sort them
-    std::sort(ids.begin(), ids.end());
-    std::unique(ids.begin(), ids.end());
+    // Stage 2, on this thread: parse the library. The metadata requests of cited
+    // books and webpages start as soon as each entry is parsed.
+    // Stage 3: print the input text, then the references as they are resolved
+    try{
+        requireLibraryFiles(libraryPaths);
+        const Library library = !libraryPaths.empty() ? loadLibraries(libraryPaths, cited) : Library{};
+        cited.get();
 
-    // Find citations corresponding to the extracted IDs
-    for(auto& id : ids) {
-        for(auto& citation : citations) {
-            if(citation->getId() == id)
-                printedCitations.push_back(citation);
-        }
-    }
-    
-    // Check if all IDs were found
-    if(ids.size() != printedCitations.size()) std::exit(1);
-
-    // Print citations to standard output or to a file
-    if(outputPath == "") {
-        try{
-            printCitations(printedCitations, input, std::cout);
+        // Find citations corresponding to the extracted IDs
+        std::vector<std::size_t> positions;
+        positions.reserve(ids.size());
+        bool valid = true;
+        for(auto& id : ids) {
+            // Every ID must be defined exactly once in the library; report all that are not before failing
+            if(library.count(id) != 1) {
+                reportInvalidId(library, id, libraryPaths);
+                valid = false;
+                continue;
+            }
+            positions.push_back(library.indexOf(id));
         }
-        catch(...) {
-            exit(1);
+        if(!valid) std::exit(1);
+
+        // Print to standard output or to a file; the file is only created or truncated once the input is valid
+        std::ofstream outputFile;
+        std::ostream* output = &std::cout;
+        if(outputPath != "") {
+            outputFile.open(outputPath);
+            if(!outputFile.is_open()) std::exit(1);
+            output = &outputFile;
         }
+
+        *output << text; // Print input text
+        printReferences(library, positions, *output, numbered);
     }
-    else {
-        try{
-            std::ofstream output = std::ofstream{outputPath};
-            printCitations(printedCitations, input, output);
-        }
-        catch(...) {
-            std::exit(1);
-        }
+    catch(...) {
+        // Handle exceptions thrown during file I/O, scanning, citation loading or resolution
+        std::exit(1);
     }
-    
+
     return 0;
 }
@@ -0,0 +1,81 @@
+#include "mapped_file.h"
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        copy = std::move(other.copy);
+        length = std::exchange(other.length, 0);
+        data = copy.empty() ? std::exchange(other.data, nullptr) : copy.data();
+        other.data = nullptr;
+    }
+    return *this;
+}
+
+/**
+ * @brief Map a file, replacing the current view.
+ *
+ * An empty file is not mapped, as mmap() rejects empty mappings; its view is
+ * simply empty.
+ *
+ * @param path The path to the file.
+ * @return true if the file was mapped, false if it cannot be opened.
+ */
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<std::size_t>(status.st_size);
+    if (length > 0) {
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(fd);
+            length = 0;
+            return false;
+        }
+        data = static_cast<const char*>(mapped);
+    }
+    // The mapping keeps the file alive
+    ::close(fd);
+    return true;
+#else
+    std::ifstream file{path, std::ios::binary};
+    if (!file) return false;
+    copy.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+    data = copy.data();
+    length = copy.size();
+    return true;
+#endif
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+    if (data && copy.empty()) munmap(const_cast<char*>(data), length);
+#endif
+    copy.clear();
+    data = nullptr;
+    length = 0;
+}
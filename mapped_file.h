@@ -0,0 +1,62 @@
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief A read-only view of a whole file, mapped into memory.
+ *
+ * The pages are loaded by the operating system as they are touched, so a
+ * large file is not read before it is used, and several processes share its
+ * pages. Where mmap() is not available, the file is read into memory instead.
+ * A mapping stays valid when the file is replaced by a rename.
+ */
+class MappedFile {
+public:
+    /**
+     * @brief Construct a view of no file.
+     */
+    MappedFile() = default;
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    /**
+     * @brief Map a file, replacing the current view.
+     *
+     * @param path The path to the file.
+     * @return true if the file was mapped, false if it cannot be opened; the view is then empty.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Get the contents of the file.
+     */
+    std::string_view view() const {
+        return {data, length};
+    }
+
+    /**
+     * @brief Get the size of the file in bytes.
+     */
+    std::size_t size() const {
+        return length;
+    }
+
+private:
+    const char* data = nullptr;
+    std::size_t length = 0;
+    std::string copy;  //!< The contents, where the file is read instead of mapped.
+
+    void close();
+};
+
+#endif
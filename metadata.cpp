@@ -0,0 +1,198 @@
+#include "metadata.h"
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "third_parties/cpp-httplib/httplib.h"
+#include "isbn_table.h"
+#include "metadata_store.h"
+#include "thread_pool.h"
+#include "title_table.h"
+#include "utils.hpp"
+
+namespace {
+
+// Outcome of one request: whether it succeeded and the response body.
+using FetchResult = std::pair<bool, std::string>;
+
+// The number of requests prefetchMetadata() keeps on the wire at once
+constexpr std::size_t kPrefetchThreads = 16;
+
+std::mutex inflightMutex;
+// Requests that are currently on the wire, keyed by request path
+std::unordered_map<std::string, std::shared_future<FetchResult>> inflight;
+
+// Build the request path for a key, which also serves as the cache key.
+std::string requestPath(MetadataKind kind, const std::string& key) {
+    return (kind == MetadataKind::Isbn ? "/isbn/" : "/title/") + encodeUriComponent(key);
+}
+
+// Perform the request for a path. Each thread keeps its own client, because a
+// client serializes the requests made through it. Responses and "404 Not Found"
+// are kept in the metadataStore(); other failures may be transient and are not.
+FetchResult request(const std::string& path) {
+    thread_local httplib::Client client{API_ENDPOINT};
+    auto response = client.Get(path);
+    if (response && response->status == httplib::NotFound_404) metadataStore().put(path, {}, true);
+    if (!response || response->status != httplib::OK_200) return {false, {}};
+    metadataStore().put(path, response->body);
+    return {true, std::move(response->body)};
+}
+
+// Look a path up in the cache and in the store on disk.
+// Returns false if the path has to be requested.
+bool lookupStored(const std::string& path, FetchResult& result) {
+    std::string body;
+    if (metadataCache().get(path, body)) {
+        result = {true, std::move(body)};
+        return true;
+    }
+    switch (metadataStore().find(path, body)) {
+    case MetadataStore::Lookup::Found:
+        metadataCache().put(path, body);
+        result = {true, std::move(body)};
+        return true;
+    case MetadataStore::Lookup::NotFound:
+        result = {false, {}};
+        return true;
+    case MetadataStore::Lookup::Missing:
+        break;
+    }
+    return false;
+}
+
+// Register the request of a path as in flight, to be completed through a promise.
+// If another thread has already claimed the path, return the future of its request instead.
+std::shared_future<FetchResult> claim(const std::string& path, std::promise<FetchResult>& promise) {
+    std::lock_guard<std::mutex> lock{inflightMutex};
+    auto found = inflight.find(path);
+    if (found != inflight.end()) return found->second;
+    inflight.emplace(path, promise.get_future().share());
+    return {};
+}
+
+// Answer a claimed path from the store or with a request, and hand the result
+// to the threads waiting for it.
+FetchResult complete(const std::string& path, std::promise<FetchResult>& promise) {
+    FetchResult result;
+    try {
+        if (!lookupStored(path, result)) {
+            result = request(path);
+            if (result.first) metadataCache().put(path, result.second);
+        }
+    }
+    catch (const std::exception&) {
+        // Waiters must not be left hanging; the failure surfaces as a failed fetch
+        result = {false, {}};
+    }
+    promise.set_value(result);
+    {
+        std::lock_guard<std::mutex> lock{inflightMutex};
+        inflight.erase(path);
+    }
+    return result;
+}
+
+// Return the response body of a path from the cache, from the store on disk,
+// from a request already in flight, or from a new request, in that order.
+FetchResult resolve(const std::string& path) {
+    FetchResult result;
+    if (lookupStored(path, result)) return result;
+    std::promise<FetchResult> promise;
+    auto pending = claim(path, promise);
+    if (pending.valid()) return pending.get();
+    return complete(path, promise);
+}
+
+// The pool that runs prefetches. Requests mostly wait on the network, so it
+// has more threads than cores, but a bounded number of them.
+ThreadPool& prefetchPool() {
+    // Never destroyed, like ThreadPool::instance()
+    static ThreadPool* pool = new ThreadPool{kPrefetchThreads};
+    return *pool;
+}
+
+// Look a key up in the tables imported into the metadata store, and return
+// the record parsed like a response. A book record that does not parse or
+// that a Book cannot be built from is left to the network.
+bool findLocal(MetadataKind kind, const std::string& key, nlohmann::json& result) {
+    std::string record;
+    if (kind == MetadataKind::Isbn) {
+        if (!isbnTable().find(key, record)) return false;
+        result = nlohmann::json::parse(record, nullptr, false);
+        return IsbnTable::isComplete(result);
+    }
+    if (!titleTable().find(key, record)) return false;
+    result = nlohmann::json{{"title", std::move(record)}};
+    return true;
+}
+
+} // namespace
+
+MetadataCache& metadataCache() {
+    static MetadataCache cache{std::size_t{64} << 20};
+    return cache;
+}
+
+/**
+ * @brief Fetch the metadata of a canonical key from the API endpoint.
+ *
+ * Books and webpages imported into the local isbnTable() and titleTable()
+ * are answered without a request, unless the record of a book lacks a field.
+ * Successful response bodies are cached under their request path, in memory
+ * and, if enabled, in the metadataStore() on disk; failed requests are not
+ * cached, except that the store remembers a "404 Not Found" for a day. If the
+ * same path is already being requested by another thread, this call waits for
+ * that request instead of sending another.
+ *
+ * @param kind The kind of metadata to fetch.
+ * @param key The canonical key.
+ * @param result Receives the parsed JSON response.
+ * @return true if the metadata was fetched, false otherwise.
+ */
+bool fetchMetadata(MetadataKind kind, const std::string& key, nlohmann::json& result) {
+    if (findLocal(kind, key, result)) return true;
+
+    auto response = resolve(requestPath(kind, key));
+    if (!response.first) return false;
+
+    result = nlohmann::json::parse(response.second, nullptr, false);
+    return !result.is_discarded();
+}
+
+/**
+ * @brief Start fetching the metadata of a canonical key in the background.
+ *
+ * The request is registered as in flight right away and queued on a pool of
+ * kPrefetchThreads threads, so a fetchMetadata() of the key waits for it instead
+ * of sending another, however long the queue. Keys found locally, in memory or
+ * on disk are not queued.
+ *
+ * @param kind The kind of metadata to fetch.
+ * @param key The canonical key.
+ * @return true if the outcome is already known, false if a request is in flight.
+ */
+bool prefetchMetadata(MetadataKind kind, const std::string& key) {
+    nlohmann::json local;
+    if (findLocal(kind, key, local)) return true;
+    auto path = requestPath(kind, key);
+    FetchResult stored;
+    if (lookupStored(path, stored)) return true;
+    auto promise = std::make_shared<std::promise<FetchResult>>();
+    if (claim(path, *promise).valid()) return false;
+    prefetchPool().submit(new Task{[path = std::move(path), promise] { complete(path, *promise); }});
+    return false;
+}
+
+/**
+ * @brief Get the directory of the persistent metadata store.
+ *
+ * @return $DOCMAN_CACHE_DIR, else $XDG_CACHE_HOME/docman, else $HOME/.cache/docman, else ".docman-cache".
+ */
+std::string metadataStoreDirectory() {
+    if (const char* directory = std::getenv("DOCMAN_CACHE_DIR"); directory && *directory) return directory;
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) return std::string{cache} + "/docman";
+    if (const char* home = std::getenv("HOME"); home && *home) return std::string{home} + "/.cache/docman";
+    return ".docman-cache";
+}
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef METADATA_H
+#define METADATA_H
+
+#include <string>
+#include "third_parties/nlohmann/json.hpp"
+#include "metadata_cache.h"
+
+/**
+ * @brief The kinds of metadata that can be resolved from the API endpoint.
+ */
+enum class MetadataKind {
+    Isbn,   //!< Book metadata, resolved through "/isbn/<canonical isbn>".
+    Title   //!< Webpage title, resolved through "/title/<canonical url>".
+};
+
+/**
+ * @brief Get the process-wide cache in front of the metadata requests.
+ *
+ * The cache has a fixed budget of 64 MiB.
+ *
+ * @return A reference to the shared MetadataCache.
+ */
+MetadataCache& metadataCache();
+
+/**
+ * @brief Get the directory of the persistent metadata store, e.g. of the imported ISBN and title tables.
+ *
+ * It is $DOCMAN_CACHE_DIR if set, else $XDG_CACHE_HOME/docman, else
+ * $HOME/.cache/docman, else ".docman-cache" in the working directory.
+ *
+ * @return The path of the directory, which may not exist yet.
+ */
+std::string metadataStoreDirectory();
+
+/**
+ * @brief Fetch the metadata of a canonical key from the API endpoint.
+ *
+ * Books and webpages in the imported tables of the metadata store are answered
+ * locally, without a request.
+ * Responses are kept in the process-wide metadataCache(), keyed by kind and
+ * canonical key, so a book or webpage that appears repeatedly is requested
+ * once while it stays cached. If $DOCMAN_STORE_RESPONSES is set, they are also
+ * kept on disk in the metadataStore(), so later runs need not request them again.
+ *
+ * @param kind The kind of metadata to fetch.
+ * @param key The canonical key, i.e. the output of normalizeIsbn() or normalizeUrl().
+ * @param result Receives the parsed JSON response.
+ * @return true if the request succeeded with HTTP 200 and a JSON body, false otherwise.
+ */
+bool fetchMetadata(MetadataKind kind, const std::string& key, nlohmann::json& result);
+
+/**
+ * @brief Start fetching the metadata of a canonical key in the background, without waiting for it.
+ *
+ * The requests run on a small pool of their own. The response is stored in
+ * metadataCache(), and a later fetchMetadata() of the same key either hits the
+ * cache or waits for this request to complete. Failures are not reported here;
+ * they surface when the metadata is actually fetched.
+ *
+ * @param kind The kind of metadata to fetch.
+ * @param key The canonical key.
+ * @return true if the outcome is already known locally, in memory or on disk, so
+ *         that fetchMetadata() will not wait; false if a request is in flight.
+ */
+bool prefetchMetadata(MetadataKind kind, const std::string& key);
+
+#endif
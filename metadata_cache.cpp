@@ -0,0 +1,268 @@
+#include "metadata_cache.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// Fixed number of bytes charged per entry for list nodes, map buckets and string headers.
+constexpr std::size_t kEntryOverhead = 96;
+// Share of each shard's budget given to the admission window, in percent.
+constexpr std::size_t kWindowPercent = 1;
+// Share of the main segment given to the protected segment, in percent.
+constexpr std::size_t kProtectedPercent = 80;
+// Assumed average entry size, used to size the frequency sketch.
+constexpr std::size_t kAverageEntryBytes = 256;
+
+std::uint64_t hashKey(std::string_view key) {
+    // FNV-1a followed by a murmur finalizer to spread the low bits
+    std::uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+std::size_t nextPowerOfTwo(std::size_t n) {
+    std::size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+/**
+ * @brief Count-min sketch of 4 rows with saturating counters and periodic aging.
+ *
+ * After a number of increments proportional to the width, all counters are
+ * halved, so frequencies reflect recent popularity.
+ */
+class FrequencySketch {
+public:
+    explicit FrequencySketch(std::size_t expectedEntries)
+        : width{nextPowerOfTwo(std::max<std::size_t>(expectedEntries, 64))},
+          sampleSize{width * 10},
+          table(width * kRows, 0) {}
+
+    void increment(std::uint64_t hash) {
+        bool added = false;
+        for (std::size_t row = 0; row < kRows; row++) {
+            auto& counter = table[row * width + index(hash, row)];
+            if (counter < kMaxCount) {
+                counter++;
+                added = true;
+            }
+        }
+        if (added && ++additions >= sampleSize) age();
+    }
+
+    unsigned frequency(std::uint64_t hash) const {
+        unsigned result = kMaxCount;
+        for (std::size_t row = 0; row < kRows; row++) {
+            result = std::min<unsigned>(result, table[row * width + index(hash, row)]);
+        }
+        return result;
+    }
+
+private:
+    static constexpr std::size_t kRows = 4;
+    static constexpr std::uint8_t kMaxCount = 15;
+
+    std::size_t width = 0;
+    std::size_t additions = 0;
+    std::size_t sampleSize = 0;
+    std::vector<std::uint8_t> table;
+
+    std::size_t index(std::uint64_t hash, std::size_t row) const {
+        // Derive one index per row from a single hash (double hashing)
+        std::uint64_t h = (hash >> 32) + (row + 1) * (hash & 0xffffffffull) + row * 0x9e3779b97f4a7c15ull;
+        return static_cast<std::size_t>(h ^ (h >> 29)) & (width - 1);
+    }
+
+    void age() {
+        for (auto& counter : table) counter >>= 1;
+        additions /= 2;
+    }
+};
+
+} // namespace
+
+/**
+ * @brief One independently locked partition of the cache.
+ *
+ * Entries live in one of three LRU lists, most recently used first: the
+ * admission window, the probation segment and the protected segment. The
+ * index maps a key, viewed in place inside its list node, to the node.
+ */
+class MetadataCache::Shard {
+public:
+    explicit Shard(std::size_t budget)
+        : budget{budget},
+          windowBudget{std::max<std::size_t>(budget * kWindowPercent / 100, kEntryOverhead)},
+          protectedBudget{(budget - std::min(budget, windowBudget)) * kProtectedPercent / 100},
+          sketch{budget / kAverageEntryBytes} {}
+
+    bool get(const std::string& key, std::uint64_t hash, std::string& value) {
+        std::lock_guard<std::mutex> lock{mutex};
+        sketch.increment(hash);
+        auto found = index.find(key);
+        if (found == index.end()) return false;
+        auto node = found->second;
+        value = node->value;
+        touch(node);
+        return true;
+    }
+
+    void put(const std::string& key, std::uint64_t hash, std::string&& value) {
+        std::lock_guard<std::mutex> lock{mutex};
+        std::size_t charge = kEntryOverhead + key.size() + value.size();
+
+        auto found = index.find(key);
+        if (found != index.end()) {
+            auto node = found->second;
+            segmentBytes(node->segment) -= node->charge;
+            node->value = std::move(value);
+            node->charge = charge;
+            segmentBytes(node->segment) += charge;
+            touch(node);
+            enforceBudget();
+            return;
+        }
+
+        if (charge > budget) return;
+
+        window.push_front(Entry{key, std::move(value), hash, charge, Segment::Window});
+        index.emplace(window.front().key, window.begin());
+        windowBytes += charge;
+        enforceBudget();
+    }
+
+private:
+    enum class Segment { Window, Probation, Protected };
+
+    struct Entry {
+        std::string key;
+        std::string value;
+        std::uint64_t hash;
+        std::size_t charge;
+        Segment segment;
+    };
+
+    using List = std::list<Entry>;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string_view, List::iterator> index;
+    List window, probation, protectedList;
+    std::size_t windowBytes = 0, probationBytes = 0, protectedBytes = 0;
+    const std::size_t budget, windowBudget, protectedBudget;
+    FrequencySketch sketch;
+
+    List& segmentList(Segment segment) {
+        return segment == Segment::Window ? window : (segment == Segment::Probation ? probation : protectedList);
+    }
+
+    std::size_t& segmentBytes(Segment segment) {
+        return segment == Segment::Window ? windowBytes : (segment == Segment::Probation ? probationBytes : protectedBytes);
+    }
+
+    // Move a node to the front of a segment; list iterators stay valid across splice.
+    void moveTo(List::iterator node, Segment segment) {
+        segmentBytes(node->segment) -= node->charge;
+        segmentList(segment).splice(segmentList(segment).begin(), segmentList(node->segment), node);
+        node->segment = segment;
+        segmentBytes(segment) += node->charge;
+    }
+
+    void remove(List::iterator node) {
+        index.erase(node->key);
+        segmentBytes(node->segment) -= node->charge;
+        segmentList(node->segment).erase(node);
+    }
+
+    // Record a hit: promote probation entries, refresh recency elsewhere.
+    void touch(List::iterator node) {
+        if (node->segment == Segment::Probation) {
+            moveTo(node, Segment::Protected);
+            // Demote the least recently used protected entries back to probation
+            while (protectedBytes > protectedBudget && protectedList.size() > 1) {
+                moveTo(std::prev(protectedList.end()), Segment::Probation);
+            }
+        } else {
+            moveTo(node, node->segment);
+        }
+    }
+
+    // Move entries out of the window and let them compete for the main segment.
+    void enforceBudget() {
+        while (windowBytes > windowBudget && !window.empty()) {
+            auto candidate = std::prev(window.end());
+            moveTo(candidate, Segment::Probation);
+            admit(candidate);
+        }
+        // Replacing a value with a larger one can still leave the shard over budget
+        while (windowBytes + probationBytes + protectedBytes > budget) {
+            List& victims = !probation.empty() ? probation : (!protectedList.empty() ? protectedList : window);
+            remove(std::prev(victims.end()));
+        }
+    }
+
+    // Evict until the main segment fits, choosing between the candidate and the probation victim by frequency.
+    void admit(List::iterator candidate) {
+        std::size_t mainBudget = budget - std::min(budget, windowBudget);
+        while (probationBytes + protectedBytes > mainBudget) {
+            if (probation.size() <= 1 && !protectedList.empty()) {
+                moveTo(std::prev(protectedList.end()), Segment::Probation);
+                // Keep the candidate at the front so it is not its own victim
+                moveTo(candidate, Segment::Probation);
+                continue;
+            }
+            auto victim = std::prev(probation.end());
+            if (victim == candidate) {
+                remove(candidate);
+                return;
+            }
+            if (sketch.frequency(candidate->hash) > sketch.frequency(victim->hash)) {
+                remove(victim);
+            } else {
+                remove(candidate);
+                return;
+            }
+        }
+    }
+};
+
+/**
+ * @brief Construct a new MetadataCache object.
+ *
+ * The budget is divided evenly among the shards.
+ *
+ * @param budgetBytes The byte budget of the whole cache.
+ * @param shardCount The number of shards.
+ */
+MetadataCache::MetadataCache(std::size_t budgetBytes, std::size_t shardCount) {
+    shardCount = nextPowerOfTwo(std::max<std::size_t>(shardCount, 1));
+    shards.reserve(shardCount);
+    for (std::size_t i = 0; i < shardCount; i++) {
+        shards.push_back(std::make_unique<Shard>(budgetBytes / shardCount));
+    }
+}
+
+MetadataCache::~MetadataCache() = default;
+
+MetadataCache::Shard& MetadataCache::shardFor(std::uint64_t hash) {
+    // The high bits pick the shard; the sketch uses the whole hash
+    return *shards[(hash >> 40) & (shards.size() - 1)];
+}
+
+bool MetadataCache::get(const std::string& key, std::string& value) {
+    auto hash = hashKey(key);
+    return shardFor(hash).get(key, hash, value);
+}
+
+void MetadataCache::put(const std::string& key, std::string value) {
+    auto hash = hashKey(key);
+    shardFor(hash).put(key, hash, std::move(value));
+}
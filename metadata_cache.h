@@ -0,0 +1,75 @@
+#pragma once
+#ifndef METADATA_CACHE_H
+#define METADATA_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief A bounded, thread-safe cache for resolved metadata responses.
+ *
+ * MetadataCache keeps the response bodies of "/isbn" and "/title" requests in
+ * memory under a fixed byte budget. Admission and eviction follow W-TinyLFU:
+ * new entries enter a small LRU window, and an entry leaving the window only
+ * replaces the least recently used entry of the main segmented LRU if it has
+ * been requested more often, as estimated by a count-min sketch that is halved
+ * periodically so that old popularity fades. This keeps the hit ratio close to
+ * optimal for the skewed (Zipf-like) popularity of books and webpages while
+ * one-off lookups cannot flush popular entries.
+ *
+ * The key space is split across independently locked shards, so concurrent
+ * lookups of different keys rarely contend.
+ */
+class MetadataCache {
+public:
+    /**
+     * @brief Construct a new MetadataCache object.
+     *
+     * @param budgetBytes The maximum number of bytes charged to entries, including
+     *                    a fixed per-entry overhead.
+     * @param shardCount The number of independently locked shards, rounded up to a power of two.
+     */
+    explicit MetadataCache(std::size_t budgetBytes, std::size_t shardCount = 16);
+
+    ~MetadataCache();
+
+    MetadataCache(const MetadataCache&) = delete;
+    MetadataCache& operator=(const MetadataCache&) = delete;
+
+    /**
+     * @brief Look up a key and record the access for admission.
+     *
+     * @param key The cache key.
+     * @param value Receives a copy of the cached value on a hit.
+     * @return true on a hit, false on a miss.
+     */
+    bool get(const std::string& key, std::string& value);
+
+    /**
+     * @brief Insert or replace the value of a key.
+     *
+     * The entry may be rejected immediately by the admission policy, or evicted
+     * later, if it is larger than a shard or less popular than the entries it
+     * would displace.
+     *
+     * @param key The cache key.
+     * @param value The value to store.
+     */
+    void put(const std::string& key, std::string value);
+
+private:
+    class Shard;
+
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    Shard& shardFor(std::uint64_t hash);
+};
+
+#endif
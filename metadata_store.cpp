@@ -0,0 +1,617 @@
+#include "metadata_store.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+#include "bloom_filter.h"
+#include "metadata.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr std::uint32_t kRecordMagic = 0x4352444d;  // "MDRC" in little-endian order
+constexpr std::uint32_t kNegative = 1;
+
+/**
+ * @brief The header of a record, followed by its key and its value.
+ */
+struct RecordHeader {
+    std::uint32_t magic;
+    std::uint32_t checksum;  //!< The CRC-32 of the rest of the header, the key and the value.
+    std::uint64_t stored;    //!< Seconds since the epoch.
+    std::uint64_t expires;   //!< Seconds since the epoch.
+    std::uint32_t keyLength;
+    std::uint32_t valueLength;
+    std::uint32_t flags;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(RecordHeader) == 40, "headers are written as they are laid out");
+
+/**
+ * @brief A record read from a segment; the key and the value are views into it.
+ */
+struct Record {
+    std::uint64_t stored;
+    std::uint64_t expires;
+    bool negative;
+    std::string_view key;
+    std::string_view value;
+    std::size_t size;  //!< The size of the whole record in the segment.
+};
+
+enum class ReadResult { Ok, Truncated, Corrupt };
+
+/**
+ * @brief A segment file of a store, and whether it has an index.
+ */
+struct SegmentFile {
+    std::uint32_t number;
+    std::string path;
+    bool indexed;
+};
+
+std::uint32_t crc32(std::uint32_t crc, std::string_view data) {
+    static const auto table = [] {
+        std::array<std::uint32_t, 256> table{};
+        for (std::uint32_t i = 0; i < 256; i++) {
+            auto c = i;
+            for (int bit = 0; bit < 8; bit++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return table;
+    }();
+    crc = ~crc;
+    for (unsigned char byte : data) crc = table[(crc ^ byte) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+std::uint64_t now() {
+    auto elapsed = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(elapsed).count());
+}
+
+std::string encodeRecord(std::string_view key, std::string_view value, std::uint64_t stored, std::uint64_t expires,
+                         bool negative) {
+    RecordHeader header{kRecordMagic, 0, stored, expires, static_cast<std::uint32_t>(key.size()),
+                        static_cast<std::uint32_t>(value.size()), negative ? kNegative : 0, 0};
+    std::string record(sizeof(header), '\0');
+    record.append(key);
+    record.append(value);
+    std::memcpy(&record[0], &header, sizeof(header));
+    header.checksum = crc32(0, std::string_view{record}.substr(offsetof(RecordHeader, stored)));
+    std::memcpy(&record[offsetof(RecordHeader, checksum)], &header.checksum, sizeof(header.checksum));
+    return record;
+}
+
+/**
+ * @brief Read the record at an offset of a segment, checking its checksum.
+ */
+ReadResult readRecord(std::string_view segment, std::uint64_t offset, Record& record) {
+    RecordHeader header;
+    if (offset > segment.size() || segment.size() - offset < sizeof(header)) return ReadResult::Truncated;
+    std::memcpy(&header, segment.data() + offset, sizeof(header));
+    if (header.magic != kRecordMagic) return ReadResult::Corrupt;
+    auto size = sizeof(header) + std::uint64_t{header.keyLength} + header.valueLength;
+    if (segment.size() - offset < size) return ReadResult::Truncated;
+    auto bytes = segment.substr(static_cast<std::size_t>(offset), static_cast<std::size_t>(size));
+    if (crc32(0, bytes.substr(offsetof(RecordHeader, stored))) != header.checksum) return ReadResult::Corrupt;
+    record.stored = header.stored;
+    record.expires = header.expires;
+    record.negative = (header.flags & kNegative) != 0;
+    record.key = bytes.substr(sizeof(header), header.keyLength);
+    record.value = bytes.substr(sizeof(header) + header.keyLength);
+    record.size = static_cast<std::size_t>(size);
+    return ReadResult::Ok;
+}
+
+std::string segmentPath(const std::string& directory, std::uint32_t number, const char* extension) {
+    char name[16];
+    std::snprintf(name, sizeof(name), "%08u", static_cast<unsigned>(number));
+    return directory + "/" + name + extension;
+}
+
+/**
+ * @brief List the segments of a store, named by their 8-digit number, in order.
+ */
+std::vector<SegmentFile> listSegments(const std::string& directory) {
+    std::vector<SegmentFile> found;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator{directory, error}) {
+        auto name = entry.path().filename().string();
+        std::uint32_t number = 0;
+        if (name.size() != 12 || name.compare(8, 4, ".seg") != 0) continue;
+        auto parsed = std::from_chars(name.data(), name.data() + 8, number);
+        if (parsed.ec != std::errc{} || parsed.ptr != name.data() + 8) continue;
+        found.push_back({number, entry.path().string(),
+                         std::filesystem::exists(segmentPath(directory, number, ".idx"), error)});
+    }
+    std::sort(found.begin(), found.end(),
+              [](const SegmentFile& a, const SegmentFile& b) { return a.number < b.number; });
+    return found;
+}
+
+/**
+ * @brief Test whether a process is writing a segment, i.e. holds its lock.
+ */
+bool isActive(const std::string& path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool active = ::flock(fd, LOCK_EX | LOCK_NB) != 0;
+    ::close(fd);
+    return active;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+/**
+ * @brief Locks on the segments a collection compacts, so that no process starts appending to them.
+ *
+ * The locks are released when the object is destroyed, after the segments are deleted.
+ */
+class SegmentLocks {
+public:
+    SegmentLocks() = default;
+    SegmentLocks(const SegmentLocks&) = delete;
+    SegmentLocks& operator=(const SegmentLocks&) = delete;
+
+    ~SegmentLocks() {
+#ifndef _WIN32
+        for (int fd : fds) ::close(fd);
+#endif
+    }
+
+    /**
+     * @brief Lock a segment unless a process is writing it.
+     *
+     * @return true if the segment is locked, false if a process holds its lock.
+     */
+    bool acquire(const std::string& path) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return true;
+        if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            ::close(fd);
+            return false;
+        }
+        fds.push_back(fd);
+#else
+        (void)path;
+#endif
+        return true;
+    }
+
+private:
+    std::vector<int> fds;
+};
+
+/**
+ * @brief Give a complete segment and its index a number, the index first, so that the segment is indexed once visible.
+ *
+ * Only a collection, which holds the gc.lock, creates indexes; a process
+ * creating its own segment gives the number up if it finds an index there.
+ *
+ * @param segment The temporary path of the segment.
+ * @param index The temporary path of its index.
+ * @param directory The directory of the store.
+ * @param number The number to give them.
+ * @return false if the number is taken.
+ */
+bool linkSegment(const std::string& segment, const std::string& index, const std::string& directory,
+                 std::uint32_t number) {
+    auto path = segmentPath(directory, number, ".seg");
+    auto indexPath = segmentPath(directory, number, ".idx");
+    std::error_code error;
+    if (std::filesystem::exists(path, error)) return false;
+#ifndef _WIN32
+    if (::link(index.c_str(), indexPath.c_str()) != 0) return false;
+    if (::link(segment.c_str(), path.c_str()) != 0) {
+        ::unlink(indexPath.c_str());
+        return false;
+    }
+    ::unlink(index.c_str());
+    ::unlink(segment.c_str());
+#else
+    // rename() does not replace an existing file here
+    if (std::rename(index.c_str(), indexPath.c_str()) != 0) return false;
+    if (std::rename(segment.c_str(), path.c_str()) != 0) {
+        std::rename(indexPath.c_str(), index.c_str());
+        return false;
+    }
+#endif
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Open the store in a directory, mapping its segments.
+ *
+ * The segments with an index are searched through it. The others are
+ * scanned, keeping the location of the newest record of each key hash; the
+ * tail of a segment that cannot be read, a write in progress or damage, is
+ * ignored.
+ *
+ * @param directory The directory, or "" for a store that finds and keeps nothing.
+ */
+MetadataStore::MetadataStore(std::string directory) : directory{std::move(directory)} {
+    if (this->directory.empty()) {
+        outputFailed = true;
+        return;
+    }
+    for (const auto& file : listSegments(this->directory)) {
+        auto& segment = segments.emplace_back();
+        segment.number = file.number;
+        // A segment deleted by a collection since it was listed is simply left out
+        if (!segment.file.open(file.path)) {
+            segments.pop_back();
+            continue;
+        }
+        segment.indexed = file.indexed && segment.index.open(segmentPath(this->directory, file.number, ".idx"));
+        if (segment.indexed) continue;
+
+        auto data = segment.file.view();
+        Record record;
+        for (std::uint64_t offset = 0; readRecord(data, offset, record) == ReadResult::Ok; offset += record.size) {
+            Location location{segments.size() - 1, offset, record.stored};
+            auto [found, inserted] = recent.try_emplace(BloomFilter::hash(record.key), location);
+            if (!inserted && record.stored >= found->second.stored) found->second = location;
+        }
+    }
+}
+
+MetadataStore::~MetadataStore() {
+    if (output) std::fclose(output);
+}
+
+/**
+ * @brief Look up the newest live record of a key.
+ *
+ * @param key The key.
+ * @param value Receives the response body if it is found.
+ * @return Whether the key was found, is known to have no metadata, or is missing.
+ */
+MetadataStore::Lookup MetadataStore::find(const std::string& key, std::string& value) const {
+    auto hash = BloomFilter::hash(key);
+    Record newest{};
+    std::size_t newestSegment = 0;
+    bool found = false;
+    // Of two records stored in the same second, the one of the later segment wins, as in collect()
+    auto consider = [&](std::size_t segment, std::uint64_t offset) {
+        Record record;
+        if (readRecord(segments[segment].file.view(), offset, record) != ReadResult::Ok || record.key != key) return;
+        if (found && std::make_pair(record.stored, segment) < std::make_pair(newest.stored, newestSegment)) return;
+        newest = record;
+        newestSegment = segment;
+        found = true;
+    };
+
+    auto location = recent.find(hash);
+    if (location != recent.end()) consider(location->second.segment, location->second.offset);
+    for (std::size_t i = 0; i < segments.size(); i++) {
+        std::string_view entry;
+        std::uint64_t offset = 0;
+        if (!segments[i].indexed || !segments[i].index.find(hash, entry) || entry.size() != sizeof(offset)) continue;
+        std::memcpy(&offset, entry.data(), sizeof(offset));
+        consider(i, offset);
+    }
+
+    if (!found || newest.expires <= now()) return Lookup::Missing;
+    if (newest.negative) return Lookup::NotFound;
+    value.assign(newest.value);
+    return Lookup::Found;
+}
+
+/**
+ * @brief Append a record to the segment of this process.
+ *
+ * Each record is written and flushed at once, so a crash leaves at most a
+ * truncated last record, which readers ignore.
+ *
+ * @param key The key.
+ * @param value The response body.
+ * @param negative Whether the endpoint had no metadata for the key.
+ */
+void MetadataStore::put(const std::string& key, std::string_view value, bool negative) {
+    auto stored = now();
+    auto record = encodeRecord(key, negative ? std::string_view{} : value, stored,
+                               stored + (negative ? kNegativeTtl : kResponseTtl), negative);
+    std::lock_guard<std::mutex> lock{outputMutex};
+    if (!output && (outputFailed || !openOutput())) return;
+    if (std::fwrite(record.data(), 1, record.size(), output) != record.size() || std::fflush(output) != 0) {
+        std::fclose(output);
+        output = nullptr;
+        outputFailed = true;
+    }
+}
+
+/**
+ * @brief Open a segment for this process to append to.
+ *
+ * The newest segment is reused if it has no index, no process is writing it,
+ * and it ends with a complete record. Otherwise a segment numbered after the
+ * newest one is created under a temporary name and locked before it is linked
+ * to its number, so that a collection never takes it for a finished segment;
+ * the link fails if another process took the number first.
+ *
+ * @return true if a segment was opened, false otherwise; writes are then skipped.
+ */
+bool MetadataStore::openOutput() {
+    outputFailed = true;
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) return false;
+    auto files = listSegments(directory);
+    std::uint32_t number = files.empty() ? 0 : files.back().number;
+
+#ifndef _WIN32
+    if (!files.empty() && !files.back().indexed && reuse(files.back().path)) return true;
+
+    auto temporary = directory + "/new." + std::to_string(::getpid()) + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) return false;
+    ::flock(fd, LOCK_EX);
+    bool linked = false;
+    for (int attempt = 0; attempt < 64 && !linked; attempt++) {
+        auto path = segmentPath(directory, ++number, ".seg");
+        linked = ::link(temporary.c_str(), path.c_str()) == 0;
+        // A collection is linking its segment under this number, index first
+        if (linked && std::filesystem::exists(segmentPath(directory, number, ".idx"), error)) {
+            ::unlink(path.c_str());
+            linked = false;
+        }
+    }
+    ::unlink(temporary.c_str());
+    if (!linked || !(output = ::fdopen(fd, "ab"))) {
+        ::close(fd);
+        return false;
+    }
+#else
+    for (int attempt = 0; attempt < 64 && !output; attempt++) {
+        output = std::fopen(segmentPath(directory, ++number, ".seg").c_str(), "wbx");
+    }
+    if (!output) return false;
+#endif
+    outputFailed = false;
+    return true;
+}
+
+#ifndef _WIN32
+/**
+ * @brief Lock a finished segment and append to it.
+ *
+ * A collection holds the locks of the segments it compacts until it has
+ * deleted them, so once the lock is taken, the path must still name the file
+ * that was opened.
+ *
+ * @param path The path to the segment.
+ * @return true if the segment is open for appending, false otherwise.
+ */
+bool MetadataStore::reuse(const std::string& path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) return false;
+    struct stat opened, named;
+    bool usable = ::flock(fd, LOCK_EX | LOCK_NB) == 0 && ::fstat(fd, &opened) == 0 &&
+                  ::stat(path.c_str(), &named) == 0 && opened.st_dev == named.st_dev && opened.st_ino == named.st_ino;
+    // Records appended after a truncated one would never be read
+    MappedFile segment;
+    if (usable && segment.open(path)) {
+        auto data = segment.view();
+        Record record;
+        std::uint64_t offset = 0;
+        while (readRecord(data, offset, record) == ReadResult::Ok) offset += record.size;
+        usable = offset == data.size();
+    }
+    if (!usable || !(output = ::fdopen(fd, "ab"))) {
+        ::close(fd);
+        return false;
+    }
+    outputFailed = false;
+    return true;
+}
+#endif
+
+/**
+ * @brief Compact the segments of a store into one new indexed segment.
+ *
+ * The segments that no process is writing are locked and read, and the newest
+ * record of each key is kept unless it has expired; a negative record is kept
+ * until it expires too, so the key is not requested again early. The records kept are
+ * written in key order to a temporary file and indexed by RecordTable::write();
+ * once both are complete, they are linked under a number after every existing
+ * segment, so a store opened meanwhile never maps a partial or unindexed
+ * segment. The old segments are deleted last; until then a reader finds the
+ * same records in both, and the locks keep any process from appending to them.
+ *
+ * @param directory The directory of the store.
+ * @return The counters of the collection.
+ */
+MetadataStore::CollectStats MetadataStore::collect(const std::string& directory) {
+    CollectStats stats;
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+#ifndef _WIN32
+    // One collection at a time; the lock is released when the descriptor is closed
+    int lockFd = ::open((directory + "/gc.lock").c_str(), O_WRONLY | O_CREAT, 0644);
+    if (lockFd < 0 || ::flock(lockFd, LOCK_EX | LOCK_NB) != 0) {
+        if (lockFd >= 0) ::close(lockFd);
+        throw std::runtime_error("another collection is running in " + directory);
+    }
+    struct Unlock {
+        int fd;
+        ~Unlock() {
+            ::close(fd);
+        }
+    } unlock{lockFd};
+#endif
+
+    std::vector<SegmentFile> sealed;
+    std::deque<MappedFile> mapped;
+    SegmentLocks locks;
+    std::uint32_t last = 0;
+    for (const auto& file : listSegments(directory)) {
+        last = std::max(last, file.number);
+        if (!locks.acquire(file.path)) {
+            stats.active++;
+            continue;
+        }
+        if (!mapped.emplace_back().open(file.path)) {
+            mapped.pop_back();
+            continue;
+        }
+        sealed.push_back(file);
+        stats.bytesBefore += mapped.back().size();
+        if (file.indexed) {
+            auto size = std::filesystem::file_size(segmentPath(directory, file.number, ".idx"), error);
+            if (!error) stats.bytesBefore += size;
+        }
+    }
+    stats.segments = sealed.size();
+
+    // The newest record of each key; of two stored in the same second, the one of the later segment
+    std::unordered_map<std::string_view, Record> newest;
+    for (const auto& file : mapped) {
+        auto data = file.view();
+        Record record;
+        std::uint64_t offset = 0;
+        for (; readRecord(data, offset, record) == ReadResult::Ok; offset += record.size) {
+            stats.records++;
+            auto [found, inserted] = newest.try_emplace(record.key, record);
+            if (!inserted && record.stored >= found->second.stored) found->second = record;
+        }
+        if (offset < data.size()) stats.corrupt++;
+    }
+    auto time = now();
+    std::vector<const Record*> live;
+    for (const auto& [key, record] : newest) {
+        if (record.expires <= time) {
+            stats.expired++;
+            continue;
+        }
+        if (record.negative) stats.negative++;
+        live.push_back(&record);
+    }
+    std::sort(live.begin(), live.end(), [](const Record* a, const Record* b) { return a->key < b->key; });
+
+    // The collections are serialized by the gc.lock, so the temporary names are free
+    auto temporary = directory + "/gc.tmp";
+    auto temporaryIndex = directory + "/gc.tmp.idx";
+    std::FILE* output = std::fopen(temporary.c_str(), "wb");
+    if (!output) throw std::runtime_error("cannot create a segment in " + directory);
+    std::vector<std::uint64_t> offsets(live.size());
+    std::vector<RecordTable::Row> rows;
+    std::uint64_t offset = 0;
+    bool written = true;
+    for (std::size_t i = 0; i < live.size(); i++) {
+        const auto& record = *live[i];
+        auto bytes = encodeRecord(record.key, record.value, record.stored, record.expires, record.negative);
+        written = written && std::fwrite(bytes.data(), 1, bytes.size(), output) == bytes.size();
+        offsets[i] = offset;
+        offset += bytes.size();
+        rows.push_back({BloomFilter::hash(record.key), {reinterpret_cast<const char*>(&offsets[i]), sizeof(offsets[i])}});
+    }
+    written = std::fflush(output) == 0 && written;
+    std::fclose(output);
+    try {
+        if (!written) throw std::runtime_error("cannot write " + temporary);
+        RecordTable::write({std::move(rows)}, temporaryIndex);
+    }
+    catch (...) {
+        std::remove(temporary.c_str());
+        std::remove(temporaryIndex.c_str());
+        throw;
+    }
+    stats.kept = live.size();
+    stats.bytesAfter = offset;
+    auto size = std::filesystem::file_size(temporaryIndex, error);
+    if (!error) stats.bytesAfter += size;
+
+    auto number = last;
+    bool linked = false;
+    for (int attempt = 0; attempt < 64 && !linked; attempt++) linked = linkSegment(temporary, temporaryIndex, directory, ++number);
+    if (!linked) {
+        std::remove(temporary.c_str());
+        std::remove(temporaryIndex.c_str());
+        throw std::runtime_error("cannot create a segment in " + directory);
+    }
+
+    // Readers that have mapped the old segments keep them until they close
+    for (const auto& file : sealed) {
+        if (file.indexed) std::remove(segmentPath(directory, file.number, ".idx").c_str());
+        std::remove(file.path.c_str());
+    }
+    return stats;
+}
+
+/**
+ * @brief Check the framing and checksum of every record and every index entry of a store.
+ *
+ * The records of each segment are read in order up to the first one that is
+ * truncated or whose checksum does not match. Each entry of an index must
+ * point to a valid record whose key has the hash of the entry.
+ *
+ * @param directory The directory of the store.
+ * @param problems A vector to append the problems to.
+ * @return The number of valid records.
+ */
+std::size_t MetadataStore::verify(const std::string& directory, std::vector<Problem>& problems) {
+    std::size_t records = 0;
+    for (const auto& file : listSegments(directory)) {
+        MappedFile segment;
+        if (!segment.open(file.path)) {
+            problems.push_back({file.path, 0, "cannot be read"});
+            continue;
+        }
+        auto data = segment.view();
+        Record record;
+        std::uint64_t offset = 0;
+        auto result = ReadResult::Ok;
+        for (; (result = readRecord(data, offset, record)) == ReadResult::Ok; offset += record.size) records++;
+        if (offset < data.size() && !(result == ReadResult::Truncated && isActive(file.path))) {
+            problems.push_back({file.path, offset, result == ReadResult::Truncated ? "truncated record" : "corrupt record"});
+        }
+
+        if (!file.indexed) continue;
+        auto indexPath = segmentPath(directory, file.number, ".idx");
+        RecordTable index;
+        if (!index.open(indexPath)) {
+            problems.push_back({indexPath, 0, "not an index"});
+            continue;
+        }
+        auto rows = index.rows();
+        for (std::size_t i = 0; i < rows.size(); i++) {
+            std::uint64_t at = 0;
+            if (rows[i].record.size() == sizeof(at)) std::memcpy(&at, rows[i].record.data(), sizeof(at));
+            if (rows[i].record.size() != sizeof(at) || readRecord(data, at, record) != ReadResult::Ok ||
+                BloomFilter::hash(record.key) != rows[i].key) {
+                problems.push_back({indexPath, i, "entry points to no record of its key"});
+            }
+        }
+    }
+    return records;
+}
+
+MetadataStore& metadataStore() {
+    // Never destroyed: workers may still store responses while the process exits
+    static auto* store = [] {
+        const char* enabled = std::getenv("DOCMAN_STORE_RESPONSES");
+        bool persistent = enabled && *enabled && std::strcmp(enabled, "0") != 0;
+        return new MetadataStore{persistent ? metadataStoreDirectory() + "/responses" : std::string{}};
+    }();
+    return *store;
+}
@@ -0,0 +1,185 @@
+#pragma once
+#ifndef METADATA_STORE_H
+#define METADATA_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+#include "record_table.h"
+
+/**
+ * @brief MetadataStore keeps the responses of metadata requests on disk, across runs.
+ *
+ * The store is a directory of append-only segments. Each record holds a key,
+ * i.e. a request path, its response body, the time it was stored, the time it
+ * expires and a CRC-32 of all of it. A negative record remembers that the
+ * endpoint had no metadata for the key. On its first write, a process takes
+ * the lock of the newest segment and appends to it, unless that segment is
+ * indexed or another process is writing it; then it creates a segment of its
+ * own. A lookup takes the newest record of a key; of two stored in the same
+ * second, the one in the later segment wins.
+ *
+ * Segments keep expired and superseded records, so collect() compacts the
+ * live records of the segments no process is writing into one new segment,
+ * with a RecordTable index from the hash of each key to its record, and
+ * deletes the old segments. The new segment and its index are
+ * written under temporary names and linked in only once both are complete. It
+ * only creates, links and deletes files, so readers are never blocked, and a
+ * reader that has mapped an old segment keeps reading it. verify() checks
+ * every record and index entry.
+ *
+ * Segments without an index are scanned when the store is opened. Of two
+ * keys with the same hash, only one is found; the other is requested again.
+ */
+class MetadataStore {
+public:
+    /**
+     * @brief How long a response is kept, in seconds: 30 days.
+     */
+    static constexpr std::uint64_t kResponseTtl = 30 * 24 * 3600;
+
+    /**
+     * @brief How long a negative record is kept, in seconds: 1 day.
+     */
+    static constexpr std::uint64_t kNegativeTtl = 24 * 3600;
+
+    /**
+     * @brief The outcome of a lookup.
+     */
+    enum class Lookup {
+        Missing,   //!< No live record; the key has to be requested.
+        Found,     //!< A live response.
+        NotFound   //!< A live negative record: the endpoint has no metadata for the key.
+    };
+
+    /**
+     * @brief Counters of a collection.
+     */
+    struct CollectStats {
+        std::size_t segments = 0;    //!< The segments compacted.
+        std::size_t active = 0;      //!< The segments skipped because a process is writing them.
+        std::size_t records = 0;     //!< The valid records read.
+        std::size_t kept = 0;        //!< The records written to the new segment.
+        std::size_t expired = 0;     //!< The newest records of their keys that had expired.
+        std::size_t negative = 0;    //!< The records kept that are negative.
+        std::size_t corrupt = 0;     //!< The segments whose tail could not be read.
+        std::uint64_t bytesBefore = 0;
+        std::uint64_t bytesAfter = 0;
+    };
+
+    /**
+     * @brief A problem found by verify().
+     */
+    struct Problem {
+        std::string file;      //!< The path to the segment or index.
+        std::uint64_t offset;  //!< The offset of the record in the segment, or the number of the entry in the index.
+        std::string message;
+    };
+
+    /**
+     * @brief Open the store in a directory, mapping its segments.
+     *
+     * @param directory The directory, created on the first write; "" for a store that finds and keeps nothing.
+     */
+    explicit MetadataStore(std::string directory);
+
+    ~MetadataStore();
+
+    MetadataStore(const MetadataStore&) = delete;
+    MetadataStore& operator=(const MetadataStore&) = delete;
+
+    /**
+     * @brief Look up the newest live record of a key.
+     *
+     * Only the segments present when the store was opened, and not the writes
+     * of this process, are searched; the metadataCache() holds those.
+     *
+     * @param key The key.
+     * @param value Receives the response body if it is found.
+     * @return Whether the key was found, is known to have no metadata, or is missing.
+     */
+    Lookup find(const std::string& key, std::string& value) const;
+
+    /**
+     * @brief Append a record to the segment of this process.
+     *
+     * Failures to write, e.g. to a read-only directory, are ignored: the
+     * store is only a cache.
+     *
+     * @param key The key.
+     * @param value The response body; ignored for a negative record.
+     * @param negative Whether the endpoint had no metadata for the key.
+     */
+    void put(const std::string& key, std::string_view value, bool negative = false);
+
+    /**
+     * @brief Compact the segments of a store into one new indexed segment.
+     *
+     * @param directory The directory of the store.
+     * @return The counters of the collection.
+     *
+     * @throws std::runtime_error if another collection is running or the new segment cannot be written.
+     */
+    static CollectStats collect(const std::string& directory);
+
+    /**
+     * @brief Check the framing and checksum of every record and every index entry of a store.
+     *
+     * A truncated record at the end of a segment that a process is writing is
+     * a write in progress, not a problem.
+     *
+     * @param directory The directory of the store.
+     * @param problems A vector to append the problems to.
+     * @return The number of valid records.
+     */
+    static std::size_t verify(const std::string& directory, std::vector<Problem>& problems);
+
+private:
+    struct Segment {
+        std::uint32_t number;
+        MappedFile file;
+        RecordTable index;
+        bool indexed = false;
+    };
+
+    /**
+     * @brief The newest record of a key hash in the segments without an index.
+     */
+    struct Location {
+        std::size_t segment;
+        std::uint64_t offset;
+        std::uint64_t stored;
+    };
+
+    std::string directory;
+    std::deque<Segment> segments;
+    std::unordered_map<std::uint64_t, Location> recent;
+
+    std::mutex outputMutex;
+    std::FILE* output = nullptr;
+    bool outputFailed = false;
+
+    bool openOutput();
+    bool reuse(const std::string& path);
+};
+
+/**
+ * @brief Get the process-wide store of responses.
+ *
+ * Responses are only kept across runs if $DOCMAN_STORE_RESPONSES is set and not
+ * "0"; the store is then in the "responses" directory of metadataStoreDirectory().
+ * Otherwise the store finds and keeps nothing.
+ *
+ * @return A reference to the shared MetadataStore, opened on first use.
+ */
+MetadataStore& metadataStore();
+
+#endif
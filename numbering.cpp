@@ -0,0 +1,77 @@
+#include "numbering.h"
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+std::size_t decimalDigits(std::size_t n) {
+    std::size_t digits = 1;
+    for (; n >= 10; n /= 10) digits++;
+    return digits;
+}
+
+} // namespace
+
+/**
+ * @brief Number the keys of the occurrences found by a CitationScanner.
+ *
+ * @param occurrences The occurrences, in text order.
+ */
+CitationNumbering::CitationNumbering(const std::vector<CitationOccurrence>& occurrences) {
+    for (const auto& occurrence : occurrences) {
+        if (numbers.emplace(occurrence.key, keys.size() + 1).second) keys.push_back(occurrence.key);
+    }
+}
+
+std::size_t CitationNumbering::numberOf(std::string_view key) const {
+    auto found = numbers.find(key);
+    return found == numbers.end() ? 0 : found->second;
+}
+
+/**
+ * @brief Rewrite a text, replacing each reference with the numbers of its keys.
+ *
+ * Occurrences sharing a byte range are the keys of one reference, such as
+ * "\cite{a,b}", and are written as one bracketed list.
+ *
+ * @param text The text that was scanned.
+ * @param occurrences The occurrences found in the text, in text order.
+ * @return The rewritten text.
+ */
+std::string CitationNumbering::rewrite(std::string_view text, const std::vector<CitationOccurrence>& occurrences) const {
+    // First pass: the exact size of the result
+    std::size_t size = text.size();
+    for (std::size_t i = 0; i < occurrences.size(); i++) {
+        bool first = i == 0 || occurrences[i - 1].begin != occurrences[i].begin;
+        bool last = i + 1 == occurrences.size() || occurrences[i + 1].begin != occurrences[i].begin;
+        if (first) size = size - (occurrences[i].end - occurrences[i].begin) + 1;  // "["
+        size += decimalDigits(numberOf(occurrences[i].key));
+        size += last ? 1 : 2;                                                      // "]" or ", "
+    }
+
+    // Second pass: copy the text between references and write the numbers in place
+    std::string result(size, '\0');
+    char* out = &result[0];
+    std::size_t copied = 0;
+    for (std::size_t i = 0; i < occurrences.size(); i++) {
+        const auto& occurrence = occurrences[i];
+        bool first = i == 0 || occurrences[i - 1].begin != occurrence.begin;
+        bool last = i + 1 == occurrences.size() || occurrences[i + 1].begin != occurrence.begin;
+        if (first) {
+            std::memcpy(out, text.data() + copied, occurrence.begin - copied);
+            out += occurrence.begin - copied;
+            *out++ = '[';
+        }
+        out = std::to_chars(out, &result[0] + size, numberOf(occurrence.key)).ptr;
+        if (last) {
+            *out++ = ']';
+            copied = occurrence.end;
+        }
+        else {
+            *out++ = ',';
+            *out++ = ' ';
+        }
+    }
+    std::memcpy(out, text.data() + copied, text.size() - copied);
+    return result;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#ifndef NUMBERING_H
+#define NUMBERING_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "scanner.h"
+
+/**
+ * @brief CitationNumbering numbers cited keys in order of first appearance, IEEE style.
+ *
+ * The first key cited in the text is [1], the next new key is [2], and so on.
+ * The numbering can rewrite the text, replacing every reference with the
+ * numbers of its keys.
+ */
+class CitationNumbering {
+public:
+    /**
+     * @brief Number the keys of the occurrences found by a CitationScanner.
+     *
+     * @param occurrences The occurrences, in text order.
+     */
+    explicit CitationNumbering(const std::vector<CitationOccurrence>& occurrences);
+
+    /**
+     * @brief Get the number of a key.
+     *
+     * @param key The key.
+     * @return The 1-based number of the key, or 0 if it is not cited.
+     */
+    std::size_t numberOf(std::string_view key) const;
+
+    /**
+     * @brief Get the cited keys in number order; the key numbered n is at n - 1.
+     */
+    const std::vector<std::string_view>& getKeys() const {
+        return keys;
+    }
+
+    /**
+     * @brief Rewrite a text, replacing each reference with the numbers of its keys.
+     *
+     * "[id]" and "@id" become "[n]", and "\cite{a,b}" becomes "[n, m]". The size
+     * of the result is computed from the occurrences first, so the text is
+     * built in a single allocation and a single pass.
+     *
+     * @param text The text that was scanned.
+     * @param occurrences The occurrences found in the text, in text order.
+     * @return The rewritten text.
+     */
+    std::string rewrite(std::string_view text, const std::vector<CitationOccurrence>& occurrences) const;
+
+private:
+    std::vector<std::string_view> keys;                     //!< The keys in number order, viewing the scanned text.
+    std::unordered_map<std::string_view, std::size_t> numbers;  //!< Maps a key to its number.
+};
+
+#endif
@@ -0,0 +1,476 @@
+#include "prefix_index.h"
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <tuple>
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'M', 'P', 'R', 'E', 'F', 'X', '1'};
+
+void putVarint(std::string& out, std::size_t n) {
+    while (n >= 0x80) {
+        out.push_back(static_cast<char>((n & 0x7f) | 0x80));
+        n >>= 7;
+    }
+    out.push_back(static_cast<char>(n));
+}
+
+// Trusts the data: the dictionary is built or validated by deserialize() before it is read.
+std::size_t getVarint(const char*& p) {
+    std::size_t n = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        auto byte = static_cast<unsigned char>(*p++);
+        n |= static_cast<std::size_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) return n;
+    }
+}
+
+// Reads a varint without going past the end; false if it is cut short or too long.
+bool getVarint(const char*& p, const char* end, std::size_t& n) {
+    n = 0;
+    for (unsigned shift = 0; p < end && shift < sizeof(std::size_t) * 8; shift += 7) {
+        auto byte = static_cast<unsigned char>(*p++);
+        n |= static_cast<std::size_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Check that a bucket decodes inside its bytes and continues the order of the keys.
+ *
+ * @param p The first byte of the bucket.
+ * @param end One past the last byte of the bucket; the bucket must end exactly there.
+ * @param count The number of keys in the bucket.
+ * @param previous The last key of the previous bucket, replaced by the last key of this one.
+ */
+bool validBucket(const char* p, const char* end, std::size_t count, std::string& previous) {
+    std::string current;
+    for (std::size_t i = 0; i < count; i++) {
+        std::size_t shared = 0, length = 0;
+        if (i > 0 && (!getVarint(p, end, shared) || shared > current.size())) return false;
+        if (!getVarint(p, end, length) || length > static_cast<std::size_t>(end - p)) return false;
+        current.resize(shared);
+        current.append(p, length);
+        p += length;
+        if (current <= previous && !(i == 0 && previous.empty() && current.empty())) return false;
+        previous = current;
+    }
+    return p == end;
+}
+
+/**
+ * @brief Decodes the keys of one bucket in order.
+ */
+class BucketReader {
+public:
+    BucketReader(const char* p, std::size_t count) : p{p}, remaining{count} {
+        auto length = getVarint(this->p);
+        current.assign(this->p, length);
+        this->p += length;
+        remaining--;
+    }
+
+    const std::string& key() const {
+        return current;
+    }
+
+    bool next() {
+        if (remaining == 0) return false;
+        auto shared = getVarint(p);
+        auto length = getVarint(p);
+        current.resize(shared);
+        current.append(p, length);
+        p += length;
+        remaining--;
+        return true;
+    }
+
+private:
+    const char* p;
+    std::size_t remaining;
+    std::string current;
+};
+
+template <typename T>
+void writeArray(std::ostream& output, const std::vector<T>& values) {
+    std::uint64_t count = values.size();
+    output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (auto value : values) {
+        std::uint64_t v = value;
+        output.write(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+}
+
+// Reserve no more than this many elements or bytes before they are actually read,
+// so a corrupt count fails at the end of the stream rather than in the allocator.
+constexpr std::size_t kReadAhead = std::size_t{1} << 20;
+
+template <typename T>
+bool readArray(std::istream& input, std::vector<T>& values) {
+    std::uint64_t count = 0;
+    if (!input.read(reinterpret_cast<char*>(&count), sizeof(count)) || count > SIZE_MAX / sizeof(std::uint64_t))
+        return false;
+    values.clear();
+    values.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(count, kReadAhead)));
+    for (std::uint64_t i = 0; i < count; i++) {
+        std::uint64_t v = 0;
+        if (!input.read(reinterpret_cast<char*>(&v), sizeof(v))) return false;
+        values.push_back(static_cast<T>(v));
+    }
+    return true;
+}
+
+bool readBytes(std::istream& input, std::uint64_t length, std::string& bytes) {
+    bytes.clear();
+    while (bytes.size() < length) {
+        auto chunk = static_cast<std::size_t>(std::min<std::uint64_t>(length - bytes.size(), kReadAhead));
+        auto offset = bytes.size();
+        bytes.resize(offset + chunk);
+        if (!input.read(&bytes[offset], static_cast<std::streamsize>(chunk))) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Construct a dictionary of keys and their values.
+ *
+ * @param keys The keys, each with its value, in any order; the keys must be unique.
+ */
+PrefixIndex::PrefixIndex(std::vector<std::pair<std::string_view, std::size_t>> keys) {
+    std::sort(keys.begin(), keys.end());
+    values.reserve(keys.size());
+    buckets.reserve((keys.size() + kBucketSize - 1) / kBucketSize);
+
+    std::string_view previous;
+    for (std::size_t i = 0; i < keys.size(); i++) {
+        auto key = keys[i].first;
+        if (i % kBucketSize == 0) {
+            buckets.push_back(data.size());
+            putVarint(data, key.size());
+            data.append(key);
+        }
+        else {
+            std::size_t shared = 0;
+            auto most = std::min(previous.size(), key.size());
+            while (shared < most && previous[shared] == key[shared]) shared++;
+            putVarint(data, shared);
+            putVarint(data, key.size() - shared);
+            data.append(key.substr(shared));
+        }
+        values.push_back(keys[i].second);
+        previous = key;
+    }
+    data.shrink_to_fit();
+}
+
+std::string_view PrefixIndex::firstKey(std::size_t bucket) const {
+    const char* p = data.data() + buckets[bucket];
+    auto length = getVarint(p);
+    return {p, length};
+}
+
+/**
+ * @brief Get the rank of the first key not less than a key.
+ *
+ * @param key The key.
+ * @param from A bucket whose first key is known to be less than the key, where an
+ *             exponential search starts; 0 searches the whole dictionary.
+ */
+std::size_t PrefixIndex::lowerBound(std::string_view key, std::size_t from) const {
+    // The first bucket whose first key is not less than the key; the answer is in the bucket before it
+    std::size_t low = from, high = buckets.size();
+    if (from > 0) {
+        // Skips during a walk are mostly short, so gallop from the current bucket
+        for (std::size_t step = 1; from + step < buckets.size(); step *= 2) {
+            if (firstKey(from + step) >= key) {
+                high = from + step;
+                break;
+            }
+            low = from + step + 1;
+        }
+    }
+    while (low < high) {
+        auto middle = low + (high - low) / 2;
+        if (firstKey(middle) < key) low = middle + 1;
+        else high = middle;
+    }
+    if (low == 0) return 0;
+
+    auto bucket = low - 1;
+    auto rank = bucket * kBucketSize;
+    BucketReader reader{data.data() + buckets[bucket], std::min(kBucketSize, size() - rank)};
+    while (reader.next()) {
+        rank++;
+        if (std::string_view{reader.key()} >= key) return rank;
+    }
+    return std::min(low * kBucketSize, size());
+}
+
+/**
+ * @brief Get the rank of a key.
+ *
+ * @param key The key to find.
+ * @return The rank of the key, or npos if it is not in the dictionary.
+ */
+std::size_t PrefixIndex::find(std::string_view key) const {
+    auto rank = lowerBound(key);
+    return rank < size() && this->key(rank) == key ? rank : npos;
+}
+
+/**
+ * @brief Get the ranks of the keys starting with a prefix.
+ *
+ * The keys starting with the prefix lie between the prefix itself and the
+ * smallest string greater than all of them, the prefix with its last byte
+ * incremented after dropping trailing 0xff bytes.
+ *
+ * @param prefix The prefix; the empty prefix matches every key.
+ * @return The first rank matching and one past the last.
+ */
+std::pair<std::size_t, std::size_t> PrefixIndex::range(std::string_view prefix) const {
+    auto first = lowerBound(prefix);
+    return {first, endOf(prefix, first / kBucketSize)};
+}
+
+/**
+ * @brief Get one past the last rank of the keys starting with a prefix.
+ *
+ * @param prefix The prefix.
+ * @param from A bucket whose first key is not greater than the prefix, where the search starts.
+ */
+std::size_t PrefixIndex::endOf(std::string_view prefix, std::size_t from) const {
+    std::string successor{prefix};
+    while (!successor.empty() && static_cast<unsigned char>(successor.back()) == 0xff) successor.pop_back();
+    if (successor.empty()) return size();
+    successor.back() = static_cast<char>(static_cast<unsigned char>(successor.back()) + 1);
+    return lowerBound(successor, from);
+}
+
+/**
+ * @brief Get the key of a rank.
+ *
+ * @param rank The rank, less than size().
+ */
+std::string PrefixIndex::key(std::size_t rank) const {
+    auto bucket = rank / kBucketSize;
+    BucketReader reader{data.data() + buckets[bucket], std::min(kBucketSize, size() - bucket * kBucketSize)};
+    for (auto i = rank % kBucketSize; i > 0; i--) reader.next();
+    return reader.key();
+}
+
+/**
+ * @brief Visit the keys of a range of ranks in order, decoding each bucket once.
+ *
+ * @param first The first rank to visit.
+ * @param last One past the last rank to visit.
+ * @param visit Called with each rank and its key.
+ */
+void PrefixIndex::forEach(std::size_t first, std::size_t last,
+                          const std::function<void(std::size_t rank, std::string_view key)>& visit) const {
+    last = std::min(last, size());
+    for (auto rank = first; rank < last;) {
+        auto bucket = rank / kBucketSize;
+        auto bucketEnd = std::min((bucket + 1) * kBucketSize, size());
+        BucketReader reader{data.data() + buckets[bucket], bucketEnd - bucket * kBucketSize};
+        for (auto i = rank % kBucketSize; i > 0; i--) reader.next();
+        do {
+            visit(rank, reader.key());
+            rank++;
+        } while (rank < std::min(bucketEnd, last) && reader.next());
+    }
+}
+
+/**
+ * @brief Visit the keys in order as the paths of a trie, skipping the subtrees the visitor rejects.
+ *
+ * The keys of a bucket are decoded in order, and the keys of a rejected prefix
+ * are passed over with a comparison each. When the prefix runs past the bucket,
+ * the end of its range is found by a binary search instead.
+ *
+ * @param visit Called with each rank and its key; returns how many bytes of the key to accept.
+ */
+void PrefixIndex::walk(const std::function<std::size_t(std::size_t rank, std::string_view key)>& visit) const {
+    std::string rejected;
+    bool rejecting = false;
+    for (std::size_t rank = 0; rank < size();) {
+        auto bucket = rank / kBucketSize;
+        auto bucketEnd = std::min((bucket + 1) * kBucketSize, size());
+        BucketReader reader{data.data() + buckets[bucket], bucketEnd - bucket * kBucketSize};
+        for (auto i = rank % kBucketSize; i > 0; i--) reader.next();
+        do {
+            std::string_view key = reader.key();
+            if (rejecting && key.compare(0, rejected.size(), rejected) == 0) {
+                rank++;
+                continue;
+            }
+            auto accepted = visit(rank, key);
+            rejecting = accepted < key.size();
+            if (rejecting) rejected.assign(key.substr(0, accepted));
+            rank++;
+        } while (rank < bucketEnd && reader.next());
+
+        if (rejecting && rank < size() && firstKey(rank / kBucketSize).compare(0, rejected.size(), rejected) == 0) {
+            rank = endOf(rejected, rank / kBucketSize);
+        }
+    }
+}
+
+/**
+ * @brief Find the best keys starting with a prefix.
+ *
+ * @param prefix The prefix of the keys.
+ * @param limit The maximum number of ranks to return.
+ * @param ranks A vector to append the ranks of the best keys to, best first.
+ * @param weights The weights of the ranks, or nullptr to return the keys in sorted order.
+ * @return The total number of keys matching.
+ */
+std::size_t PrefixIndex::complete(std::string_view prefix, std::size_t limit, std::vector<std::size_t>& ranks,
+                                  const CompletionWeights* weights) const {
+    auto [first, last] = range(prefix);
+    if (weights) {
+        weights->top(first, last, limit, ranks);
+    }
+    else {
+        for (auto rank = first; rank < last && rank - first < limit; rank++) ranks.push_back(rank);
+    }
+    return last - first;
+}
+
+/**
+ * @brief Write the dictionary to a binary stream.
+ *
+ * @param output The stream to write to.
+ */
+void PrefixIndex::serialize(std::ostream& output) const {
+    output.write(kMagic, sizeof(kMagic));
+    std::uint64_t length = data.size();
+    output.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    output.write(data.data(), static_cast<std::streamsize>(data.size()));
+    writeArray(output, buckets);
+    writeArray(output, values);
+}
+
+/**
+ * @brief Read a dictionary written by serialize().
+ *
+ * @param input The stream to read from.
+ * @return true if a dictionary was read, false otherwise. The dictionary is unchanged on failure.
+ */
+bool PrefixIndex::deserialize(std::istream& input) {
+    char magic[sizeof(kMagic)];
+    std::uint64_t length = 0;
+    if (!input.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) return false;
+    if (!input.read(reinterpret_cast<char*>(&length), sizeof(length)) || length > SIZE_MAX / 2) return false;
+
+    PrefixIndex loaded;
+    if (!readBytes(input, length, loaded.data)) return false;
+    if (!readArray(input, loaded.buckets) || !readArray(input, loaded.values)) return false;
+    // Every bucket but the last is full, the buckets follow each other through
+    // the data, and every key decodes inside its bucket in strictly ascending order
+    if (loaded.buckets.size() != (loaded.values.size() + kBucketSize - 1) / kBucketSize) return false;
+    if (loaded.buckets.empty() ? !loaded.data.empty() : loaded.buckets.front() != 0) return false;
+    std::string previous;
+    for (std::size_t bucket = 0; bucket < loaded.buckets.size(); bucket++) {
+        auto begin = loaded.buckets[bucket];
+        auto end = bucket + 1 < loaded.buckets.size() ? loaded.buckets[bucket + 1] : loaded.data.size();
+        if (begin >= end || end > loaded.data.size()) return false;
+        auto count = std::min(kBucketSize, loaded.values.size() - bucket * kBucketSize);
+        if (!validBucket(loaded.data.data() + begin, loaded.data.data() + end, count, previous)) return false;
+    }
+    *this = std::move(loaded);
+    return true;
+}
+
+/**
+ * @brief Construct weights for a number of ranks, all zero.
+ *
+ * @param size The number of ranks.
+ */
+CompletionWeights::CompletionWeights(std::size_t size) {
+    while (leaves < size) leaves *= 2;
+    tree.assign(2 * leaves, 0);
+}
+
+/**
+ * @brief Set the weight of a rank and update the maxima above it.
+ *
+ * @param rank The rank.
+ * @param weight The new weight.
+ */
+void CompletionWeights::set(std::size_t rank, std::uint32_t weight) {
+    auto node = leaves + rank;
+    tree[node] = weight;
+    for (node /= 2; node > 0; node /= 2) tree[node] = std::max(tree[2 * node], tree[2 * node + 1]);
+}
+
+/**
+ * @brief Find the heaviest ranks of a range, ties by rank.
+ *
+ * The range is split into the nodes that cover it, kept in a heap ordered by
+ * their maximum and then by their first rank. The best node is followed down
+ * to its heaviest leaf, and the siblings passed on the way go to the heap. A
+ * node never orders after a leaf below it, so the leaves come out in order,
+ * in O(limit log n) time however many ranks the range holds.
+ *
+ * @param first The first rank of the range.
+ * @param last One past the last rank of the range.
+ * @param limit The maximum number of ranks to return.
+ * @param ranks A vector to append the ranks to, heaviest first.
+ */
+void CompletionWeights::top(std::size_t first, std::size_t last, std::size_t limit,
+                            std::vector<std::size_t>& ranks) const {
+    if (first >= last || limit == 0) return;
+    // Without any weight the order is the order of the ranks
+    if (tree[1] == 0) {
+        for (auto rank = first; rank < last && rank - first < limit; rank++) ranks.push_back(rank);
+        return;
+    }
+
+    // (weight, first rank, node, ranks below): the heaviest node first, then the leftmost
+    using Item = std::tuple<std::uint32_t, std::size_t, std::size_t, std::size_t>;
+    auto after = [](const Item& a, const Item& b) {
+        return std::get<0>(a) != std::get<0>(b) ? std::get<0>(a) < std::get<0>(b) : std::get<1>(a) > std::get<1>(b);
+    };
+    std::priority_queue<Item, std::vector<Item>, decltype(after)> heap{after};
+
+    std::size_t span = 1;
+    for (auto low = first + leaves, high = last + leaves; low < high; low /= 2, high /= 2, span *= 2) {
+        if (low & 1) {
+            heap.emplace(tree[low], low * span - leaves, low, span);
+            low++;
+        }
+        if (high & 1) {
+            high--;
+            heap.emplace(tree[high], high * span - leaves, high, span);
+        }
+    }
+
+    auto goal = ranks.size() + limit;
+    while (!heap.empty() && ranks.size() < goal) {
+        auto [weight, rank, node, below] = heap.top();
+        heap.pop();
+        if (below == 1) {
+            ranks.push_back(rank);
+            continue;
+        }
+        // Descend straight to the heaviest leaf, leaving the other children in the heap
+        while (below > 1) {
+            below /= 2;
+            auto left = 2 * node, right = left + 1;
+            if (tree[left] >= weight) {
+                heap.emplace(tree[right], rank + below, right, below);
+                node = left;
+            }
+            else {
+                heap.emplace(tree[left], rank, left, below);
+                node = right;
+                rank += below;
+            }
+        }
+        ranks.push_back(rank);
+    }
+}
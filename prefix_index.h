@@ -0,0 +1,205 @@
+#pragma once
+#ifndef PREFIX_INDEX_H
+#define PREFIX_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class CompletionWeights;
+
+/**
+ * @brief A compact sorted dictionary of unique keys that answers prefix queries.
+ *
+ * The keys are sorted and front-coded in buckets of sixteen: the first key of
+ * a bucket is stored whole, and each following key as the length of the prefix
+ * it shares with the key before it plus the rest of its bytes. A lookup binary
+ * searches the first keys of the buckets, which are read in place, and then
+ * decodes at most one bucket. Sorted IDs share long prefixes such as
+ * "smith2020", so the dictionary is usually a fraction of the size of the keys.
+ *
+ * Each key is identified by its rank in the sorted order and carries a value,
+ * e.g. the position of the entry it names.
+ */
+class PrefixIndex {
+public:
+    /**
+     * @brief The rank returned by find() for absent keys.
+     */
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    /**
+     * @brief Construct an empty dictionary.
+     */
+    PrefixIndex() = default;
+
+    /**
+     * @brief Construct a dictionary of keys and their values.
+     *
+     * @param keys The keys, each with its value, in any order; the keys must be unique.
+     */
+    explicit PrefixIndex(std::vector<std::pair<std::string_view, std::size_t>> keys);
+
+    /**
+     * @brief Get the number of keys.
+     */
+    std::size_t size() const {
+        return values.size();
+    }
+
+    /**
+     * @brief Get the rank of a key.
+     *
+     * @param key The key to find.
+     * @return The rank of the key, or npos if it is not in the dictionary.
+     */
+    std::size_t find(std::string_view key) const;
+
+    /**
+     * @brief Get the ranks of the keys starting with a prefix.
+     *
+     * @param prefix The prefix; the empty prefix matches every key.
+     * @return The first rank matching and one past the last.
+     */
+    std::pair<std::size_t, std::size_t> range(std::string_view prefix) const;
+
+    /**
+     * @brief Get the key of a rank.
+     *
+     * @param rank The rank, less than size().
+     */
+    std::string key(std::size_t rank) const;
+
+    /**
+     * @brief Visit the keys of a range of ranks in order, decoding each bucket once.
+     *
+     * @param first The first rank to visit.
+     * @param last One past the last rank to visit.
+     * @param visit Called with each rank and its key; the key is valid during the call.
+     */
+    void forEach(std::size_t first, std::size_t last,
+                 const std::function<void(std::size_t rank, std::string_view key)>& visit) const;
+
+    /**
+     * @brief Visit the keys in order as the paths of a trie, skipping the subtrees the visitor rejects.
+     *
+     * @param visit Called with each rank and its key, valid during the call. It returns how many
+     *              bytes of the key to accept: when fewer than the whole key, the following keys
+     *              starting with the accepted bytes are not visited.
+     */
+    void walk(const std::function<std::size_t(std::size_t rank, std::string_view key)>& visit) const;
+
+    /**
+     * @brief Get the value of a rank.
+     *
+     * @param rank The rank, less than size().
+     */
+    std::size_t value(std::size_t rank) const {
+        return values[rank];
+    }
+
+    /**
+     * @brief Find the best keys starting with a prefix.
+     *
+     * Without weights the keys are returned in sorted order. With weights the
+     * heaviest keys come first, ties in sorted order; the cost grows with the
+     * number of keys returned and the logarithm of the size, not with the number
+     * of keys matching.
+     *
+     * @param prefix The prefix of the keys.
+     * @param limit The maximum number of ranks to return.
+     * @param ranks A vector to append the ranks of the best keys to, best first.
+     * @param weights The weights of the ranks, or nullptr to return the keys in sorted order.
+     * @return The total number of keys matching, which may exceed limit.
+     */
+    std::size_t complete(std::string_view prefix, std::size_t limit, std::vector<std::size_t>& ranks,
+                         const CompletionWeights* weights = nullptr) const;
+
+    /**
+     * @brief Get the size of the dictionary in bytes, without the values.
+     */
+    std::size_t bytes() const {
+        return data.size() + buckets.size() * sizeof(std::size_t);
+    }
+
+    /**
+     * @brief Write the dictionary to a binary stream.
+     *
+     * @param output The stream to write to.
+     */
+    void serialize(std::ostream& output) const;
+
+    /**
+     * @brief Read a dictionary written by serialize().
+     *
+     * @param input The stream to read from.
+     * @return true if a dictionary was read, false if the data is truncated or not a dictionary.
+     */
+    bool deserialize(std::istream& input);
+
+private:
+    static constexpr std::size_t kBucketSize = 16;
+
+    std::string data;                  //!< The front-coded buckets.
+    std::vector<std::size_t> buckets;  //!< The offset of each bucket in data.
+    std::vector<std::size_t> values;   //!< The value of each rank.
+
+    std::string_view firstKey(std::size_t bucket) const;
+    std::size_t lowerBound(std::string_view key, std::size_t from = 0) const;
+    std::size_t endOf(std::string_view prefix, std::size_t from) const;
+};
+
+/**
+ * @brief CompletionWeights ranks the keys of a PrefixIndex, e.g. by how often they are cited.
+ *
+ * The weights are kept in a tree of range maxima over the ranks, so a weight
+ * is updated in logarithmic time and the heaviest ranks of a range are
+ * found without visiting the range.
+ */
+class CompletionWeights {
+public:
+    /**
+     * @brief Construct weights for a number of ranks, all zero.
+     *
+     * @param size The number of ranks, i.e. the size of the PrefixIndex.
+     */
+    explicit CompletionWeights(std::size_t size = 0);
+
+    /**
+     * @brief Set the weight of a rank.
+     *
+     * @param rank The rank.
+     * @param weight The new weight.
+     */
+    void set(std::size_t rank, std::uint32_t weight);
+
+    /**
+     * @brief Get the weight of a rank.
+     *
+     * @param rank The rank.
+     */
+    std::uint32_t get(std::size_t rank) const {
+        return tree[leaves + rank];
+    }
+
+    /**
+     * @brief Find the heaviest ranks of a range, ties by rank.
+     *
+     * @param first The first rank of the range.
+     * @param last One past the last rank of the range.
+     * @param limit The maximum number of ranks to return.
+     * @param ranks A vector to append the ranks to, heaviest first.
+     */
+    void top(std::size_t first, std::size_t last, std::size_t limit, std::vector<std::size_t>& ranks) const;
+
+private:
+    std::size_t leaves = 1;             //!< The number of leaves, a power of two.
+    std::vector<std::uint32_t> tree;    //!< The maxima of the nodes; node i has children 2i and 2i+1.
+};
+
+#endif
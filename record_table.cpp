@@ -0,0 +1,156 @@
+#include "record_table.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include "thread_pool.h"
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'M', 'T', 'A', 'B', 'L', 'E', '1'};
+constexpr std::size_t kHeaderSize = sizeof(kMagic) + sizeof(std::uint64_t);
+
+bool byKey(const RecordTable::Row& a, const RecordTable::Row& b) {
+    return a.key < b.key;
+}
+
+} // namespace
+
+/**
+ * @brief Open a table file.
+ *
+ * The header, the sizes of the arrays and the order of the keys and record ends
+ * are checked; the records are only read when they are found.
+ *
+ * @param path The path to the table.
+ * @return true if the table was opened, false otherwise.
+ */
+bool RecordTable::open(const std::string& path) {
+    count = 0;
+    if (!file.open(path)) return false;
+    auto data = file.view();
+    std::uint64_t n = 0;
+    if (data.size() < kHeaderSize || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) return false;
+    std::memcpy(&n, data.data() + sizeof(kMagic), sizeof(n));
+    if (n > (data.size() - kHeaderSize) / (2 * sizeof(std::uint64_t))) return false;
+
+    // The mapping is page aligned, so the arrays after the 16-byte header are aligned too
+    auto arrays = reinterpret_cast<const std::uint64_t*>(data.data() + kHeaderSize);
+    auto recordsOffset = kHeaderSize + 2 * sizeof(std::uint64_t) * static_cast<std::size_t>(n);
+    if (n > 0 && arrays[n + n - 1] != data.size() - recordsOffset) return false;
+    // A binary search needs the keys strictly ascending, and record() the ends ascending
+    for (std::size_t i = 1; i < n; i++) {
+        if (arrays[i - 1] >= arrays[i] || arrays[n + i - 1] > arrays[n + i]) return false;
+    }
+    keys = arrays;
+    ends = arrays + n;
+    records = data.data() + recordsOffset;
+    count = static_cast<std::size_t>(n);
+    return true;
+}
+
+/**
+ * @brief Find the record of a key by a binary search over the mapped keys.
+ *
+ * @param key The key.
+ * @param record Receives the record.
+ * @return true if the key is in the table, false otherwise.
+ */
+bool RecordTable::find(std::uint64_t key, std::string_view& record) const {
+    auto found = std::lower_bound(keys, keys + count, key);
+    if (found == keys + count || *found != key) return false;
+    record = this->record(static_cast<std::size_t>(found - keys));
+    return true;
+}
+
+/**
+ * @brief Get the rows of the table in key order.
+ */
+std::vector<RecordTable::Row> RecordTable::rows() const {
+    std::vector<Row> rows(count);
+    for (std::size_t i = 0; i < count; i++) rows[i] = {keys[i], record(i)};
+    return rows;
+}
+
+/**
+ * @brief Write the rows of several runs to a table file.
+ *
+ * Each run is sorted on its own worker with a stable sort, skipped when it is
+ * sorted already, like the rows of an old table. The runs are then merged
+ * pairwise, level by level, each level in parallel; the merge takes equal keys
+ * from the earlier run first, so the last row of a key ends its group. The
+ * table is written next to the path and renamed over it.
+ *
+ * @param runs The runs of rows.
+ * @param path The path to the table.
+ * @return The number of records written.
+ */
+std::size_t RecordTable::write(std::vector<std::vector<Row>> runs, const std::string& path) {
+    parallelFor(0, runs.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (auto r = begin; r < end; r++) {
+            if (!std::is_sorted(runs[r].begin(), runs[r].end(), byKey))
+                std::stable_sort(runs[r].begin(), runs[r].end(), byKey);
+        }
+    });
+
+    std::vector<Row> rows;
+    std::vector<std::size_t> ends;  // The end of each run in rows
+    for (auto& run : runs) {
+        rows.insert(rows.end(), run.begin(), run.end());
+        ends.push_back(rows.size());
+        std::vector<Row>{}.swap(run);
+    }
+    std::vector<Row> merged(rows.size());
+    while (ends.size() > 1) {
+        auto pairs = (ends.size() + 1) / 2;
+        parallelFor(0, pairs, 1, [&](std::size_t begin, std::size_t end) {
+            for (auto pair = begin; pair < end; pair++) {
+                auto first = pair == 0 ? 0 : ends[2 * pair - 1];
+                auto middle = ends[2 * pair];
+                auto last = 2 * pair + 1 < ends.size() ? ends[2 * pair + 1] : middle;
+                std::merge(rows.begin() + first, rows.begin() + middle, rows.begin() + middle, rows.begin() + last,
+                           merged.begin() + first, byKey);
+            }
+        });
+        std::vector<std::size_t> next;
+        for (std::size_t pair = 0; pair < pairs; pair++) next.push_back(ends[std::min(2 * pair + 1, ends.size() - 1)]);
+        rows.swap(merged);
+        ends.swap(next);
+    }
+
+    // Keep the last row of each key
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < rows.size(); i++) {
+        if (kept > 0 && rows[kept - 1].key == rows[i].key) rows[kept - 1] = rows[i];
+        else rows[kept++] = rows[i];
+    }
+    rows.resize(kept);
+
+    std::vector<std::uint64_t> arrays(2 * kept);
+    std::uint64_t offset = 0;
+    for (std::size_t i = 0; i < kept; i++) {
+        arrays[i] = rows[i].key;
+        offset += rows[i].record.size();
+        arrays[kept + i] = offset;
+    }
+    auto temporary = path + ".tmp";
+    {
+        std::ofstream output{temporary, std::ios::binary | std::ios::trunc};
+        std::uint64_t n = kept;
+        output.write(kMagic, sizeof(kMagic));
+        output.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        output.write(reinterpret_cast<const char*>(arrays.data()),
+                     static_cast<std::streamsize>(arrays.size() * sizeof(std::uint64_t)));
+        for (const auto& row : rows) output.write(row.record.data(), static_cast<std::streamsize>(row.record.size()));
+        if (!output.flush()) throw std::runtime_error("cannot write " + temporary);
+    }
+    // Readers keep the old table they have mapped; the next to open it sees the new one
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("cannot replace " + path);
+    }
+    return kept;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#ifndef RECORD_TABLE_H
+#define RECORD_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+
+/**
+ * @brief RecordTable maps 64-bit keys to records of bytes, read in place from a mapped file.
+ *
+ * The file holds the keys in ascending order, the end offset of each record,
+ * and the records one after the other. A lookup is a binary search over the
+ * mapped keys, so opening a table reads nothing and a lookup touches a few
+ * pages. It is the storage of the tables imported into the metadata store,
+ * such as the IsbnTable.
+ *
+ * A table is written once by write() and replaced by a rename, so a process
+ * that has it open keeps reading the old one.
+ */
+class RecordTable {
+public:
+    /**
+     * @brief A key and its record, e.g. a row of a dump to be written.
+     */
+    struct Row {
+        std::uint64_t key;
+        std::string_view record;
+    };
+
+    /**
+     * @brief Open a table file.
+     *
+     * @param path The path to the table.
+     * @return true if the table was opened, false if it is missing or not a table; the table is then empty.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Find the record of a key.
+     *
+     * @param key The key.
+     * @param record Receives the record, a view into the mapped file.
+     * @return true if the key is in the table, false otherwise.
+     */
+    bool find(std::uint64_t key, std::string_view& record) const;
+
+    /**
+     * @brief Get the number of records.
+     */
+    std::size_t size() const {
+        return count;
+    }
+
+    /**
+     * @brief Get the rows of the table in key order, as views into the mapped file.
+     */
+    std::vector<Row> rows() const;
+
+    /**
+     * @brief Write the rows of several runs to a table file.
+     *
+     * The runs are sorted by key in parallel, then merged pairwise. Of the rows
+     * with the same key, the last one, in the order of the runs and of the rows
+     * within a run, is kept.
+     *
+     * @param runs The runs of rows; the records must stay valid until the call returns.
+     * @param path The path to the table; it is created or replaced.
+     * @return The number of records written.
+     *
+     * @throws std::runtime_error if the table cannot be written.
+     */
+    static std::size_t write(std::vector<std::vector<Row>> runs, const std::string& path);
+
+private:
+    MappedFile file;
+    std::size_t count = 0;
+    const std::uint64_t* keys = nullptr;  //!< The sorted keys.
+    const std::uint64_t* ends = nullptr;  //!< The end offset of each record in records.
+    const char* records = nullptr;
+
+    std::string_view record(std::size_t i) const {
+        auto begin = i == 0 ? 0 : ends[i - 1];
+        return {records + begin, static_cast<std::size_t>(ends[i] - begin)};
+    }
+};
+
+#endif
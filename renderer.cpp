@@ -0,0 +1,136 @@
+#include "renderer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifndef _WIN32
+#ifdef IOV_MAX
+constexpr std::size_t kMaxIovecs = IOV_MAX;
+#else
+constexpr std::size_t kMaxIovecs = 1024;
+#endif
+
+// Write all buffers, resuming after partial writes and splitting at the iovec limit.
+bool writeAll(int fd, std::vector<iovec>& buffers) {
+    std::size_t first = 0;
+    while (first < buffers.size()) {
+        int count = static_cast<int>(std::min(buffers.size() - first, kMaxIovecs));
+        ssize_t written = ::writev(fd, buffers.data() + first, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        auto remaining = static_cast<std::size_t>(written);
+        while (first < buffers.size() && remaining >= buffers[first].iov_len) {
+            remaining -= buffers[first].iov_len;
+            first++;
+        }
+        if (remaining > 0) {
+            buffers[first].iov_base = static_cast<char*>(buffers[first].iov_base) + remaining;
+            buffers[first].iov_len -= remaining;
+        }
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+/**
+ * @brief Construct a new StreamingRenderer object.
+ *
+ * @param output The stream to write the references to.
+ * @param count The number of references that will be delivered.
+ * @param window The maximum number of slots in progress at a time.
+ */
+StreamingRenderer::StreamingRenderer(std::ostream& output, std::size_t count, std::size_t window)
+    : output{output}, count{count}, window{std::max<std::size_t>(std::min(window, count), 1)},
+      pending(this->window), ready(this->window, false) {}
+
+void StreamingRenderer::acquire(std::size_t slot) {
+    std::unique_lock<std::mutex> lock{mutex};
+    room.wait(lock, [this, slot] { return cancelled || slot < next + window; });
+    if (cancelled) throw std::runtime_error("rendering cancelled");
+}
+
+void StreamingRenderer::deliver(std::size_t slot, std::string text) {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (cancelled || slot < next || slot >= next + window || slot >= count) return;
+    pending[slot % window] = std::move(text);
+    ready[slot % window] = true;
+    if (slot != next) return;
+
+    // Write the run of ready slots starting at next
+    std::size_t last = next;
+    while (last < count && last - next < window && ready[last % window]) last++;
+    writeRun(next, last);
+    for (; next < last; next++) {
+        // Release the memory of the text, not just its contents
+        std::string{}.swap(pending[next % window]);
+        ready[next % window] = false;
+    }
+    room.notify_all();
+}
+
+/**
+ * @brief Write the delivered slots [first, last) with one write.
+ *
+ * @param first The first slot of the run.
+ * @param last One past the last slot of the run.
+ */
+void StreamingRenderer::writeRun(std::size_t first, std::size_t last) {
+#ifndef _WIN32
+    if (fd >= 0) {
+        // Text written through the stream must come out first
+        output.flush();
+        std::vector<iovec> buffers;
+        buffers.reserve(last - first);
+        for (auto slot = first; slot < last; slot++) {
+            auto& text = pending[slot % window];
+            if (!text.empty()) buffers.push_back(iovec{&text[0], text.size()});
+        }
+        if (!writeAll(fd, buffers)) throw std::runtime_error("cannot write output");
+        return;
+    }
+#endif
+    if (last - first == 1) {
+        const auto& text = pending[first % window];
+        output.write(text.data(), static_cast<std::streamsize>(text.size()));
+        output.flush();
+        if (!output) throw std::runtime_error("cannot write output");
+        return;
+    }
+    // Place each slot at the prefix sum of the sizes before it
+    std::vector<std::size_t> offsets(last - first + 1, 0);
+    for (auto slot = first; slot < last; slot++) {
+        offsets[slot - first + 1] = offsets[slot - first] + pending[slot % window].size();
+    }
+    std::string run(offsets.back(), '\0');
+    for (auto slot = first; slot < last; slot++) {
+        const auto& text = pending[slot % window];
+        if (!text.empty()) std::memcpy(&run[offsets[slot - first]], text.data(), text.size());
+    }
+    output.write(run.data(), static_cast<std::streamsize>(run.size()));
+    output.flush();
+    if (!output) throw std::runtime_error("cannot write output");
+}
+
+void StreamingRenderer::cancel() {
+    std::lock_guard<std::mutex> lock{mutex};
+    cancelled = true;
+    room.notify_all();
+}
+
+std::size_t StreamingRenderer::written() const {
+    std::lock_guard<std::mutex> lock{mutex};
+    return next;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief StreamingRenderer writes rendered references in order as soon as they are ready.
+ *
+ * The output is cut into slots, each holding the rendered text of one or more
+ * consecutive references, and slots may be delivered from any thread in any
+ * order. A delivered slot is held in a reorder buffer until every earlier slot
+ * has been written; then the whole ready run is written at once and the stream
+ * is flushed, so a reader sees each reference as soon as it and all references
+ * before it are resolved.
+ *
+ * A run is written with a single vectored write when the renderer has a file
+ * descriptor, so the slot buffers are never copied. Otherwise the buffers are
+ * copied at their prefix-summed offsets into one buffer, which is written with
+ * a single call.
+ *
+ * Only a window of slots past the first unwritten one can be in progress at a
+ * time: acquire() blocks producers that run too far ahead, which bounds the
+ * memory held by the reorder buffer regardless of the number of references.
+ */
+class StreamingRenderer {
+public:
+    /**
+     * @brief Construct a new StreamingRenderer object.
+     *
+     * @param output The stream to write the references to.
+     * @param count The number of slots that will be delivered.
+     * @param window The maximum number of slots in progress at a time.
+     */
+    StreamingRenderer(std::ostream& output, std::size_t count, std::size_t window = 1024);
+
+    StreamingRenderer(const StreamingRenderer&) = delete;
+    StreamingRenderer& operator=(const StreamingRenderer&) = delete;
+
+    /**
+     * @brief Write the references directly to the file descriptor underlying the stream.
+     *
+     * The stream is flushed before each write, so text written to it earlier
+     * stays in front of the references. Not available on Windows.
+     *
+     * @param fd The file descriptor the stream writes to, e.g. STDOUT_FILENO for std::cout.
+     */
+    void setDescriptor(int fd) {
+        this->fd = fd;
+    }
+
+    /**
+     * @brief Wait until a slot fits in the window.
+     *
+     * @param slot The slot about to be produced.
+     *
+     * @throws std::runtime_error if the renderer was cancelled.
+     */
+    void acquire(std::size_t slot);
+
+    /**
+     * @brief Deliver the rendered text of a slot and write every slot that became ready.
+     *
+     * @param slot The slot; it must have been acquired.
+     * @param text The rendered references of the slot.
+     *
+     * @throws std::runtime_error if the output cannot be written.
+     */
+    void deliver(std::size_t slot, std::string text);
+
+    /**
+     * @brief Give up on the remaining slots and wake up every producer waiting in acquire().
+     */
+    void cancel();
+
+    /**
+     * @brief Get the number of slots written so far.
+     */
+    std::size_t written() const;
+
+private:
+    std::ostream& output;
+    std::size_t count;
+    std::size_t window;
+    int fd = -1;                       //!< The descriptor to write to, or -1 to write to the stream.
+    std::vector<std::string> pending;  //!< Ring buffer of delivered texts, indexed by slot modulo the window.
+    std::vector<bool> ready;           //!< Whether each ring buffer position holds a delivered text.
+    std::size_t next = 0;              //!< The first slot not yet written.
+    bool cancelled = false;
+    mutable std::mutex mutex;
+    std::condition_variable room;
+
+    void writeRun(std::size_t first, std::size_t last);
+};
+
+#endif
@@ -0,0 +1,376 @@
+#include "scanner.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCANNER_HAVE_SSE2 1
+#endif
+
+namespace {
+
+constexpr std::size_t npos = std::string_view::npos;
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+bool isAlpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Letters, digits, '_' and every non-ASCII byte, so UTF-8 letters are accepted
+bool isKeyWord(char c) {
+    return isAlpha(c) || (c >= '0' && c <= '9') || c == '_' || static_cast<unsigned char>(c) >= 0x80;
+}
+
+// Punctuation Pandoc allows inside a key, but not at its end
+bool isKeyPunctuation(char c) {
+    return std::strchr(":.#$%&-+?<>~/", c) != nullptr && c != '\0';
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && isSpace(s.front())) s.remove_prefix(1);
+    while (!s.empty() && isSpace(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+// \cite, \nocite, \citep, \citet, \citeauthor, \parencite, \textcite, \autocite, \footcite, ...
+bool isCiteCommand(std::string_view name) {
+    constexpr std::string_view cite = "cite";
+    return name.size() >= cite.size() &&
+           (name.compare(0, cite.size(), cite) == 0 || name.compare(name.size() - cite.size(), cite.size(), cite) == 0);
+}
+
+/**
+ * @brief Read "[id]" at text[at] == '['.
+ *
+ * @return The position of the closing ']', or npos if the bracket is unterminated or nested.
+ */
+std::size_t closingBracket(std::string_view text, std::size_t at) {
+    for (std::size_t i = at + 1; i < text.size(); i++) {
+        if (text[i] == ']') return i;
+        if (text[i] == '[') return npos;
+    }
+    return npos;
+}
+
+/**
+ * @brief Read a LaTeX citation command at text[at] == '\'.
+ *
+ * @param next Set to the position where scanning resumes.
+ * @param complete Set to false if the text ends where the arguments of a citation command could follow.
+ * @return false if the command is a citation with an unterminated argument.
+ */
+bool scanLatex(std::string_view text, std::size_t at, std::vector<CitationOccurrence>& occurrences, std::size_t& next,
+               bool& complete) {
+    std::size_t i = at + 1;
+    while (i < text.size() && isAlpha(text[i])) i++;
+    if (i == at + 1) {
+        // A control symbol such as "\\" or "\{"; skip the escaped byte
+        next = std::min(at + 2, text.size());
+        return true;
+    }
+    next = i;
+    if (!isCiteCommand(text.substr(at + 1, i - at - 1))) return true;
+
+    if (i < text.size() && text[i] == '*') i++;
+    // Up to two optional arguments, e.g. \cite[see][p.~5]{key}
+    for (int optional = 0; optional < 2; optional++) {
+        while (i < text.size() && isSpace(text[i])) i++;
+        if (i >= text.size() || text[i] != '[') break;
+        auto close = text.find(']', i + 1);
+        if (close == npos) return false;
+        i = close + 1;
+    }
+    while (i < text.size() && isSpace(text[i])) i++;
+    if (i >= text.size()) complete = false;
+    if (i >= text.size() || text[i] != '{') return true;
+
+    auto close = text.find('}', i + 1);
+    if (close == npos) return false;
+    // Split the keys at commas without copying them
+    for (std::size_t keyBegin = i + 1; keyBegin <= close;) {
+        auto comma = text.find(',', keyBegin);
+        std::size_t keyEnd = (comma == npos || comma > close) ? close : comma;
+        auto key = trim(text.substr(keyBegin, keyEnd - keyBegin));
+        // "\nocite{*}" names every entry rather than a key
+        if (!key.empty() && key != "*") {
+            auto keyOffset = static_cast<std::size_t>(key.data() - text.data());
+            occurrences.push_back(CitationOccurrence{at, close + 1, keyOffset, key, Latex});
+        }
+        keyBegin = keyEnd + 1;
+    }
+    next = close + 1;
+    return true;
+}
+
+/**
+ * @brief Read a Pandoc citation at text[at] == '@'.
+ *
+ * @param next Set to the position where scanning resumes.
+ * @return false if a braced key is unterminated.
+ */
+bool scanPandoc(std::string_view text, std::size_t at, std::vector<CitationOccurrence>& occurrences, std::size_t& next) {
+    next = at + 1;
+    // A key starts a word, which keeps e-mail addresses out
+    if (at > 0) {
+        char before = text[at - 1];
+        if (!isSpace(before) && before != '[' && before != ';' && before != '-' && before != '(') return true;
+    }
+
+    if (at + 1 < text.size() && text[at + 1] == '{') {
+        auto close = text.find('}', at + 2);
+        if (close == npos) return false;
+        auto key = trim(text.substr(at + 2, close - at - 2));
+        auto keyOffset = static_cast<std::size_t>(key.data() - text.data());
+        if (!key.empty()) occurrences.push_back(CitationOccurrence{at, close + 1, keyOffset, key, Pandoc});
+        next = close + 1;
+        return true;
+    }
+
+    std::size_t i = at + 1;
+    if (i >= text.size() || !isKeyWord(text[i])) return true;
+    std::size_t end = i;
+    while (i < text.size() && (isKeyWord(text[i]) || isKeyPunctuation(text[i]))) {
+        if (isKeyWord(text[i])) end = i + 1;
+        i++;
+    }
+    // Trailing punctuation such as the period ending a sentence is not part of the key
+    occurrences.push_back(CitationOccurrence{at, end, at + 1, text.substr(at + 1, end - at - 1), Pandoc});
+    next = end;
+    return true;
+}
+
+// Whether text[at] starts a line, allowing the up to three spaces of indentation Markdown allows
+bool atLineStart(std::string_view text, std::size_t at) {
+    std::size_t spaces = 0;
+    while (at > 0 && text[at - 1] == ' ' && spaces <= 3) {
+        at--;
+        spaces++;
+    }
+    return spaces <= 3 && (at == 0 || text[at - 1] == '\n');
+}
+
+std::size_t runLength(std::string_view text, std::size_t at) {
+    std::size_t i = at;
+    while (i < text.size() && text[i] == text[at]) i++;
+    return i - at;
+}
+
+/**
+ * @brief Find the end of a fenced code block opened at text[at].
+ *
+ * The block ends after the line holding a run of at least length fence characters
+ * at its start.
+ *
+ * @return The position after the block, or npos if it is not closed.
+ */
+std::size_t skipFence(std::string_view text, std::size_t at, std::size_t length) {
+    auto line = text.find('\n', at);
+    while (line != npos) {
+        std::size_t i = line + 1;
+        while (i < text.size() && i - line - 1 < 3 && text[i] == ' ') i++;
+        if (i < text.size() && text[i] == text[at] && runLength(text, i) >= length) {
+            auto end = text.find('\n', i);
+            return end == npos ? text.size() : end + 1;
+        }
+        line = text.find('\n', line + 1);
+    }
+    return npos;
+}
+
+/**
+ * @brief Find the end of an inline code span opened by length backticks at text[at].
+ *
+ * @return The position after the closing backticks, or npos if the span is not closed.
+ */
+std::size_t skipCodeSpan(std::string_view text, std::size_t at, std::size_t length) {
+    for (auto i = text.find('`', at + length); i != npos; i = text.find('`', i)) {
+        auto run = runLength(text, i);
+        if (run == length) return i + run;
+        i += run;
+    }
+    return npos;
+}
+
+} // namespace
+
+/**
+ * @brief Construct a new CitationScanner object.
+ *
+ * @param options The syntaxes to recognise.
+ */
+CitationScanner::CitationScanner(ScannerOptions options) : options{options} {
+    if (options.syntaxes & Brackets) {
+        addTrigger('[');
+        addTrigger(']');
+    }
+    if (options.syntaxes & Latex) addTrigger('\\');
+    if (options.syntaxes & Pandoc) addTrigger('@');
+    if (options.skipCode) {
+        addTrigger('`');
+        addTrigger('~');
+        addTrigger('<');
+    }
+}
+
+void CitationScanner::addTrigger(char c) {
+    trigger[static_cast<unsigned char>(c)] = true;
+    triggers[triggerCount++] = c;
+}
+
+/**
+ * @brief Find the first trigger byte at or after a position.
+ *
+ * @return The position of the trigger byte, or text.size() if there is none.
+ */
+std::size_t CitationScanner::findTrigger(std::string_view text, std::size_t from) const {
+    const char* p = text.data();
+    std::size_t n = text.size(), i = from;
+#ifdef SCANNER_HAVE_SSE2
+    __m128i needles[sizeof(triggers)];
+    for (std::size_t t = 0; t < triggerCount; t++) needles[t] = _mm_set1_epi8(triggers[t]);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i hit = _mm_setzero_si128();
+        for (std::size_t t = 0; t < triggerCount; t++) hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, needles[t]));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+        if (mask != 0) {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+            return i + bit;
+#else
+            return i + static_cast<std::size_t>(__builtin_ctz(mask));
+#endif
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (trigger[static_cast<unsigned char>(p[i])]) return i;
+    }
+    return n;
+}
+
+/**
+ * @brief Find every citation key in a text.
+ *
+ * When both brackets and Pandoc are enabled, a bracket holding an "@key" is a
+ * Pandoc citation group such as "[see @a, p. 3; @b]", not a "[id]" reference:
+ * its keys are the Pandoc keys inside it.
+ *
+ * @param text The text to scan.
+ * @param occurrences A vector to append the occurrences to, in text order.
+ * @return true if the text is well formed, false otherwise.
+ */
+bool CitationScanner::scan(std::string_view text, std::vector<CitationOccurrence>& occurrences) const {
+    ScanStatus status;
+    return scan(text, occurrences, status);
+}
+
+/**
+ * @brief Find every citation key in a text, and tell where it stopped.
+ *
+ * @param text The text to scan.
+ * @param occurrences A vector to append the occurrences to, in text order.
+ * @param status Set to whether the end of the text cut off a construct, and to where
+ *               the text stopped being well formed.
+ * @return true if the text is well formed, false otherwise.
+ */
+bool CitationScanner::scan(std::string_view text, std::vector<CitationOccurrence>& occurrences, ScanStatus& status) const {
+    status = ScanStatus{};
+    bool& complete = status.complete;
+    std::size_t groupEnd = npos;  // The ']' closing the current Pandoc group, if any
+    for (std::size_t i = findTrigger(text, 0); i < text.size(); i = findTrigger(text, i)) {
+        std::size_t next = i + 1;
+        switch (text[i]) {
+        case '[': {
+            auto close = closingBracket(text, i);
+            if (close == npos) {
+                status.errorAt = i;
+                return false;
+            }
+            auto content = text.substr(i + 1, close - i - 1);
+            if ((options.syntaxes & Pandoc) && content.find('@') != npos) {
+                // Scan inside the group for its keys
+                groupEnd = close;
+                break;
+            }
+            occurrences.push_back(CitationOccurrence{i, close + 1, i + 1, content, Brackets});
+            next = close + 1;
+            break;
+        }
+        case ']':
+            if (i != groupEnd) {
+                status.errorAt = i;
+                return false;
+            }
+            groupEnd = npos;
+            break;
+        case '\\':
+            if (!scanLatex(text, i, occurrences, next, complete)) {
+                status.errorAt = i;
+                return false;
+            }
+            break;
+        case '@':
+            if (!scanPandoc(text, i, occurrences, next)) {
+                status.errorAt = i;
+                return false;
+            }
+            break;
+        case '`':
+        case '~': {
+            auto run = runLength(text, i);
+            next = i + run;
+            if (run >= 3 && atLineStart(text, i)) {
+                // An unclosed fence runs to the end of the text
+                auto end = skipFence(text, i, run);
+                if (end == npos) complete = false;
+                next = end == npos ? text.size() : end;
+            }
+            else if (text[i] == '`') {
+                // Unmatched backticks are literal text
+                auto end = skipCodeSpan(text, i, run);
+                if (end == npos) complete = false;
+                else next = end;
+            }
+            break;
+        }
+        case '<':
+            if (text.compare(i, 4, "<!--") == 0) {
+                // An unclosed comment runs to the end of the text
+                auto end = text.find("-->", i + 4);
+                if (end == npos) complete = false;
+                next = end == npos ? text.size() : end + 3;
+            }
+            break;
+        }
+        i = next;
+    }
+    return true;
+}
+
+/**
+ * @brief Parse a comma-separated list of syntax names, e.g. "brackets,latex,pandoc".
+ *
+ * @param list The list of names.
+ * @param syntaxes The combined CitationSyntax flags of the names.
+ * @return true if every name is known and the list is not empty, false otherwise.
+ */
+bool parseCitationSyntaxes(const std::string& list, unsigned& syntaxes) {
+    syntaxes = 0;
+    std::string_view rest = list;
+    while (true) {
+        auto comma = rest.find(',');
+        auto name = rest.substr(0, comma);
+        if (name == "brackets") syntaxes |= Brackets;
+        else if (name == "latex") syntaxes |= Latex;
+        else if (name == "pandoc") syntaxes |= Pandoc;
+        else return false;
+        if (comma == npos) break;
+        rest.remove_prefix(comma + 1);
+    }
+    return syntaxes != 0;
+}
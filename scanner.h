@@ -0,0 +1,123 @@
+#pragma once
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief The reference syntaxes a CitationScanner can recognise, combined as bit flags.
+ */
+enum CitationSyntax : unsigned {
+    Brackets = 1u << 0,  //!< Markdown-style "[id]".
+    Latex = 1u << 1,     //!< LaTeX "\cite{a,b}" and its variants such as \citep, \parencite or \nocite.
+    Pandoc = 1u << 2     //!< Pandoc "@key", "@{key}" and "[@a; @b]".
+};
+
+/**
+ * @brief Options of a CitationScanner.
+ */
+struct ScannerOptions {
+    unsigned syntaxes = Brackets;  //!< The syntaxes to recognise; the default is the original "[id]" only.
+    bool skipCode = false;         //!< Skip Markdown fenced code blocks, inline code spans and HTML comments.
+};
+
+/**
+ * @brief One citation key found in a text.
+ *
+ * A reference naming several keys, such as "\cite{a,b}", yields one occurrence
+ * per key; they share the byte range of the reference.
+ */
+struct CitationOccurrence {
+    std::size_t begin;      //!< Byte offset of the first byte of the reference, e.g. its '[' or '\'.
+    std::size_t end;        //!< Byte offset one past the last byte of the reference.
+    std::size_t keyOffset;  //!< Byte offset of the key.
+    std::string_view key;   //!< The key, viewing the scanned text.
+    CitationSyntax syntax;  //!< The syntax of the reference.
+};
+
+/**
+ * @brief How a scan ended, for scanning a text in pieces and for reporting errors.
+ */
+struct ScanStatus {
+    bool complete = true;                             //!< false if the end of the text cut off a construct.
+    std::size_t errorAt = std::string_view::npos;     //!< Byte offset of the reference that is not well formed, if any.
+};
+
+/**
+ * @brief CitationScanner finds citation keys in a text in a single pass.
+ *
+ * The scanner only stops at bytes that can start or end a reference of one of
+ * the configured syntaxes. These trigger bytes are found 16 at a time with
+ * SSE2; at each of them a small state machine for the syntax reads the
+ * reference and splits its keys. Keys are reported as views into the text, so
+ * scanning does not allocate besides growing the occurrence vector.
+ *
+ * With skipCode, backticks, tildes and '<' are triggers too, so Markdown code
+ * and HTML comments are recognised in the same pass and jumped over with a
+ * memchr-based search for their end; brackets in code such as "a[i]" are not
+ * references.
+ */
+class CitationScanner {
+public:
+    /**
+     * @brief Construct a new CitationScanner object.
+     *
+     * @param options The syntaxes to recognise.
+     */
+    explicit CitationScanner(ScannerOptions options = {});
+
+    /**
+     * @brief Find every citation key in a text.
+     *
+     * @param text The text to scan.
+     * @param occurrences A vector to append the occurrences to, in text order.
+     * @return true if the text is well formed, false if a bracket or brace is unbalanced,
+     *         or "[id]" references are nested.
+     */
+    bool scan(std::string_view text, std::vector<CitationOccurrence>& occurrences) const;
+
+    /**
+     * @brief Find every citation key in a text, and tell where it stopped.
+     *
+     * Scanning two texts one after the other gives the same occurrences as
+     * scanning their concatenation when the first ends with a newline and is
+     * complete, which lets a document be scanned in independent pieces.
+     *
+     * @param text The text to scan.
+     * @param occurrences A vector to append the occurrences to, in text order.
+     * @param status Set to whether the end of the text cut off a code block, code span, comment
+     *               or citation command, and to where the text stopped being well formed.
+     * @return true if the text is well formed, false otherwise.
+     */
+    bool scan(std::string_view text, std::vector<CitationOccurrence>& occurrences, ScanStatus& status) const;
+
+    /**
+     * @brief Get the options of the scanner.
+     */
+    const ScannerOptions& getOptions() const {
+        return options;
+    }
+
+private:
+    ScannerOptions options;
+    bool trigger[256] = {};   //!< Whether the scan stops at each byte value.
+    char triggers[8] = {};    //!< The trigger bytes, for the vector search.
+    std::size_t triggerCount = 0;
+
+    void addTrigger(char c);
+    std::size_t findTrigger(std::string_view text, std::size_t from) const;
+};
+
+/**
+ * @brief Parse a comma-separated list of syntax names, e.g. "brackets,latex,pandoc".
+ *
+ * @param list The list of names.
+ * @param syntaxes The combined CitationSyntax flags of the names.
+ * @return true if every name is known and the list is not empty, false otherwise.
+ */
+bool parseCitationSyntaxes(const std::string& list, unsigned& syntaxes);
+
+#endif
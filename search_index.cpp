@@ -0,0 +1,383 @@
+#include "search_index.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+#include "bloom_filter.h"
+#include "thread_pool.h"
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'M', 'S', 'R', 'C', 'H', 'I', '1'};
+
+// The fields whose words are indexed
+constexpr const char* kFields[] = {"author", "title", "journal", "publisher"};
+
+void putVarint(std::string& out, std::uint32_t n) {
+    while (n >= 0x80) {
+        out.push_back(static_cast<char>((n & 0x7f) | 0x80));
+        n >>= 7;
+    }
+    out.push_back(static_cast<char>(n));
+}
+
+std::uint32_t getVarint(const char*& p) {
+    std::uint32_t n = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        auto byte = static_cast<unsigned char>(*p++);
+        n |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) return n;
+    }
+}
+
+/**
+ * @brief Split the string fields of an entry into words, also inside arrays such as a list of authors.
+ */
+void addWords(const nlohmann::json& value, std::vector<std::string>& words) {
+    if (value.is_string()) {
+        SearchIndex::tokenize(value.get_ref<const std::string&>(), words);
+    }
+    else if (value.is_array()) {
+        for (const auto& element : value) addWords(element, words);
+    }
+}
+
+/**
+ * @brief Mix the strings of an indexed field into a hash, also inside arrays; other values count as absent.
+ */
+void hashField(const nlohmann::json& value, std::uint64_t& h) {
+    constexpr std::uint64_t kPrime = 1099511628211ull;
+    if (value.is_string()) {
+        h = (h ^ BloomFilter::hash(value.get_ref<const std::string&>())) * kPrime;
+    }
+    else if (value.is_array()) {
+        // The length keeps ["a", "b"] apart from "a" followed by a field "b"
+        h = (h ^ value.size()) * kPrime;
+        for (const auto& element : value) hashField(element, h);
+    }
+    else {
+        h *= kPrime;
+    }
+}
+
+template <typename T>
+void writeVector(std::ostream& output, const std::vector<T>& values) {
+    std::uint64_t count = values.size();
+    output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    output.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+template <typename T>
+bool readVector(std::istream& input, std::vector<T>& values) {
+    std::uint64_t count = 0;
+    if (!input.read(reinterpret_cast<char*>(&count), sizeof(count)) || count > SIZE_MAX / sizeof(T)) return false;
+    values.resize(static_cast<std::size_t>(count));
+    return static_cast<bool>(input.read(reinterpret_cast<char*>(values.data()),
+                                        static_cast<std::streamsize>(count * sizeof(T))));
+}
+
+} // namespace
+
+/**
+ * @brief Reads the positions of one word in order, and jumps ahead through the skip table.
+ */
+class SearchIndex::Cursor {
+public:
+    Cursor(const SearchIndex& index, const List& list)
+        : index{index}, firstBlock{list.skip}, blocks{(list.count + kBlockSize - 1) / kBlockSize}, count{list.count} {}
+
+    /**
+     * @brief Move to the first position not less than a target.
+     *
+     * @return false if there is none.
+     */
+    bool seek(std::uint32_t target) {
+        if (started && value >= target) return true;
+        // Gallop over the blocks whose first position is not greater than the target
+        auto block = started ? this->block : 0;
+        if (skip(block).first <= target) {
+            std::size_t step = 1;
+            while (block + step < blocks && skip(block + step).first <= target) {
+                block += step;
+                step *= 2;
+            }
+            for (; step > 0; step /= 2) {
+                if (block + step < blocks && skip(block + step).first <= target) block += step;
+            }
+        }
+        if (!started || block != this->block) enter(block);
+        while (value < target) {
+            if (!next()) return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Move to the next position.
+     *
+     * @return false at the end of the list.
+     */
+    bool next() {
+        if (!started) {
+            enter(0);
+            return true;
+        }
+        if (++inBlock < blockLength()) {
+            value += getVarint(p);
+            return true;
+        }
+        if (block + 1 >= blocks) return false;
+        enter(block + 1);
+        return true;
+    }
+
+    std::uint32_t get() const {
+        return value;
+    }
+
+private:
+    const SearchIndex& index;
+    std::size_t firstBlock;
+    std::size_t blocks;
+    std::size_t count;
+    std::size_t block = 0;
+    std::size_t inBlock = 0;
+    std::uint32_t value = 0;
+    const char* p = nullptr;
+    bool started = false;
+
+    const Skip& skip(std::size_t block) const {
+        return index.skips[firstBlock + block];
+    }
+
+    std::size_t blockLength() const {
+        return std::min(kBlockSize, count - block * kBlockSize);
+    }
+
+    void enter(std::size_t block) {
+        this->block = block;
+        inBlock = 0;
+        value = static_cast<std::uint32_t>(skip(block).first);
+        p = index.data.data() + skip(block).offset;
+        started = true;
+    }
+};
+
+/**
+ * @brief Index the entries of a library.
+ *
+ * The entries are cut into contiguous chunks whose words are collected in
+ * parallel, each into its own table. The tables are then merged word by word
+ * in sorted order; the chunks are in library order, so concatenating the lists
+ * of a word keeps its positions ascending.
+ *
+ * @param library The library to index.
+ */
+SearchIndex::SearchIndex(const Library& library) : fingerprint{fingerprintOf(library)} {
+    using Table = std::unordered_map<std::string, std::vector<std::uint32_t>>;
+    auto n = library.size();
+    auto chunkCount = std::max<std::size_t>(1, std::min(n / 4096 + 1, ThreadPool::instance().size() * 4));
+    std::vector<Table> tables(chunkCount);
+
+    parallelFor(0, chunkCount, 1, [&](std::size_t begin, std::size_t end) {
+        std::vector<std::string> words;
+        for (auto chunk = begin; chunk < end; chunk++) {
+            auto& table = tables[chunk];
+            for (auto position = n * chunk / chunkCount; position < n * (chunk + 1) / chunkCount; position++) {
+                const auto& entry = library.getEntry(position);
+                words.clear();
+                for (const auto* field : kFields) {
+                    auto found = entry.find(field);
+                    if (found != entry.end()) addWords(*found, words);
+                }
+                std::sort(words.begin(), words.end());
+                words.erase(std::unique(words.begin(), words.end()), words.end());
+                for (auto& word : words) table[std::move(word)].push_back(static_cast<std::uint32_t>(position));
+            }
+        }
+    });
+
+    std::vector<std::pair<std::string_view, std::size_t>> vocabulary;
+    for (const auto& table : tables) {
+        for (const auto& [word, positions] : table) vocabulary.emplace_back(word, 0);
+    }
+    std::sort(vocabulary.begin(), vocabulary.end());
+    vocabulary.erase(std::unique(vocabulary.begin(), vocabulary.end(),
+                                 [](const auto& a, const auto& b) { return a.first == b.first; }),
+                     vocabulary.end());
+    for (std::size_t i = 0; i < vocabulary.size(); i++) vocabulary[i].second = i;
+
+    lists.reserve(vocabulary.size());
+    std::vector<std::uint32_t> positions;
+    for (const auto& [word, rank] : vocabulary) {
+        positions.clear();
+        for (const auto& table : tables) {
+            auto found = table.find(std::string{word});
+            if (found != table.end()) positions.insert(positions.end(), found->second.begin(), found->second.end());
+        }
+        append(positions);
+    }
+    // The dictionary copies the words, so the tables can go
+    dictionary = PrefixIndex{std::move(vocabulary)};
+}
+
+/**
+ * @brief Encode the ascending positions of the next word.
+ */
+void SearchIndex::append(const std::vector<std::uint32_t>& positions) {
+    lists.push_back({positions.size(), skips.size()});
+    for (std::size_t i = 0; i < positions.size(); i++) {
+        if (i % kBlockSize == 0) {
+            skips.push_back({positions[i], data.size()});
+            continue;
+        }
+        putVarint(data, positions[i] - positions[i - 1]);
+    }
+}
+
+/**
+ * @brief Split a text into lowercase words of ASCII letters and digits, keeping other UTF-8 bytes.
+ *
+ * @param text The text to split.
+ * @param words A vector to append the words to, in text order.
+ */
+void SearchIndex::tokenize(std::string_view text, std::vector<std::string>& words) {
+    std::string word;
+    for (unsigned char c : text) {
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80) {
+            word.push_back(static_cast<char>(c));
+        }
+        else if (c >= 'A' && c <= 'Z') {
+            word.push_back(static_cast<char>(c - 'A' + 'a'));
+        }
+        else if (!word.empty()) {
+            words.push_back(std::move(word));
+            word.clear();
+        }
+    }
+    if (!word.empty()) words.push_back(std::move(word));
+}
+
+/**
+ * @brief Find the entries containing every word of a query.
+ *
+ * The words are intersected from the rarest: each candidate left is looked up
+ * in the next list with a forward seek, so a common word costs a jump per
+ * candidate rather than a pass over its list.
+ *
+ * @param query The query.
+ * @param positions A vector to store the positions of the matching entries, in library order.
+ * @return The number of matching entries.
+ */
+std::size_t SearchIndex::search(std::string_view query, std::vector<std::size_t>& positions) const {
+    std::vector<std::string> words;
+    tokenize(query, words);
+    std::vector<const List*> found;
+    for (const auto& word : words) {
+        auto rank = dictionary.find(word);
+        // A word that is in no entry leaves nothing to find
+        if (rank == PrefixIndex::npos) return 0;
+        found.push_back(&lists[rank]);
+    }
+    if (found.empty()) return 0;
+    std::sort(found.begin(), found.end(), [](const List* a, const List* b) { return a->count < b->count; });
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    std::vector<std::uint32_t> candidates;
+    candidates.reserve(found[0]->count);
+    Cursor rarest{*this, *found[0]};
+    while (rarest.next()) candidates.push_back(rarest.get());
+
+    for (std::size_t i = 1; i < found.size() && !candidates.empty(); i++) {
+        Cursor cursor{*this, *found[i]};
+        std::size_t kept = 0;
+        for (auto candidate : candidates) {
+            if (!cursor.seek(candidate)) break;
+            if (cursor.get() == candidate) candidates[kept++] = candidate;
+        }
+        candidates.resize(kept);
+    }
+
+    positions.assign(candidates.begin(), candidates.end());
+    return positions.size();
+}
+
+/**
+ * @brief Compute the fingerprint of a library.
+ *
+ * The entries are hashed in parallel blocks of a fixed size, whose hashes are
+ * combined in order, so the fingerprint does not depend on the number of workers.
+ *
+ * @param library The library.
+ * @return A hash of the number of entries, and of their IDs and indexed fields in order.
+ */
+std::uint64_t SearchIndex::fingerprintOf(const Library& library) {
+    constexpr std::uint64_t kPrime = 1099511628211ull;
+    constexpr std::size_t kBlock = 4096;
+    std::vector<std::uint64_t> blocks((library.size() + kBlock - 1) / kBlock);
+    parallelFor(0, blocks.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (auto block = begin; block < end; block++) {
+            std::uint64_t h = 0;
+            for (auto i = block * kBlock; i < std::min(library.size(), (block + 1) * kBlock); i++) {
+                h = (h ^ BloomFilter::hash(library.getId(i))) * kPrime;
+                const auto& entry = library.getEntry(i);
+                for (const auto* field : kFields) {
+                    auto found = entry.find(field);
+                    hashField(found != entry.end() ? *found : nlohmann::json{}, h);
+                }
+            }
+            blocks[block] = h;
+        }
+    });
+    std::uint64_t h = library.size();
+    for (auto block : blocks) h = (h ^ block) * kPrime;
+    return h;
+}
+
+/**
+ * @brief Write the index to a binary stream.
+ *
+ * @param output The stream to write to.
+ */
+void SearchIndex::serialize(std::ostream& output) const {
+    output.write(kMagic, sizeof(kMagic));
+    output.write(reinterpret_cast<const char*>(&fingerprint), sizeof(fingerprint));
+    dictionary.serialize(output);
+    writeVector(output, lists);
+    writeVector(output, skips);
+    std::uint64_t length = data.size();
+    output.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    output.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+/**
+ * @brief Read an index written by serialize().
+ *
+ * @param input The stream to read from.
+ * @return true if an index was read, false otherwise. The index is unchanged on failure.
+ */
+bool SearchIndex::deserialize(std::istream& input) {
+    char magic[sizeof(kMagic)];
+    if (!input.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) return false;
+
+    SearchIndex loaded;
+    std::uint64_t length = 0;
+    if (!input.read(reinterpret_cast<char*>(&loaded.fingerprint), sizeof(loaded.fingerprint))) return false;
+    if (!loaded.dictionary.deserialize(input)) return false;
+    if (!readVector(input, loaded.lists) || !readVector(input, loaded.skips)) return false;
+    if (!input.read(reinterpret_cast<char*>(&length), sizeof(length)) || length > SIZE_MAX / 2) return false;
+    loaded.data.resize(static_cast<std::size_t>(length));
+    if (length > 0 && !input.read(&loaded.data[0], static_cast<std::streamsize>(length))) return false;
+
+    // Every word has a list, and every list lies inside the skip table and the data
+    if (loaded.lists.size() != loaded.dictionary.size()) return false;
+    for (const auto& list : loaded.lists) {
+        if (list.count == 0 || list.skip + (list.count + kBlockSize - 1) / kBlockSize > loaded.skips.size()) return false;
+    }
+    for (const auto& skip : loaded.skips) {
+        if (skip.offset > loaded.data.size()) return false;
+    }
+    *this = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "library.h"
+#include "prefix_index.h"
+
+/**
+ * @brief SearchIndex is an inverted index of the words of a library, for finding entries by their content.
+ *
+ * The author, title, journal and publisher fields of every entry are split
+ * into lowercase words. Each word maps to the ascending positions of the entries
+ * containing it. The position lists are stored as varint-coded differences in
+ * blocks of 128, and the first position and offset of each block are kept in a
+ * skip table. A query returns the entries containing all of its words: the
+ * shortest list is decoded, and the others are only probed at the remaining
+ * candidates, jumping over the blocks that cannot hold them.
+ *
+ * The words are split in parallel, and the index can be written next to the
+ * library and read back, so it is only rebuilt when the library changes.
+ * Only the fields stored in the library file are indexed. The metadata of books
+ * and webpages would have to be fetched from the network.
+ */
+class SearchIndex {
+public:
+    /**
+     * @brief Construct an empty index.
+     */
+    SearchIndex() = default;
+
+    /**
+     * @brief Index the entries of a library.
+     *
+     * @param library The library to index.
+     */
+    explicit SearchIndex(const Library& library);
+
+    /**
+     * @brief Find the entries containing every word of a query.
+     *
+     * @param query The query; it is split into words like the fields.
+     * @param positions A vector to store the positions of the matching entries, in library order.
+     * @return The number of matching entries; 0 if the query has no words.
+     */
+    std::size_t search(std::string_view query, std::vector<std::size_t>& positions) const;
+
+    /**
+     * @brief Split a text into lowercase words of ASCII letters and digits, keeping other UTF-8 bytes.
+     *
+     * @param text The text to split.
+     * @param words A vector to append the words to, in text order.
+     */
+    static void tokenize(std::string_view text, std::vector<std::string>& words);
+
+    /**
+     * @brief Compute the fingerprint of a library, which identifies the index built from it.
+     *
+     * @param library The library.
+     * @return A hash of the number of entries, and of their IDs and indexed fields in order.
+     */
+    static std::uint64_t fingerprintOf(const Library& library);
+
+    /**
+     * @brief Get the fingerprint of the library the index was built from.
+     */
+    std::uint64_t getFingerprint() const {
+        return fingerprint;
+    }
+
+    /**
+     * @brief Get the number of distinct words.
+     */
+    std::size_t words() const {
+        return lists.size();
+    }
+
+    /**
+     * @brief Write the index to a binary stream.
+     *
+     * @param output The stream to write to.
+     */
+    void serialize(std::ostream& output) const;
+
+    /**
+     * @brief Read an index written by serialize().
+     *
+     * @param input The stream to read from.
+     * @return true if an index was read, false if the data is truncated or not an index.
+     */
+    bool deserialize(std::istream& input);
+
+private:
+    static constexpr std::size_t kBlockSize = 128;
+
+    /**
+     * @brief The first position of a block and the offset of its other positions in data.
+     */
+    struct Skip {
+        std::uint64_t first;
+        std::uint64_t offset;
+    };
+
+    /**
+     * @brief The number of positions of a word and its first block in skips.
+     */
+    struct List {
+        std::uint64_t count;
+        std::uint64_t skip;
+    };
+
+    class Cursor;
+
+    PrefixIndex dictionary;   //!< The words; the rank of a word is the index of its list.
+    std::vector<List> lists;
+    std::vector<Skip> skips;
+    std::string data;         //!< The varint-coded differences of the positions.
+    std::uint64_t fingerprint = 0;
+
+    void append(const std::vector<std::uint32_t>& positions);
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "suggest.h"
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace {
+
+/**
+ * @brief Find every key of a dictionary within an edit distance of a key, but the key itself.
+ *
+ * Row d of the table holds the distances between the first d bytes of the
+ * visited key and every prefix of the mistyped key; rows are stored one after
+ * the other, and the rows up to the prefix shared with the previous key are
+ * still valid.
+ *
+ * @param ids The dictionary of keys.
+ * @param key The key.
+ * @param bound The largest distance to accept.
+ * @param found A vector to append the distance and rank of each key found to.
+ */
+void findWithin(const PrefixIndex& ids, std::string_view key, std::size_t bound,
+                std::vector<std::pair<std::size_t, std::size_t>>& found) {
+    const std::size_t width = key.size() + 1;
+
+    std::vector<std::size_t> rows(width);
+    for (std::size_t j = 0; j < width; j++) rows[j] = j;
+    std::string previous;
+
+    ids.walk([&](std::size_t rank, std::string_view candidate) {
+        std::size_t depth = 0;
+        while (depth < previous.size() && depth < candidate.size() && previous[depth] == candidate[depth]) depth++;
+
+        bool rejected = false;
+        for (; depth < candidate.size(); depth++) {
+            if (rows.size() < (depth + 2) * width) rows.resize((depth + 2) * width);
+            const auto* above = &rows[depth * width];
+            auto* row = &rows[(depth + 1) * width];
+            auto c = candidate[depth];
+            row[0] = depth + 1;
+            auto best = row[0];
+            for (std::size_t j = 1; j < width; j++) {
+                auto cost = std::min({above[j] + 1, row[j - 1] + 1, above[j - 1] + (c == key[j - 1] ? 0 : 1)});
+                // A swap of the last two bytes
+                if (depth > 0 && j > 1 && c == key[j - 2] && candidate[depth - 1] == key[j - 1])
+                    cost = std::min(cost, rows[(depth - 1) * width + j - 2] + 1);
+                row[j] = cost;
+                best = std::min(best, cost);
+            }
+            if (best > bound) {
+                // Every longer key with this prefix is at least as far
+                depth++;
+                rejected = true;
+                break;
+            }
+        }
+        previous.assign(candidate.substr(0, depth));
+        if (rejected) return depth;
+
+        auto distance = rows[candidate.size() * width + key.size()];
+        if (distance > 0 && distance <= bound) found.emplace_back(distance, rank);
+        return candidate.size();
+    });
+}
+
+} // namespace
+
+/**
+ * @brief Find the keys of a dictionary closest to a mistyped key by edit distance.
+ *
+ * Most typos are a single edit, and a walk within one edit prunes much
+ * earlier than a walk within two, so the keys one edit away are looked for
+ * first, and the keys two edits away only when there are none.
+ *
+ * @param ids The dictionary of keys.
+ * @param key The key to find suggestions for.
+ * @param limit The maximum number of ranks to return.
+ * @param ranks A vector to append the ranks of the closest keys to, closest first.
+ */
+void suggestKeys(const PrefixIndex& ids, std::string_view key, std::size_t limit, std::vector<std::size_t>& ranks) {
+    if (ids.size() == 0 || limit == 0) return;
+    std::vector<std::pair<std::size_t, std::size_t>> found;  // (distance, rank)
+    findWithin(ids, key, 1, found);
+    if (found.empty() && key.size() > 4) findWithin(ids, key, 2, found);
+    std::sort(found.begin(), found.end());
+    for (std::size_t i = 0; i < found.size() && i < limit; i++) ranks.push_back(found[i].second);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#ifndef SUGGEST_H
+#define SUGGEST_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "prefix_index.h"
+
+/**
+ * @brief Find the keys of a dictionary closest to a mistyped key by edit distance.
+ *
+ * Insertions, deletions, substitutions and swaps of adjacent bytes count as one
+ * edit. The keys one edit away are suggested if there are any; otherwise the
+ * keys two edits away, unless the key has four bytes or fewer.
+ *
+ * The sorted keys are walked as a trie, computing one row of the edit distance
+ * table per byte of a key and reusing the rows of the prefix it shares with the
+ * key before. As soon as every entry of a row exceeds the bound, no key below
+ * that prefix can be close enough, and the walk jumps past all of them. The
+ * cost therefore depends on the number of prefixes close to the key, not on
+ * the size of the dictionary, and no index besides the dictionary is needed.
+ *
+ * @param ids The dictionary of keys.
+ * @param key The key to find suggestions for.
+ * @param limit The maximum number of ranks to return.
+ * @param ranks A vector to append the ranks of the closest keys to, closest first, ties by rank.
+ */
+void suggestKeys(const PrefixIndex& ids, std::string_view key, std::size_t limit, std::vector<std::size_t>& ranks);
+
+#endif
@@ -0,0 +1,253 @@
+#include "thread_pool.h"
+
+namespace {
+
+// The pool and worker index of the current thread, if it is a worker.
+thread_local ThreadPool* currentPool = nullptr;
+thread_local std::size_t currentIndex = 0;
+
+// Number of empty polls before an idle worker goes to sleep.
+constexpr int kSpinRounds = 64;
+
+std::uint64_t nextRandom(std::uint64_t& state) {
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+} // namespace
+
+WorkStealingDeque::WorkStealingDeque(std::int64_t capacity) {
+    std::int64_t size = 1;
+    while (size < capacity) size <<= 1;
+    buffers.push_back(std::make_unique<Buffer>(size));
+    buffer.store(buffers.back().get(), std::memory_order_relaxed);
+}
+
+WorkStealingDeque::Buffer* WorkStealingDeque::grow(Buffer* old, std::int64_t b, std::int64_t t) {
+    buffers.push_back(std::make_unique<Buffer>(old->capacity * 2));
+    Buffer* bigger = buffers.back().get();
+    for (std::int64_t i = t; i < b; i++) bigger->put(i, old->get(i));
+    buffer.store(bigger, std::memory_order_release);
+    return bigger;
+}
+
+void WorkStealingDeque::push(Task* task) {
+    std::int64_t b = bottom.load(std::memory_order_relaxed);
+    std::int64_t t = top.load(std::memory_order_acquire);
+    Buffer* a = buffer.load(std::memory_order_relaxed);
+    if (b - t > a->capacity - 1) a = grow(a, b, t);
+    a->put(b, task);
+    // Publishes the slot to thieves, which load bottom with acquire
+    bottom.store(b + 1, std::memory_order_release);
+}
+
+Task* WorkStealingDeque::pop() {
+    std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Buffer* a = buffer.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // Empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Task* task = a->get(b);
+    if (t == b) {
+        // Last task: race against thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            task = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+Task* WorkStealingDeque::steal() {
+    std::int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+
+    Buffer* a = buffer.load(std::memory_order_acquire);
+    Task* task = a->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return task;
+}
+
+/**
+ * @brief Construct a new ThreadPool object and start its workers.
+ *
+ * @param threadCount The number of worker threads; 0 uses the hardware concurrency.
+ */
+ThreadPool::ThreadPool(std::size_t threadCount) {
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    workers.reserve(threadCount);
+    for (std::size_t i = 0; i < threadCount; i++) workers.push_back(std::make_unique<Worker>());
+    for (std::size_t i = 0; i < threadCount; i++) {
+        workers[i]->thread = std::thread{[this, i] { workerLoop(i); }};
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock{sleepMutex};
+        sleepCondition.notify_all();
+    }
+    for (auto& worker : workers) worker->thread.join();
+}
+
+/**
+ * @brief Get the process-wide pool.
+ *
+ * The pool is intentionally never destroyed: docman may call std::exit() while
+ * tasks are still running, and joining workers from a static destructor would
+ * then block or deadlock.
+ */
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool* pool = new ThreadPool{};
+    return *pool;
+}
+
+void ThreadPool::submit(Task* task) {
+    if (currentPool == this) {
+        workers[currentIndex]->deque.push(task);
+    } else {
+        auto& inbox = workers[nextInbox.fetch_add(1, std::memory_order_relaxed) % workers.size()]->inbox;
+        std::lock_guard<std::mutex> lock{inbox.mutex};
+        inbox.tasks.push_back(task);
+    }
+    pending.fetch_add(1);
+    if (sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock{sleepMutex};
+        sleepCondition.notify_one();
+    }
+}
+
+/**
+ * @brief Find a task: first the own deque and inbox, then the deques and inboxes of others.
+ *
+ * @param self The index of the calling worker, or size() for threads outside the pool.
+ * @param seed The state of the caller's random victim selection.
+ * @return The task, or nullptr if none was found.
+ */
+Task* ThreadPool::findTask(std::size_t self, std::uint64_t& seed) {
+    Task* task = nullptr;
+    if (self < workers.size()) {
+        task = workers[self]->deque.pop();
+        if (!task) {
+            auto& inbox = workers[self]->inbox;
+            std::lock_guard<std::mutex> lock{inbox.mutex};
+            if (!inbox.tasks.empty()) {
+                task = inbox.tasks.front();
+                inbox.tasks.pop_front();
+            }
+        }
+    }
+
+    std::size_t count = workers.size();
+    std::size_t start = static_cast<std::size_t>(nextRandom(seed) % count);
+    for (std::size_t k = 0; k < count && !task; k++) {
+        std::size_t victim = (start + k) % count;
+        if (victim == self) continue;
+        task = workers[victim]->deque.steal();
+        if (!task) {
+            auto& inbox = workers[victim]->inbox;
+            std::unique_lock<std::mutex> lock{inbox.mutex, std::try_to_lock};
+            if (lock.owns_lock() && !inbox.tasks.empty()) {
+                task = inbox.tasks.front();
+                inbox.tasks.pop_front();
+            }
+        }
+    }
+
+    if (task) pending.fetch_sub(1);
+    return task;
+}
+
+void ThreadPool::execute(Task* task) {
+    std::unique_ptr<Task> owned{task};
+    owned->run();
+}
+
+bool ThreadPool::runPendingTask() {
+    thread_local std::uint64_t seed = 0x9e3779b97f4a7c15ull ^ reinterpret_cast<std::uintptr_t>(&seed);
+    std::size_t self = currentPool == this ? currentIndex : workers.size();
+    Task* task = findTask(self, seed);
+    if (!task) return false;
+    execute(task);
+    return true;
+}
+
+void ThreadPool::workerLoop(std::size_t index) {
+    currentPool = this;
+    currentIndex = index;
+    std::uint64_t seed = 0x2545f4914f6cdd1dull * (index + 1);
+
+    int idle = 0;
+    while (true) {
+        if (Task* task = findTask(index, seed)) {
+            execute(task);
+            idle = 0;
+            continue;
+        }
+        if (++idle < kSpinRounds) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock{sleepMutex};
+        if (stopping.load() && pending.load() == 0) return;
+        sleepers.fetch_add(1);
+        sleepCondition.wait(lock, [this] { return stopping.load() || pending.load() > 0; });
+        sleepers.fetch_sub(1);
+        idle = 0;
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void TaskGroup::run(std::function<void()> function) {
+    outstanding.fetch_add(1);
+    pool.submit(new Task{[this, function = std::move(function)] {
+        try {
+            function();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock{errorMutex};
+            if (!error) error = std::current_exception();
+        }
+        // Last access to the group: wait() may return and destroy it once the lock is released
+        std::lock_guard<std::mutex> lock{doneMutex};
+        outstanding.fetch_sub(1);
+        doneCondition.notify_all();
+    }});
+}
+
+void TaskGroup::wait() {
+    while (outstanding.load() > 0) {
+        if (pool.runPendingTask()) continue;
+        // Nothing is runnable here, so the rest of the group is running on other
+        // threads: sleep until one of its tasks finishes, then look for work again
+        std::unique_lock<std::mutex> lock{doneMutex};
+        auto remaining = outstanding.load();
+        if (remaining > 0) doneCondition.wait(lock, [&] { return outstanding.load() != remaining; });
+    }
+    // The last task signals under the lock; wait until it has left before the group may go away
+    { std::lock_guard<std::mutex> lock{doneMutex}; }
+    std::exception_ptr thrown;
+    {
+        std::lock_guard<std::mutex> lock{errorMutex};
+        std::swap(thrown, error);
+    }
+    if (thrown) std::rethrow_exception(thrown);
+}
@@ -0,0 +1,291 @@
+#pragma once
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A unit of work scheduled on a ThreadPool.
+ */
+struct Task {
+    std::function<void()> run;  //!< The work to do.
+};
+
+/**
+ * @brief A Chase-Lev work-stealing deque of tasks.
+ *
+ * The owning worker pushes and pops tasks at the bottom without locks, while
+ * other workers steal from the top with a single compare-and-swap. The ring
+ * buffer grows when full; retired buffers are kept until the deque is
+ * destroyed, because a concurrent thief may still be reading from them.
+ */
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(std::int64_t capacity = 256);
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    /**
+     * @brief Push a task at the bottom. Only the owning worker may call this.
+     */
+    void push(Task* task);
+
+    /**
+     * @brief Pop the most recently pushed task. Only the owning worker may call this.
+     *
+     * @return The task, or nullptr if the deque is empty.
+     */
+    Task* pop();
+
+    /**
+     * @brief Steal the oldest task. Any thread may call this.
+     *
+     * @return The task, or nullptr if the deque is empty or the steal lost a race.
+     */
+    Task* steal();
+
+    /**
+     * @brief Check whether the deque appears empty.
+     */
+    bool empty() const {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Buffer {
+        std::int64_t capacity;
+        std::unique_ptr<std::atomic<Task*>[]> slots;
+
+        explicit Buffer(std::int64_t capacity) : capacity{capacity}, slots{new std::atomic<Task*>[capacity]} {}
+
+        Task* get(std::int64_t i) const {
+            return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(std::int64_t i, Task* task) {
+            slots[i & (capacity - 1)].store(task, std::memory_order_relaxed);
+        }
+    };
+
+    alignas(64) std::atomic<std::int64_t> top{0};
+    alignas(64) std::atomic<std::int64_t> bottom{0};
+    alignas(64) std::atomic<Buffer*> buffer;
+    std::vector<std::unique_ptr<Buffer>> buffers;  //!< All buffers ever used, owned by the deque.
+
+    Buffer* grow(Buffer* old, std::int64_t b, std::int64_t t);
+};
+
+/**
+ * @brief A work-stealing thread pool shared by the parallel stages of docman.
+ *
+ * Every worker owns a WorkStealingDeque. Tasks spawned by a worker go to its
+ * own deque and are popped in LIFO order for locality; idle workers steal the
+ * oldest task of a randomly chosen victim. Tasks submitted from outside the
+ * pool go to small per-worker inboxes chosen round-robin, so there is no
+ * single global queue. Threads waiting for a TaskGroup execute pending tasks
+ * instead of blocking, which makes nested parallelism safe, and sleep only
+ * when no task is runnable.
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief Construct a new ThreadPool object.
+     *
+     * @param threadCount The number of worker threads; 0 uses the hardware concurrency.
+     */
+    explicit ThreadPool(std::size_t threadCount = 0);
+
+    /**
+     * @brief Stop and join all workers. Pending tasks are run before the workers exit.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Get the process-wide pool, created on first use.
+     */
+    static ThreadPool& instance();
+
+    /**
+     * @brief Schedule a task. The pool takes ownership of it.
+     *
+     * @param task The task to run.
+     */
+    void submit(Task* task);
+
+    /**
+     * @brief Run one pending task on the calling thread, if there is any.
+     *
+     * @return true if a task was run, false if none was found.
+     */
+    bool runPendingTask();
+
+    /**
+     * @brief Get the number of worker threads.
+     */
+    std::size_t size() const {
+        return workers.size();
+    }
+
+private:
+    struct Inbox {
+        std::mutex mutex;
+        std::deque<Task*> tasks;
+    };
+
+    struct Worker {
+        WorkStealingDeque deque;
+        Inbox inbox;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<std::size_t> nextInbox{0};
+    std::atomic<std::size_t> pending{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<std::size_t> sleepers{0};
+
+    void workerLoop(std::size_t index);
+    Task* findTask(std::size_t self, std::uint64_t& seed);
+    void execute(Task* task);
+};
+
+/**
+ * @brief A set of tasks that can be waited for together.
+ *
+ * The first exception thrown by a task of the group is captured and rethrown
+ * by wait(); later exceptions are dropped.
+ */
+class TaskGroup {
+public:
+    /**
+     * @brief Construct a new TaskGroup object on a pool.
+     *
+     * @param pool The pool that runs the tasks.
+     */
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::instance()) : pool{pool} {}
+
+    /**
+     * @brief Wait for the outstanding tasks, ignoring their exceptions.
+     */
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    /**
+     * @brief Schedule a function as a task of this group.
+     *
+     * @param function The function to run.
+     */
+    void run(std::function<void()> function);
+
+    /**
+     * @brief Wait until every task of the group has finished, running pending tasks meanwhile.
+     *
+     * When no task is runnable, the caller sleeps until a task of the group finishes.
+     *
+     * @throws The first exception thrown by a task of the group.
+     */
+    void wait();
+
+private:
+    ThreadPool& pool;
+    std::atomic<std::size_t> outstanding{0};
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::mutex errorMutex;
+    std::exception_ptr error;
+};
+
+/**
+ * @brief Call body(chunkBegin, chunkEnd) for contiguous chunks covering [begin, end) in parallel.
+ *
+ * The range is cut into at most four chunks per worker, each at least grain
+ * elements long. Ranges of a single chunk run on the calling thread.
+ *
+ * @param begin The first index.
+ * @param end One past the last index.
+ * @param grain The minimum number of indices per chunk.
+ * @param body The function to call for each chunk.
+ *
+ * @throws The first exception thrown by body.
+ */
+template <typename Body>
+void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, Body&& body) {
+    if (end <= begin) return;
+    std::size_t n = end - begin;
+    auto& pool = ThreadPool::instance();
+    std::size_t chunks = std::min((n + std::max<std::size_t>(grain, 1) - 1) / std::max<std::size_t>(grain, 1),
+                                  pool.size() * 4);
+    if (chunks <= 1) {
+        body(begin, end);
+        return;
+    }
+    TaskGroup group{pool};
+    for (std::size_t c = 1; c < chunks; c++) {
+        std::size_t chunkBegin = begin + n * c / chunks, chunkEnd = begin + n * (c + 1) / chunks;
+        group.run([&body, chunkBegin, chunkEnd] { body(chunkBegin, chunkEnd); });
+    }
+    // The first chunk runs on the calling thread
+    std::exception_ptr error;
+    try {
+        body(begin, begin + n / chunks);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    group.wait();
+    if (error) std::rethrow_exception(error);
+}
+
+/**
+ * @brief Reduce [begin, end) in parallel.
+ *
+ * Each chunk is mapped to a partial result with map(chunkBegin, chunkEnd), and the
+ * partial results are folded left to right with combine, starting from identity.
+ * The order of combination is fixed, so the result is deterministic even if
+ * combine is only associative.
+ *
+ * @param begin The first index.
+ * @param end One past the last index.
+ * @param grain The minimum number of indices per chunk.
+ * @param identity The initial value of the fold.
+ * @param map The function computing the partial result of a chunk.
+ * @param combine The function combining two partial results.
+ * @return The combined result.
+ */
+template <typename T, typename Map, typename Combine>
+T parallelReduce(std::size_t begin, std::size_t end, std::size_t grain, T identity, Map&& map, Combine&& combine) {
+    if (end <= begin) return identity;
+    std::size_t n = end - begin;
+    std::size_t chunks = std::min((n + std::max<std::size_t>(grain, 1) - 1) / std::max<std::size_t>(grain, 1),
+                                  ThreadPool::instance().size() * 4);
+    chunks = std::max<std::size_t>(chunks, 1);
+    std::vector<T> partial(chunks, identity);
+    parallelFor(0, chunks, 1, [&](std::size_t first, std::size_t last) {
+        for (std::size_t c = first; c < last; c++) {
+            partial[c] = map(begin + n * c / chunks, begin + n * (c + 1) / chunks);
+        }
+    });
+    T result = std::move(identity);
+    for (auto& value : partial) result = combine(std::move(result), std::move(value));
+    return result;
+}
+
+#endif
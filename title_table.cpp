@@ -0,0 +1,264 @@
+#include "title_table.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "bloom_filter.h"
+#include "html_title.h"
+#include "mapped_file.h"
+#include "metadata.h"
+#include "thread_pool.h"
+#include "url.h"
+
+namespace {
+
+using Row = RecordTable::Row;
+
+/**
+ * @brief A page read from an archive: its URL and its HTML, views into the archive.
+ */
+struct Page {
+    std::string_view uri;
+    std::string_view html;
+};
+
+/**
+ * @brief The titles of one chunk of the pages of an archive.
+ */
+struct Chunk {
+    std::vector<Row> rows;
+    std::vector<std::pair<std::size_t, std::size_t>> built;  // The records of the rows in arena
+    std::string arena;
+    std::size_t untitled = 0;
+};
+
+bool equalsNoCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (std::size_t i = 0; i < a.size(); i++) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Get the value of a header from a block of "Name: value" lines, ignoring the case of the name.
+ *
+ * @return The value without surrounding whitespace, or an empty view if the header is missing.
+ */
+std::string_view headerValue(std::string_view headers, std::string_view name) {
+    std::size_t from = 0;
+    while (from < headers.size()) {
+        auto end = std::min(headers.find('\n', from), headers.size());
+        auto line = headers.substr(from, end - from);
+        from = end + 1;
+        if (line.size() <= name.size() || line[name.size()] != ':' || !equalsNoCase(line.substr(0, name.size()), name))
+            continue;
+        auto value = line.substr(name.size() + 1);
+        auto begin = value.find_first_not_of(" \t");
+        if (begin == std::string_view::npos) return {};
+        return value.substr(begin, value.find_last_not_of(" \t\r") - begin + 1);
+    }
+    return {};
+}
+
+/**
+ * @brief Find the end of a block of headers, after the blank line that ends it.
+ *
+ * @return The position after the blank line, or npos if there is none.
+ */
+std::size_t endOfHeaders(std::string_view text) {
+    for (auto at = text.find('\n'); at != std::string_view::npos; at = text.find('\n', at + 1)) {
+        if (at + 1 < text.size() && text[at + 1] == '\n') return at + 2;
+        if (at + 2 < text.size() && text[at + 1] == '\r' && text[at + 2] == '\n') return at + 3;
+    }
+    return std::string_view::npos;
+}
+
+bool isHtml(std::string_view contentType) {
+    std::string lower{contentType.substr(0, contentType.find(';'))};
+    for (auto& c : lower) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return lower.find("html") != std::string::npos;
+}
+
+/**
+ * @brief Collect the HTML pages of a WARC file.
+ *
+ * The records are walked by their Content-Length, so the pages themselves
+ * are not read here.
+ *
+ * @param text The contents of the file.
+ * @param filename The path to the file, for errors.
+ * @param pages A vector to append the pages to, in file order.
+ */
+void readWarc(std::string_view text, const std::string& filename, std::vector<Page>& pages) {
+    std::size_t position = 0;
+    while ((position = text.find_first_not_of("\r\n", position)) != std::string_view::npos) {
+        if (text.compare(position, 5, "WARC/") != 0)
+            throw std::runtime_error(filename + ": no WARC record at offset " + std::to_string(position));
+        auto rest = text.substr(position);
+        auto body = endOfHeaders(rest);
+        auto lengthText = body == std::string_view::npos ? std::string_view{} : headerValue(rest.substr(0, body), "Content-Length");
+        std::uint64_t length = 0;
+        auto parsed = std::from_chars(lengthText.data(), lengthText.data() + lengthText.size(), length);
+        if (lengthText.empty() || parsed.ec != std::errc{} || length > rest.size() - body)
+            throw std::runtime_error(filename + ": truncated WARC record at offset " + std::to_string(position));
+        auto headers = rest.substr(0, body);
+        auto block = rest.substr(body, static_cast<std::size_t>(length));
+        position += body + static_cast<std::size_t>(length);
+
+        auto type = headerValue(headers, "WARC-Type");
+        auto uri = headerValue(headers, "WARC-Target-URI");
+        // The examples of WARC 1.0 put the URI in angle brackets
+        if (uri.size() >= 2 && uri.front() == '<' && uri.back() == '>') uri = uri.substr(1, uri.size() - 2);
+        if (uri.empty()) continue;
+
+        if (type == "resource") {
+            if (isHtml(headerValue(headers, "Content-Type"))) pages.push_back({uri, block});
+        }
+        else if (type == "response") {
+            // The block is the HTTP response, e.g. "HTTP/1.1 200 OK", its headers and the page
+            auto payload = endOfHeaders(block);
+            if (payload == std::string_view::npos) continue;
+            auto http = block.substr(0, payload);
+            auto space = http.find(' ');
+            if (http.compare(0, 5, "HTTP/") != 0 || space == std::string_view::npos || http.compare(space + 1, 3, "200") != 0)
+                continue;
+            auto encoding = headerValue(http, "Content-Encoding");
+            if (!encoding.empty() && !equalsNoCase(encoding, "identity")) continue;
+            auto contentType = headerValue(http, "Content-Type");
+            if (!contentType.empty() && !isHtml(contentType)) continue;
+            pages.push_back({uri, block.substr(payload)});
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Get the path of the table in the metadata store directory.
+ */
+std::string TitleTable::defaultPath() {
+    return metadataStoreDirectory() + "/title.table";
+}
+
+/**
+ * @brief Open a table file.
+ *
+ * @param path The path to the table.
+ * @return true if the table was opened, false otherwise.
+ */
+bool TitleTable::open(const std::string& path) {
+    return table.open(path);
+}
+
+/**
+ * @brief Find the title of a webpage.
+ *
+ * A record is the canonical URL, a newline and the title; a record of another
+ * URL with the same hash is a miss.
+ *
+ * @param canonical The canonical URL.
+ * @param title Receives the title.
+ * @return true if the URL is in the table, false otherwise.
+ */
+bool TitleTable::find(const std::string& canonical, std::string& title) const {
+    std::string_view record;
+    if (!table.find(BloomFilter::hash(canonical), record)) return false;
+    if (record.size() <= canonical.size() || record.compare(0, canonical.size(), canonical) != 0 ||
+        record[canonical.size()] != '\n')
+        return false;
+    title.assign(record.substr(canonical.size() + 1));
+    return true;
+}
+
+/**
+ * @brief Test whether a file is a web archive that import() reads.
+ *
+ * @param filename The path to the file.
+ */
+bool TitleTable::isArchive(const std::string& filename) {
+    return filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".warc") == 0;
+}
+
+/**
+ * @brief Merge the titles of the pages of web archives into a table file.
+ *
+ * Each archive is mapped and its records are walked to collect the pages.
+ * The pages are then cut into chunks whose titles are extracted in parallel,
+ * each into the arena of its chunk. The rows of the old table come first,
+ * then each chunk is a run of RecordTable::write(), so the last page of a URL
+ * wins.
+ *
+ * @param archives The paths to the archives.
+ * @param path The path to the table; it is created or replaced.
+ * @return The counters of the import.
+ */
+TitleTable::ImportStats TitleTable::import(const std::vector<std::string>& archives, const std::string& path) {
+    ImportStats stats;
+    std::vector<std::vector<Row>> runs;
+    std::list<std::string> arenas;
+
+    // The old table comes first so that the archives replace its records
+    RecordTable old;
+    if (old.open(path)) runs.push_back(old.rows());
+
+    for (const auto& archive : archives) {
+        MappedFile file;
+        if (!file.open(archive)) throw std::runtime_error("cannot open " + archive);
+        std::vector<Page> pages;
+        readWarc(file.view(), archive, pages);
+        stats.pages += pages.size();
+
+        auto chunkCount = std::max<std::size_t>(1, std::min(pages.size() / 256 + 1, ThreadPool::instance().size() * 4));
+        std::vector<Chunk> chunks(chunkCount);
+        parallelFor(0, chunkCount, 1, [&](std::size_t begin, std::size_t end) {
+            std::string uri, canonical, title;
+            for (auto c = begin; c < end; c++) {
+                auto& chunk = chunks[c];
+                for (auto i = pages.size() * c / chunkCount; i < pages.size() * (c + 1) / chunkCount; i++) {
+                    if (!extractHtmlTitle(pages[i].html, title)) {
+                        chunk.untitled++;
+                        continue;
+                    }
+                    uri.assign(pages[i].uri);
+                    if (!normalizeUrl(uri, canonical)) canonical = uri;
+                    auto offset = chunk.arena.size();
+                    chunk.arena += canonical;
+                    chunk.arena += '\n';
+                    chunk.arena += title;
+                    chunk.built.emplace_back(offset, chunk.arena.size() - offset);
+                    chunk.rows.push_back({BloomFilter::hash(canonical), {}});
+                }
+            }
+        });
+
+        for (auto& chunk : chunks) {
+            // The views into the arena are taken once it has stopped growing and moving
+            const auto& arena = arenas.emplace_back(std::move(chunk.arena));
+            for (std::size_t i = 0; i < chunk.rows.size(); i++) {
+                chunk.rows[i].record = std::string_view{arena}.substr(chunk.built[i].first, chunk.built[i].second);
+            }
+            stats.untitled += chunk.untitled;
+            runs.push_back(std::move(chunk.rows));
+        }
+    }
+    stats.records = RecordTable::write(std::move(runs), path);
+    return stats;
+}
+
+/**
+ * @brief Get the table imported into the metadata store, opened on first use.
+ *
+ * @return The table; it is empty if nothing has been imported.
+ */
+const TitleTable& titleTable() {
+    static TitleTable table;
+    static std::once_flag opened;
+    std::call_once(opened, [] { table.open(TitleTable::defaultPath()); });
+    return table;
+}
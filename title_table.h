@@ -0,0 +1,95 @@
+#pragma once
+#ifndef TITLE_TABLE_H
+#define TITLE_TABLE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "record_table.h"
+
+/**
+ * @brief TitleTable is a table of webpage titles by URL, read in place from a mapped file.
+ *
+ * The table is built from web archives by import(): the pages are read from
+ * the WARC records, and their titles are extracted by extractHtmlTitle(). It
+ * is a RecordTable keyed by a 64-bit hash of the canonical URL, whose records
+ * hold the URL, so that a lookup can tell a collision from a hit, and the title.
+ */
+class TitleTable {
+public:
+    /**
+     * @brief Get the path of the table in the metadata store directory.
+     */
+    static std::string defaultPath();
+
+    /**
+     * @brief Counters of an import.
+     */
+    struct ImportStats {
+        std::size_t pages = 0;     //!< The HTML pages read from the archives.
+        std::size_t untitled = 0;  //!< The pages without a title.
+        std::size_t records = 0;   //!< The records in the new table, including those kept from the old one.
+    };
+
+    /**
+     * @brief Open a table file.
+     *
+     * @param path The path to the table.
+     * @return true if the table was opened, false if it is missing or not a table; the table is then empty.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Find the title of a webpage.
+     *
+     * @param canonical The URL in the canonical form of normalizeUrl().
+     * @param title Receives the title.
+     * @return true if the URL is in the table, false otherwise.
+     */
+    bool find(const std::string& canonical, std::string& title) const;
+
+    /**
+     * @brief Get the number of records.
+     */
+    std::size_t size() const {
+        return table.size();
+    }
+
+    /**
+     * @brief Test whether a file is a web archive that import() reads, i.e. its name ends with ".warc".
+     *
+     * @param filename The path to the file.
+     */
+    static bool isArchive(const std::string& filename);
+
+    /**
+     * @brief Merge the titles of the pages of web archives into a table file.
+     *
+     * The archives are uncompressed WARC files. The "response" records with a
+     * successful HTML response and the "resource" records of HTML are read;
+     * a response with a Content-Encoding other than identity is skipped. The
+     * title of a page replaces that of its URL from the old table and from
+     * earlier records.
+     *
+     * @param archives The paths to the archives.
+     * @param path The path to the table; it is created or replaced.
+     * @return The counters of the import.
+     *
+     * @throws std::runtime_error if an archive cannot be read or is not a WARC file,
+     *         or the table cannot be written.
+     */
+    static ImportStats import(const std::vector<std::string>& archives, const std::string& path);
+
+private:
+    RecordTable table;
+};
+
+/**
+ * @brief Get the process-wide title table, opened from the metadata store directory on first use.
+ *
+ * @return The table, empty if none was imported.
+ */
+const TitleTable& titleTable();
+
+#endif
@@ -0,0 +1,180 @@
+#pragma once
+#ifndef URI_HPP
+#define URI_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define URI_HAVE_SSE2 1
+#endif
+
+namespace uri_detail {
+
+/**
+ * @brief Classification of a single byte for percent-encoding.
+ *
+ * Every byte falls into exactly one class, which also determines how many
+ * bytes it occupies in the encoded output (1, 1 and 3 respectively).
+ */
+enum ByteClass : std::uint8_t {
+    Unreserved = 0, //!< Copied verbatim: ALPHA / DIGIT / "-" / "." / "_" / "~".
+    Space = 1,      //!< Encoded as '+'.
+    Escaped = 2     //!< Encoded as "%xx".
+};
+
+constexpr std::array<std::uint8_t, 256> makeByteClassTable() {
+    std::array<std::uint8_t, 256> table{};
+    for (int c = 0; c < 256; c++) {
+        bool unreserved = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                          c == '-' || c == '_' || c == '.' || c == '~';
+        table[c] = unreserved ? Unreserved : (c == ' ' ? Space : Escaped);
+    }
+    return table;
+}
+
+constexpr std::array<std::int8_t, 256> makeHexValueTable() {
+    std::array<std::int8_t, 256> table{};
+    for (int c = 0; c < 256; c++) {
+        if (c >= '0' && c <= '9') table[c] = static_cast<std::int8_t>(c - '0');
+        else if (c >= 'a' && c <= 'f') table[c] = static_cast<std::int8_t>(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') table[c] = static_cast<std::int8_t>(c - 'A' + 10);
+        else table[c] = -1;
+    }
+    return table;
+}
+
+constexpr std::array<std::uint8_t, 256> kByteClass = makeByteClassTable();
+constexpr std::array<std::int8_t, 256> kHexValue = makeHexValueTable();
+constexpr std::uint8_t kEncodedWidth[3] = {1, 1, 3};
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+/**
+ * @brief Return the length of the run of unreserved bytes starting at p.
+ *
+ * With SSE2 available, 16 bytes are classified per step; the scalar table
+ * lookup handles the tail and the first reserved byte of a block.
+ */
+inline std::size_t unreservedRun(const unsigned char* p, std::size_t n) {
+    std::size_t i = 0;
+#ifdef URI_HAVE_SSE2
+    const __m128i digitLo = _mm_set1_epi8('0' - 1), digitHi = _mm_set1_epi8('9' + 1);
+    const __m128i upperLo = _mm_set1_epi8('A' - 1), upperHi = _mm_set1_epi8('Z' + 1);
+    const __m128i lowerLo = _mm_set1_epi8('a' - 1), lowerHi = _mm_set1_epi8('z' + 1);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        // Bytes >= 0x80 compare as negative and therefore never match a range.
+        __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, digitLo), _mm_cmplt_epi8(v, digitHi));
+        ok = _mm_or_si128(ok, _mm_and_si128(_mm_cmpgt_epi8(v, upperLo), _mm_cmplt_epi8(v, upperHi)));
+        ok = _mm_or_si128(ok, _mm_and_si128(_mm_cmpgt_epi8(v, lowerLo), _mm_cmplt_epi8(v, lowerHi)));
+        ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+        ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+        ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('~')));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(ok));
+        if (mask != 0xFFFF) {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long bit;
+            _BitScanForward(&bit, ~mask);
+            return i + bit;
+#else
+            return i + static_cast<std::size_t>(__builtin_ctz(~mask));
+#endif
+        }
+    }
+#endif
+    while (i < n && kByteClass[p[i]] == Unreserved) i++;
+    return i;
+}
+
+} // namespace uri_detail
+
+/**
+ * @brief Percent-encode a string for use as a single URI path component.
+ *
+ * Unreserved characters are copied, spaces become '+', and every other byte
+ * is written as '%' followed by two lowercase hex digits. Bytes are treated
+ * as unsigned, so UTF-8 sequences encode byte by byte (e.g. "%e4%b8%ad").
+ *
+ * The output size is computed up front, so the result is allocated once.
+ *
+ * @param s The string to encode.
+ * @return The encoded string.
+ */
+inline std::string encodeUriComponent(const std::string& s) {
+    using namespace uri_detail;
+    const auto* in = reinterpret_cast<const unsigned char*>(s.data());
+    const std::size_t n = s.size();
+
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < n;) {
+        std::size_t run = unreservedRun(in + i, n - i);
+        size += run;
+        i += run;
+        if (i < n) size += kEncodedWidth[kByteClass[in[i++]]];
+    }
+    if (size == n) return s;
+
+    std::string encoded(size, '\0');
+    char* out = &encoded[0];
+    for (std::size_t i = 0; i < n;) {
+        std::size_t run = unreservedRun(in + i, n - i);
+        for (std::size_t k = 0; k < run; k++) *out++ = static_cast<char>(in[i + k]);
+        i += run;
+        if (i == n) break;
+        unsigned char c = in[i++];
+        if (kByteClass[c] == Space) {
+            *out++ = '+';
+        } else {
+            *out++ = '%';
+            *out++ = kHexDigits[c >> 4];
+            *out++ = kHexDigits[c & 0xF];
+        }
+    }
+    return encoded;
+}
+
+/**
+ * @brief Decode a percent-encoded URI component.
+ *
+ * This is the inverse of encodeUriComponent(): '+' becomes a space and "%xx"
+ * (either hex case) becomes the corresponding byte. A '%' that is not followed
+ * by two hex digits is kept literally rather than rejected.
+ *
+ * @param s The encoded string.
+ * @param plusIsSpace Whether '+' stands for a space, as in a query; in a path it is literal.
+ * @return The decoded string.
+ */
+inline std::string decodeUriComponent(const std::string& s, bool plusIsSpace = true) {
+    using namespace uri_detail;
+    const auto* in = reinterpret_cast<const unsigned char*>(s.data());
+    const std::size_t n = s.size();
+
+    // Decoding never grows the string, so one allocation is enough.
+    std::string decoded(n, '\0');
+    char* out = &decoded[0];
+    for (std::size_t i = 0; i < n;) {
+        std::size_t run = unreservedRun(in + i, n - i);
+        for (std::size_t k = 0; k < run; k++) *out++ = static_cast<char>(in[i + k]);
+        i += run;
+        if (i == n) break;
+        unsigned char c = in[i];
+        if (c == '+' && plusIsSpace) {
+            *out++ = ' ';
+            i++;
+        } else if (c == '%' && i + 2 < n && kHexValue[in[i + 1]] >= 0 && kHexValue[in[i + 2]] >= 0) {
+            *out++ = static_cast<char>((kHexValue[in[i + 1]] << 4) | kHexValue[in[i + 2]]);
+            i += 3;
+        } else {
+            *out++ = static_cast<char>(c);
+            i++;
+        }
+    }
+    decoded.resize(static_cast<std::size_t>(out - decoded.data()));
+    return decoded;
+}
+
+#endif
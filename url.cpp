@@ -0,0 +1,207 @@
+#include "url.h"
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+char toLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+char toUpper(char c) {
+    return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool isHex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// Append s[begin, end) to out, uppercasing the hex digits of every "%xx" escape.
+void appendEscaped(std::string& out, const std::string& s, std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; i++) {
+        if (s[i] == '%' && i + 2 < end && isHex(s[i + 1]) && isHex(s[i + 2])) {
+            out += '%';
+            out += toUpper(s[i + 1]);
+            out += toUpper(s[i + 2]);
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+}
+
+// Return the default port of a (lowercase) scheme, or nullptr if it has none.
+const char* defaultPort(const std::string& scheme) {
+    if (scheme == "http") return "80";
+    if (scheme == "https") return "443";
+    if (scheme == "ftp") return "21";
+    return nullptr;
+}
+
+// Return true if the query parameter name is matched by one of the filters.
+bool isDropped(const std::string& s, std::size_t begin, std::size_t end, const std::vector<std::string>& filters) {
+    std::size_t length = end - begin;
+    for (auto& filter : filters) {
+        if (!filter.empty() && filter.back() == '*') {
+            std::size_t prefix = filter.size() - 1;
+            if (length >= prefix && s.compare(begin, prefix, filter, 0, prefix) == 0) return true;
+        } else if (length == filter.size() && s.compare(begin, length, filter) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Remove "." and ".." segments from an absolute path (RFC 3986, section 5.2.4).
+std::string removeDotSegments(const std::string& path) {
+    if (path.find("/.") == std::string::npos) return path;
+    std::vector<std::pair<std::size_t, std::size_t>> segments;
+    std::size_t i = 1;
+    bool trailing = false;
+    while (i <= path.size()) {
+        std::size_t next = path.find('/', i);
+        if (next == std::string::npos) next = path.size();
+        std::size_t length = next - i;
+        trailing = false;
+        if (length == 1 && path[i] == '.') {
+            trailing = true;
+        } else if (length == 2 && path[i] == '.' && path[i + 1] == '.') {
+            if (!segments.empty()) segments.pop_back();
+            trailing = true;
+        } else {
+            segments.emplace_back(i, length);
+        }
+        i = next + 1;
+    }
+    std::string result;
+    result.reserve(path.size());
+    for (auto& segment : segments) {
+        result += '/';
+        result.append(path, segment.first, segment.second);
+    }
+    if (result.empty() || trailing) result += '/';
+    return result;
+}
+
+} // namespace
+
+/**
+ * @brief Canonicalize a URL for request deduplication and cache keying.
+ *
+ * The URL is split once into scheme, authority, path, query and fragment;
+ * each part is then normalized and appended to a single reserved buffer.
+ *
+ * @param url The URL as written in the library.
+ * @param canonical Receives the canonical URL.
+ * @param options The normalization options.
+ * @return true if the URL could be normalized, false otherwise.
+ */
+bool normalizeUrl(const std::string& url, std::string& canonical, const UrlNormalizeOptions& options) {
+    // Trim surrounding whitespace
+    std::size_t begin = 0, end = url.size();
+    while (begin < end && isSpace(url[begin])) begin++;
+    while (end > begin && isSpace(url[end - 1])) end--;
+
+    // scheme = ALPHA *( ALPHA / DIGIT / "+" / "-" / "." ) ":"
+    std::size_t colon = begin;
+    while (colon < end && (std::isalnum(static_cast<unsigned char>(url[colon])) || url[colon] == '+' ||
+                           url[colon] == '-' || url[colon] == '.')) colon++;
+    if (colon == begin || colon == end || url[colon] != ':' || !std::isalpha(static_cast<unsigned char>(url[begin])))
+        return false;
+
+    std::string result;
+    result.reserve(end - begin);
+    for (std::size_t i = begin; i < colon; i++) result += toLower(url[i]);
+    std::string scheme = result;
+    result += ':';
+
+    // Locate the end of each component
+    std::size_t fragment = url.find('#', colon + 1);
+    if (fragment == std::string::npos || fragment > end) fragment = end;
+    std::size_t query = url.find('?', colon + 1);
+    if (query == std::string::npos || query > fragment) query = fragment;
+
+    std::size_t pathBegin = colon + 1;
+    bool hasAuthority = pathBegin + 1 < query && url[pathBegin] == '/' && url[pathBegin + 1] == '/';
+    if (hasAuthority) {
+        std::size_t authority = pathBegin + 2;
+        std::size_t authorityEnd = authority;
+        while (authorityEnd < query && url[authorityEnd] != '/') authorityEnd++;
+
+        // userinfo is case-sensitive and kept verbatim
+        std::size_t at = url.rfind('@', authorityEnd - 1);
+        std::size_t host = (at != std::string::npos && at >= authority) ? at + 1 : authority;
+
+        // The port starts at the last ':' that is not inside an IPv6 literal
+        std::size_t port = authorityEnd;
+        for (std::size_t i = authorityEnd; i > host; i--) {
+            if (url[i - 1] == ']') break;
+            if (url[i - 1] == ':') {
+                port = i - 1;
+                break;
+            }
+        }
+
+        result += "//";
+        result.append(url, authority, host - authority);
+        for (std::size_t i = host; i < port; i++) result += toLower(url[i]);
+        // Drop a trailing dot of a fully qualified host name
+        if (result.back() == '.') result.pop_back();
+
+        if (port + 1 < authorityEnd) {
+            std::size_t digits = port + 1;
+            while (digits + 1 < authorityEnd && url[digits] == '0') digits++;
+            const char* known = defaultPort(scheme);
+            if (!known || url.compare(digits, authorityEnd - digits, known) != 0) {
+                result += ':';
+                result.append(url, digits, authorityEnd - digits);
+            }
+        }
+        pathBegin = authorityEnd;
+    }
+
+    // Path
+    std::string path;
+    appendEscaped(path, url, pathBegin, query);
+    if (hasAuthority) {
+        if (path.empty()) path = "/";
+        path = removeDotSegments(path);
+        if (options.stripTrailingSlash && path.size() > 1 && path.back() == '/') path.pop_back();
+    }
+    result += path;
+
+    // Query: keep the parameters not matched by the filters
+    if (query < fragment) {
+        std::vector<std::pair<std::size_t, std::size_t>> params;
+        std::size_t i = query + 1;
+        while (i <= fragment) {
+            std::size_t next = url.find('&', i);
+            if (next == std::string::npos || next > fragment) next = fragment;
+            std::size_t nameEnd = url.find('=', i);
+            if (nameEnd == std::string::npos || nameEnd > next) nameEnd = next;
+            if (next > i && !isDropped(url, i, nameEnd, options.droppedParams))
+                params.emplace_back(i, next);
+            i = next + 1;
+        }
+        if (options.sortParams) {
+            std::stable_sort(params.begin(), params.end(), [&url](const auto& a, const auto& b) {
+                return url.compare(a.first, a.second - a.first, url, b.first, b.second - b.first) < 0;
+            });
+        }
+        for (std::size_t k = 0; k < params.size(); k++) {
+            result += k == 0 ? '?' : '&';
+            appendEscaped(result, url, params[k].first, params[k].second);
+        }
+    }
+
+    if (!options.stripFragment && fragment < end) {
+        appendEscaped(result, url, fragment, end);
+    }
+
+    canonical = std::move(result);
+    return true;
+}
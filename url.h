@@ -0,0 +1,38 @@
+#pragma once
+#ifndef URL_H
+#define URL_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Options controlling how normalizeUrl() canonicalizes a URL.
+ *
+ * Query parameters whose name matches one of the filters are removed. A filter
+ * ending in '*' matches every parameter name starting with the text before it,
+ * e.g. "utm_*" matches "utm_source" and "utm_campaign".
+ */
+struct UrlNormalizeOptions {
+    std::vector<std::string> droppedParams{"utm_*", "fbclid", "gclid", "dclid", "msclkid", "mc_cid", "mc_eid", "spm"};
+    bool sortParams = true;          //!< Sort the remaining query parameters by name.
+    bool stripFragment = true;       //!< Remove the "#fragment" part.
+    bool stripTrailingSlash = true;  //!< Remove a trailing '/' from non-root paths.
+};
+
+/**
+ * @brief Canonicalize a URL for request deduplication and cache keying.
+ *
+ * This function lowercases the scheme and host, removes the default port of
+ * http, https and ftp, normalizes an empty path to "/", uppercases the hex
+ * digits of percent escapes, resolves "." and ".." path segments, drops the
+ * query parameters selected by the options and strips the fragment.
+ *
+ * @param url The URL as written in the library.
+ * @param canonical Receives the canonical URL. It is left unchanged on failure.
+ * @param options The normalization options.
+ * @return true if url has a scheme and could be normalized, false otherwise.
+ */
+bool normalizeUrl(const std::string& url, std::string& canonical,
+                  const UrlNormalizeOptions& options = UrlNormalizeOptions{});
+
+#endif
@@ -1,11 +1,10 @@
 #include "webpage.h"
 #include <typeinfo>
 #include <stdexcept>
-#include "third_parties/cpp-httplib/httplib.h"
 #include "third_parties/nlohmann/json.hpp"
 #include "utils.hpp"
-
-extern httplib::Client client;
+#include "url.h"
+#include "metadata.h"
 
 /**
  * @brief Construct a new WebPage object with the given attributes.
@@ -22,30 +21,33 @@ WebPage::WebPage(const std::string& id, const std::string& title, const std::str
  * 
  * This constructor initializes a new WebPage object with the given attributes: id and url.
  * It retrieves the webpage title from an external API using the provided URL.
+ * The request is made with the canonical form of the URL (see normalizeUrl()),
+ * while the URL is printed exactly as given.
  * 
  * @param id The unique identifier for the webpage citation.
  * @param url The website URL of the webpage.
  * 
  * @note This constructor fetches the webpage title from an external API using the provided URL.
  *       If the request is successful, the title is extracted from the response body and assigned
- *       to the WebPage object. If the request fails, an error message is printed to standard error.
+ *       to the WebPage object. If the request fails, std::runtime_error is thrown.
  * 
  * @note It is recommended to use try-catch blocks to handle potential exceptions
  *       when calling this constructor, such as network errors or JSON parsing errors.
 */
 WebPage::WebPage(const std::string& id, const std::string& url) : Citation{id}, url{url} {
-    // Make an HTTP GET request to retrieve the webpage title using the provided URL
-    auto result = client.Get("/title/" + encodeUriComponent(url));
+    // Requests are keyed on the canonical URL so that equivalent URLs resolve once;
+    // fall back to the URL as written if it cannot be parsed.
+    std::string canonical;
+    if(!normalizeUrl(url, canonical)) canonical = url;
 
-    // Check if the request was successful (HTTP status code 200)
-    if(result && result->status == httplib::OK_200) {
-        // Parse the reponse body as JSON to extract the webpage title
-        auto jsonObj = nlohmann::json::parse(result->body);
-        if(!check_string(jsonObj, "title")) exit(1);
+    // Retrieve the webpage title using the canonical URL
+    nlohmann::json jsonObj;
+    if(fetchMetadata(MetadataKind::Title, canonical, jsonObj)) {
+        if(!check_string(jsonObj, "title")) throw std::runtime_error("No title for URL: " + url);
         title = jsonObj["title"].get<std::string>();
     } else {
         // Handle HTTP errors
-        std::exit(1);
+        throw std::runtime_error("Cannot retrieve the title of URL: " + url);
     }
 }
 
@@ -51,7 +51,7 @@ public:
      * 
      * @note This constructor fetches the webpage title from an external API using the provided URL.
      *       If the request is successful, the title is extracted from the response body and assigned
-     *       to the WebPage object. If the request fails, an error message is printed to stanndanr error.
+     *       to the WebPage object. If the request fails, std::runtime_error is thrown.
      * 
      * @note It is recommended to use try-catch blocks to handle potential exceptions
      *       when calling this constructor, such as network errors or JSON parsing errors.